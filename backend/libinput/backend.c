@@ -6,6 +6,7 @@
 #include <wlr/backend/session.h>
 #include <wlr/util/log.h>
 #include "backend/libinput.h"
+#include "util/input_latency.h"
 #include "util/signal.h"
 
 static struct wlr_libinput_backend *get_libinput_backend_from_backend(
@@ -45,6 +46,22 @@ static const struct libinput_interface libinput_impl = {
 	.close_restricted = libinput_close_restricted
 };
 
+// Kernel timestamp of the events traced for input latency, or zero
+static uint64_t get_event_time_usec(struct libinput_event *event) {
+	switch (libinput_event_get_type(event)) {
+	case LIBINPUT_EVENT_KEYBOARD_KEY:
+		return libinput_event_keyboard_get_time_usec(
+			libinput_event_get_keyboard_event(event));
+	case LIBINPUT_EVENT_POINTER_MOTION:
+	case LIBINPUT_EVENT_POINTER_MOTION_ABSOLUTE:
+	case LIBINPUT_EVENT_POINTER_BUTTON:
+		return libinput_event_pointer_get_time_usec(
+			libinput_event_get_pointer_event(event));
+	default:
+		return 0;
+	}
+}
+
 static int handle_libinput_readable(int fd, uint32_t mask, void *_backend) {
 	struct wlr_libinput_backend *backend = _backend;
 	int ret = libinput_dispatch(backend->libinput_context);
@@ -55,7 +72,14 @@ static int handle_libinput_readable(int fd, uint32_t mask, void *_backend) {
 	}
 	struct libinput_event *event;
 	while ((event = libinput_get_event(backend->libinput_context))) {
+		if (input_latency_is_enabled()) {
+			uint64_t time_usec = get_event_time_usec(event);
+			if (time_usec != 0) {
+				input_latency_handle_dispatch(time_usec);
+			}
+		}
 		handle_libinput_event(backend, event);
+		input_latency_handle_dispatch_done();
 		libinput_event_destroy(event);
 	}
 	return 0;
@@ -0,0 +1,574 @@
+#define _POSIX_C_SOURCE 200809L
+#include <assert.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <wlr/interfaces/wlr_keyboard.h>
+#include <wlr/interfaces/wlr_pointer.h>
+#include <wlr/interfaces/wlr_touch.h>
+#include <wlr/util/log.h>
+#include "backend/replay.h"
+#include "util/signal.h"
+#include "util/time.h"
+
+// Records replayed per event loop iteration when replaying as fast as possible
+#define FAST_REPLAY_BATCH 256
+
+static const struct wlr_keyboard_impl replay_keyboard_impl = {
+	.name = "replay-keyboard",
+};
+
+static const struct wlr_pointer_impl replay_pointer_impl = {
+	.name = "replay-pointer",
+};
+
+static const struct wlr_touch_impl replay_touch_impl = {
+	.name = "replay-touch",
+};
+
+static struct wlr_replay_backend *replay_backend_from_backend(
+		struct wlr_backend *wlr_backend) {
+	assert(wlr_backend_is_replay(wlr_backend));
+	return (struct wlr_replay_backend *)wlr_backend;
+}
+
+static int64_t get_now_nsec(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return timespec_to_nsec(&now);
+}
+
+static struct wlr_replay_input_device *get_device(
+		struct wlr_replay_backend *backend, uint32_t id) {
+	struct wlr_replay_input_device *dev;
+	wl_list_for_each(dev, &backend->devices, link) {
+		if (dev->id == id) {
+			return dev;
+		}
+	}
+	return NULL;
+}
+
+static void device_destroy(struct wlr_replay_input_device *dev) {
+	switch (dev->type) {
+	case WLR_INPUT_DEVICE_KEYBOARD:
+		wlr_keyboard_finish(&dev->keyboard);
+		break;
+	case WLR_INPUT_DEVICE_POINTER:
+		wlr_pointer_finish(&dev->pointer);
+		break;
+	case WLR_INPUT_DEVICE_TOUCH:
+		wlr_touch_finish(&dev->touch);
+		break;
+	default:
+		abort(); // unreachable
+	}
+	wl_list_remove(&dev->link);
+	free(dev);
+}
+
+static void device_create(struct wlr_replay_backend *backend, uint32_t id,
+		const struct replay_device *desc) {
+	if (get_device(backend, id) != NULL) {
+		wlr_log(WLR_ERROR, "Duplicate input device %" PRIu32 " in recording",
+			id);
+		return;
+	}
+
+	char name[REPLAY_DEVICE_NAME_LEN + 1];
+	memcpy(name, desc->name, REPLAY_DEVICE_NAME_LEN);
+	name[REPLAY_DEVICE_NAME_LEN] = '\0';
+
+	struct wlr_replay_input_device *dev = calloc(1, sizeof(*dev));
+	if (dev == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return;
+	}
+	dev->id = id;
+	dev->type = desc->type;
+	dev->backend = backend;
+
+	struct wlr_input_device *base;
+	switch (dev->type) {
+	case WLR_INPUT_DEVICE_KEYBOARD:
+		wlr_keyboard_init(&dev->keyboard, &replay_keyboard_impl, name);
+		base = &dev->keyboard.base;
+		break;
+	case WLR_INPUT_DEVICE_POINTER:
+		wlr_pointer_init(&dev->pointer, &replay_pointer_impl, name);
+		base = &dev->pointer.base;
+		break;
+	case WLR_INPUT_DEVICE_TOUCH:
+		wlr_touch_init(&dev->touch, &replay_touch_impl, name);
+		base = &dev->touch.base;
+		break;
+	default:
+		wlr_log(WLR_ERROR, "Unsupported input device type %" PRIu32
+			" in recording", desc->type);
+		free(dev);
+		return;
+	}
+	base->vendor = desc->vendor;
+	base->product = desc->product;
+
+	wl_list_insert(&backend->devices, &dev->link);
+	wlr_signal_emit_safe(&backend->backend.events.new_input, base);
+}
+
+static bool read_payload(const struct replay_record_header *header,
+		const char *payload, void *dst, size_t size) {
+	if (header->size != size) {
+		wlr_log(WLR_ERROR, "Invalid size for input record of type %" PRIu16,
+			header->type);
+		return false;
+	}
+	memcpy(dst, payload, size);
+	return true;
+}
+
+static struct wlr_pointer *device_get_pointer(
+		struct wlr_replay_input_device *dev) {
+	return dev->type == WLR_INPUT_DEVICE_POINTER ? &dev->pointer : NULL;
+}
+
+static struct wlr_touch *device_get_touch(
+		struct wlr_replay_input_device *dev) {
+	return dev->type == WLR_INPUT_DEVICE_TOUCH ? &dev->touch : NULL;
+}
+
+static void replay_pointer_record(struct wlr_pointer *pointer,
+		const struct replay_record_header *header, const char *payload) {
+	switch (header->type) {
+	case REPLAY_POINTER_MOTION:;
+		struct replay_pointer_motion motion;
+		if (read_payload(header, payload, &motion, sizeof(motion))) {
+			struct wlr_pointer_motion_event event = {
+				.pointer = pointer,
+				.time_msec = motion.time_msec,
+				.delta_x = motion.delta_x,
+				.delta_y = motion.delta_y,
+				.unaccel_dx = motion.unaccel_dx,
+				.unaccel_dy = motion.unaccel_dy,
+			};
+			wlr_signal_emit_safe(&pointer->events.motion, &event);
+		}
+		break;
+	case REPLAY_POINTER_MOTION_ABSOLUTE:;
+		struct replay_pointer_motion_absolute motion_abs;
+		if (read_payload(header, payload, &motion_abs, sizeof(motion_abs))) {
+			struct wlr_pointer_motion_absolute_event event = {
+				.pointer = pointer,
+				.time_msec = motion_abs.time_msec,
+				.x = motion_abs.x,
+				.y = motion_abs.y,
+			};
+			wlr_signal_emit_safe(&pointer->events.motion_absolute, &event);
+		}
+		break;
+	case REPLAY_POINTER_BUTTON:;
+		struct replay_pointer_button button;
+		if (read_payload(header, payload, &button, sizeof(button))) {
+			struct wlr_pointer_button_event event = {
+				.pointer = pointer,
+				.time_msec = button.time_msec,
+				.button = button.button,
+				.state = button.state,
+			};
+			wlr_signal_emit_safe(&pointer->events.button, &event);
+		}
+		break;
+	case REPLAY_POINTER_AXIS:;
+		struct replay_pointer_axis axis;
+		if (read_payload(header, payload, &axis, sizeof(axis))) {
+			struct wlr_pointer_axis_event event = {
+				.pointer = pointer,
+				.time_msec = axis.time_msec,
+				.source = axis.source,
+				.orientation = axis.orientation,
+				.delta = axis.delta,
+				.delta_discrete = axis.delta_discrete,
+			};
+			wlr_signal_emit_safe(&pointer->events.axis, &event);
+		}
+		break;
+	case REPLAY_POINTER_FRAME:
+		wlr_signal_emit_safe(&pointer->events.frame, pointer);
+		break;
+	}
+}
+
+static void replay_touch_record(struct wlr_touch *touch,
+		const struct replay_record_header *header, const char *payload) {
+	struct replay_touch_position position;
+	struct replay_touch_id id;
+	switch (header->type) {
+	case REPLAY_TOUCH_DOWN:
+		if (read_payload(header, payload, &position, sizeof(position))) {
+			struct wlr_touch_down_event event = {
+				.touch = touch,
+				.time_msec = position.time_msec,
+				.touch_id = position.touch_id,
+				.x = position.x,
+				.y = position.y,
+			};
+			wlr_signal_emit_safe(&touch->events.down, &event);
+		}
+		break;
+	case REPLAY_TOUCH_UP:
+		if (read_payload(header, payload, &id, sizeof(id))) {
+			struct wlr_touch_up_event event = {
+				.touch = touch,
+				.time_msec = id.time_msec,
+				.touch_id = id.touch_id,
+			};
+			wlr_signal_emit_safe(&touch->events.up, &event);
+		}
+		break;
+	case REPLAY_TOUCH_MOTION:
+		if (read_payload(header, payload, &position, sizeof(position))) {
+			struct wlr_touch_motion_event event = {
+				.touch = touch,
+				.time_msec = position.time_msec,
+				.touch_id = position.touch_id,
+				.x = position.x,
+				.y = position.y,
+			};
+			wlr_signal_emit_safe(&touch->events.motion, &event);
+		}
+		break;
+	case REPLAY_TOUCH_CANCEL:
+		if (read_payload(header, payload, &id, sizeof(id))) {
+			struct wlr_touch_cancel_event event = {
+				.touch = touch,
+				.time_msec = id.time_msec,
+				.touch_id = id.touch_id,
+			};
+			wlr_signal_emit_safe(&touch->events.cancel, &event);
+		}
+		break;
+	case REPLAY_TOUCH_FRAME:
+		wlr_signal_emit_safe(&touch->events.frame, touch);
+		break;
+	}
+}
+
+static void replay_record(struct wlr_replay_backend *backend,
+		const struct replay_record_header *header, const char *payload) {
+	if (header->type == REPLAY_DEVICE_ADD) {
+		struct replay_device desc;
+		if (read_payload(header, payload, &desc, sizeof(desc))) {
+			device_create(backend, header->device, &desc);
+		}
+		return;
+	}
+
+	struct wlr_replay_input_device *dev = get_device(backend, header->device);
+	if (dev == NULL) {
+		wlr_log(WLR_DEBUG, "Input record for unknown device %" PRIu32,
+			header->device);
+		return;
+	}
+
+	struct wlr_pointer *pointer;
+	struct wlr_touch *touch;
+	switch (header->type) {
+	case REPLAY_DEVICE_REMOVE:
+		device_destroy(dev);
+		break;
+	case REPLAY_POINTER_MOTION:
+	case REPLAY_POINTER_MOTION_ABSOLUTE:
+	case REPLAY_POINTER_BUTTON:
+	case REPLAY_POINTER_AXIS:
+	case REPLAY_POINTER_FRAME:
+		if ((pointer = device_get_pointer(dev)) != NULL) {
+			replay_pointer_record(pointer, header, payload);
+		}
+		break;
+	case REPLAY_KEYBOARD_KEY:;
+		struct replay_keyboard_key key;
+		if (dev->type == WLR_INPUT_DEVICE_KEYBOARD &&
+				read_payload(header, payload, &key, sizeof(key))) {
+			struct wlr_keyboard_key_event event = {
+				.time_msec = key.time_msec,
+				.keycode = key.keycode,
+				.state = key.state,
+				.update_state = key.update_state,
+			};
+			wlr_keyboard_notify_key(&dev->keyboard, &event);
+		}
+		break;
+	case REPLAY_TOUCH_DOWN:
+	case REPLAY_TOUCH_UP:
+	case REPLAY_TOUCH_MOTION:
+	case REPLAY_TOUCH_CANCEL:
+	case REPLAY_TOUCH_FRAME:
+		if ((touch = device_get_touch(dev)) != NULL) {
+			replay_touch_record(touch, header, payload);
+		}
+		break;
+	default:
+		wlr_log(WLR_DEBUG, "Unknown input record type %" PRIu16,
+			header->type);
+		break;
+	}
+}
+
+/**
+ * Get the header of the next record. Returns false at the end of the
+ * recording.
+ */
+static bool peek_record(struct wlr_replay_backend *backend,
+		struct replay_record_header *header) {
+	if (backend->size - backend->offset < sizeof(*header)) {
+		return false;
+	}
+	memcpy(header, backend->data + backend->offset, sizeof(*header));
+	if (backend->size - backend->offset - sizeof(*header) < header->size) {
+		wlr_log(WLR_ERROR, "Truncated input recording");
+		return false;
+	}
+	return true;
+}
+
+static bool replay_next_record(struct wlr_replay_backend *backend) {
+	struct replay_record_header header;
+	if (!peek_record(backend, &header)) {
+		return false;
+	}
+	const char *payload = backend->data + backend->offset + sizeof(header);
+	backend->offset += sizeof(header) + header.size;
+	backend->records++;
+	replay_record(backend, &header, payload);
+	return true;
+}
+
+static void replay_finish(struct wlr_replay_backend *backend) {
+	if (backend->timer != NULL) {
+		wl_event_source_remove(backend->timer);
+		backend->timer = NULL;
+	}
+	if (backend->busy != NULL) {
+		wl_event_source_remove(backend->busy);
+		backend->busy = NULL;
+	}
+	for (size_t i = 0; i < 2; i++) {
+		if (backend->busy_fds[i] >= 0) {
+			close(backend->busy_fds[i]);
+			backend->busy_fds[i] = -1;
+		}
+	}
+
+	if (backend->finished) {
+		return;
+	}
+	backend->finished = true;
+
+	double elapsed = (get_now_nsec() - backend->start_nsec) / 1e9;
+	wlr_log(WLR_INFO, "Replayed %zu input records in %.3f s (%.0f records/s)",
+		backend->records, elapsed,
+		elapsed > 0 ? backend->records / elapsed : 0.0);
+}
+
+static int handle_timer(void *data) {
+	struct wlr_replay_backend *backend = data;
+
+	struct replay_record_header header;
+	while (peek_record(backend, &header)) {
+		int64_t elapsed = get_now_nsec() - backend->start_nsec;
+		if ((int64_t)header.time_nsec > elapsed) {
+			int64_t delay_ms = (header.time_nsec - elapsed + 999999) / 1000000;
+			wl_event_source_timer_update(backend->timer, delay_ms);
+			return 0;
+		}
+		replay_next_record(backend);
+	}
+
+	replay_finish(backend);
+	return 0;
+}
+
+static int handle_busy_readable(int fd, uint32_t mask, void *data) {
+	struct wlr_replay_backend *backend = data;
+
+	// The fd stays readable, this is called again on the next event loop
+	// iteration
+	for (size_t i = 0; i < FAST_REPLAY_BATCH; i++) {
+		if (!replay_next_record(backend)) {
+			replay_finish(backend);
+			break;
+		}
+	}
+	return 0;
+}
+
+static bool start_fast_replay(struct wlr_replay_backend *backend) {
+	// A pipe with unread data wakes up the event loop on each iteration,
+	// without starving other event sources
+	if (pipe(backend->busy_fds) != 0) {
+		wlr_log_errno(WLR_ERROR, "pipe failed");
+		return false;
+	}
+	for (size_t i = 0; i < 2; i++) {
+		fcntl(backend->busy_fds[i], F_SETFD, FD_CLOEXEC);
+	}
+	char byte = 0;
+	if (write(backend->busy_fds[1], &byte, sizeof(byte)) != sizeof(byte)) {
+		wlr_log_errno(WLR_ERROR, "write failed");
+		return false;
+	}
+
+	struct wl_event_loop *loop = wl_display_get_event_loop(backend->display);
+	backend->busy = wl_event_loop_add_fd(loop, backend->busy_fds[0],
+		WL_EVENT_READABLE, handle_busy_readable, backend);
+	return backend->busy != NULL;
+}
+
+static bool backend_start(struct wlr_backend *wlr_backend) {
+	struct wlr_replay_backend *backend =
+		replay_backend_from_backend(wlr_backend);
+	wlr_log(WLR_INFO, "Starting replay backend");
+
+	backend->start_nsec = get_now_nsec();
+	backend->started = true;
+
+	if (!backend->realtime) {
+		if (!start_fast_replay(backend)) {
+			replay_finish(backend);
+			return false;
+		}
+		return true;
+	}
+
+	struct wl_event_loop *loop = wl_display_get_event_loop(backend->display);
+	backend->timer = wl_event_loop_add_timer(loop, handle_timer, backend);
+	if (backend->timer == NULL) {
+		wlr_log(WLR_ERROR, "Failed to create replay timer");
+		return false;
+	}
+	handle_timer(backend);
+	return true;
+}
+
+static void backend_destroy(struct wlr_backend *wlr_backend) {
+	if (!wlr_backend) {
+		return;
+	}
+	struct wlr_replay_backend *backend =
+		replay_backend_from_backend(wlr_backend);
+
+	wl_list_remove(&backend->display_destroy.link);
+
+	backend->finished = true;
+	replay_finish(backend);
+
+	struct wlr_replay_input_device *dev, *tmp;
+	wl_list_for_each_safe(dev, tmp, &backend->devices, link) {
+		device_destroy(dev);
+	}
+
+	wlr_backend_finish(wlr_backend);
+
+	free(backend->data);
+	free(backend);
+}
+
+static const struct wlr_backend_impl backend_impl = {
+	.start = backend_start,
+	.destroy = backend_destroy,
+};
+
+static void handle_display_destroy(struct wl_listener *listener, void *data) {
+	struct wlr_replay_backend *backend =
+		wl_container_of(listener, backend, display_destroy);
+	backend_destroy(&backend->backend);
+}
+
+static bool read_recording(struct wlr_replay_backend *backend,
+		const char *path) {
+	FILE *f = fopen(path, "rb");
+	if (f == NULL) {
+		wlr_log_errno(WLR_ERROR, "Failed to open input recording '%s'", path);
+		return false;
+	}
+
+	struct replay_file_header header;
+	if (fread(&header, 1, sizeof(header), f) != sizeof(header) ||
+			memcmp(header.magic, REPLAY_FILE_MAGIC, sizeof(header.magic)) != 0) {
+		wlr_log(WLR_ERROR, "'%s' is not an input recording", path);
+		goto error;
+	}
+	if (header.version != REPLAY_FILE_VERSION) {
+		wlr_log(WLR_ERROR, "Unsupported input recording version %" PRIu32,
+			header.version);
+		goto error;
+	}
+
+	size_t cap = 0;
+	while (!feof(f)) {
+		if (backend->size == cap) {
+			cap = cap == 0 ? 4096 : cap * 2;
+			char *data = realloc(backend->data, cap);
+			if (data == NULL) {
+				wlr_log_errno(WLR_ERROR, "Allocation failed");
+				goto error;
+			}
+			backend->data = data;
+		}
+		backend->size += fread(backend->data + backend->size, 1,
+			cap - backend->size, f);
+		if (ferror(f)) {
+			wlr_log_errno(WLR_ERROR, "Failed to read input recording");
+			goto error;
+		}
+	}
+
+	fclose(f);
+	return true;
+
+error:
+	fclose(f);
+	return false;
+}
+
+struct wlr_backend *wlr_replay_backend_create(struct wl_display *display,
+		const char *path, bool realtime) {
+	wlr_log(WLR_INFO, "Creating replay backend");
+
+	struct wlr_replay_backend *backend = calloc(1, sizeof(*backend));
+	if (!backend) {
+		wlr_log(WLR_ERROR, "Failed to allocate wlr_replay_backend");
+		return NULL;
+	}
+
+	if (!read_recording(backend, path)) {
+		free(backend->data);
+		free(backend);
+		return NULL;
+	}
+
+	wlr_backend_init(&backend->backend, &backend_impl);
+
+	backend->display = display;
+	backend->realtime = realtime;
+	backend->busy_fds[0] = backend->busy_fds[1] = -1;
+	wl_list_init(&backend->devices);
+
+	backend->display_destroy.notify = handle_display_destroy;
+	wl_display_add_destroy_listener(display, &backend->display_destroy);
+
+	return &backend->backend;
+}
+
+bool wlr_replay_backend_is_finished(struct wlr_backend *wlr_backend) {
+	struct wlr_replay_backend *backend =
+		replay_backend_from_backend(wlr_backend);
+	return backend->finished;
+}
+
+bool wlr_backend_is_replay(struct wlr_backend *backend) {
+	return backend->impl == &backend_impl;
+}
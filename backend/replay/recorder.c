@@ -0,0 +1,341 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <wlr/util/log.h>
+#include "backend/replay.h"
+#include "util/time.h"
+
+struct wlr_input_recorder {
+	FILE *file;
+	int64_t start_nsec;
+	uint32_t next_device_id;
+	bool failed;
+	struct wl_list devices; // recorder_device.link
+};
+
+struct recorder_device {
+	struct wlr_input_recorder *recorder;
+	struct wlr_input_device *device;
+	uint32_t id;
+	struct wl_list link;
+
+	struct wl_listener destroy;
+	struct wl_listener keyboard_key;
+	struct wl_listener pointer_motion;
+	struct wl_listener pointer_motion_absolute;
+	struct wl_listener pointer_button;
+	struct wl_listener pointer_axis;
+	struct wl_listener pointer_frame;
+	struct wl_listener touch_down;
+	struct wl_listener touch_up;
+	struct wl_listener touch_motion;
+	struct wl_listener touch_cancel;
+	struct wl_listener touch_frame;
+};
+
+static int64_t get_now_nsec(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return timespec_to_nsec(&now);
+}
+
+static void write_record(struct wlr_input_recorder *recorder,
+		uint32_t device, enum replay_record_type type,
+		const void *payload, size_t size) {
+	if (recorder->failed) {
+		return;
+	}
+
+	struct replay_record_header header = {
+		.type = type,
+		.size = size,
+		.device = device,
+		.time_nsec = get_now_nsec() - recorder->start_nsec,
+	};
+	if (fwrite(&header, 1, sizeof(header), recorder->file) != sizeof(header) ||
+			(size > 0 && fwrite(payload, 1, size, recorder->file) != size)) {
+		wlr_log_errno(WLR_ERROR, "Failed to write input recording");
+		recorder->failed = true;
+	}
+}
+
+static void device_write_record(struct recorder_device *dev,
+		enum replay_record_type type, const void *payload, size_t size) {
+	write_record(dev->recorder, dev->id, type, payload, size);
+}
+
+static void handle_keyboard_key(struct wl_listener *listener, void *data) {
+	struct recorder_device *dev =
+		wl_container_of(listener, dev, keyboard_key);
+	struct wlr_keyboard_key_event *event = data;
+	struct replay_keyboard_key key = {
+		.time_msec = event->time_msec,
+		.keycode = event->keycode,
+		.state = event->state,
+		.update_state = event->update_state,
+	};
+	device_write_record(dev, REPLAY_KEYBOARD_KEY, &key, sizeof(key));
+}
+
+static void handle_pointer_motion(struct wl_listener *listener, void *data) {
+	struct recorder_device *dev =
+		wl_container_of(listener, dev, pointer_motion);
+	struct wlr_pointer_motion_event *event = data;
+	struct replay_pointer_motion motion = {
+		.time_msec = event->time_msec,
+		.delta_x = event->delta_x,
+		.delta_y = event->delta_y,
+		.unaccel_dx = event->unaccel_dx,
+		.unaccel_dy = event->unaccel_dy,
+	};
+	device_write_record(dev, REPLAY_POINTER_MOTION, &motion, sizeof(motion));
+}
+
+static void handle_pointer_motion_absolute(struct wl_listener *listener,
+		void *data) {
+	struct recorder_device *dev =
+		wl_container_of(listener, dev, pointer_motion_absolute);
+	struct wlr_pointer_motion_absolute_event *event = data;
+	struct replay_pointer_motion_absolute motion = {
+		.time_msec = event->time_msec,
+		.x = event->x,
+		.y = event->y,
+	};
+	device_write_record(dev, REPLAY_POINTER_MOTION_ABSOLUTE,
+		&motion, sizeof(motion));
+}
+
+static void handle_pointer_button(struct wl_listener *listener, void *data) {
+	struct recorder_device *dev =
+		wl_container_of(listener, dev, pointer_button);
+	struct wlr_pointer_button_event *event = data;
+	struct replay_pointer_button button = {
+		.time_msec = event->time_msec,
+		.button = event->button,
+		.state = event->state,
+	};
+	device_write_record(dev, REPLAY_POINTER_BUTTON, &button, sizeof(button));
+}
+
+static void handle_pointer_axis(struct wl_listener *listener, void *data) {
+	struct recorder_device *dev =
+		wl_container_of(listener, dev, pointer_axis);
+	struct wlr_pointer_axis_event *event = data;
+	struct replay_pointer_axis axis = {
+		.time_msec = event->time_msec,
+		.source = event->source,
+		.orientation = event->orientation,
+		.delta_discrete = event->delta_discrete,
+		.delta = event->delta,
+	};
+	device_write_record(dev, REPLAY_POINTER_AXIS, &axis, sizeof(axis));
+}
+
+static void handle_pointer_frame(struct wl_listener *listener, void *data) {
+	struct recorder_device *dev =
+		wl_container_of(listener, dev, pointer_frame);
+	device_write_record(dev, REPLAY_POINTER_FRAME, NULL, 0);
+}
+
+static void handle_touch_down(struct wl_listener *listener, void *data) {
+	struct recorder_device *dev = wl_container_of(listener, dev, touch_down);
+	struct wlr_touch_down_event *event = data;
+	struct replay_touch_position position = {
+		.time_msec = event->time_msec,
+		.touch_id = event->touch_id,
+		.x = event->x,
+		.y = event->y,
+	};
+	device_write_record(dev, REPLAY_TOUCH_DOWN, &position, sizeof(position));
+}
+
+static void handle_touch_up(struct wl_listener *listener, void *data) {
+	struct recorder_device *dev = wl_container_of(listener, dev, touch_up);
+	struct wlr_touch_up_event *event = data;
+	struct replay_touch_id id = {
+		.time_msec = event->time_msec,
+		.touch_id = event->touch_id,
+	};
+	device_write_record(dev, REPLAY_TOUCH_UP, &id, sizeof(id));
+}
+
+static void handle_touch_motion(struct wl_listener *listener, void *data) {
+	struct recorder_device *dev = wl_container_of(listener, dev, touch_motion);
+	struct wlr_touch_motion_event *event = data;
+	struct replay_touch_position position = {
+		.time_msec = event->time_msec,
+		.touch_id = event->touch_id,
+		.x = event->x,
+		.y = event->y,
+	};
+	device_write_record(dev, REPLAY_TOUCH_MOTION, &position, sizeof(position));
+}
+
+static void handle_touch_cancel(struct wl_listener *listener, void *data) {
+	struct recorder_device *dev = wl_container_of(listener, dev, touch_cancel);
+	struct wlr_touch_cancel_event *event = data;
+	struct replay_touch_id id = {
+		.time_msec = event->time_msec,
+		.touch_id = event->touch_id,
+	};
+	device_write_record(dev, REPLAY_TOUCH_CANCEL, &id, sizeof(id));
+}
+
+static void handle_touch_frame(struct wl_listener *listener, void *data) {
+	struct recorder_device *dev = wl_container_of(listener, dev, touch_frame);
+	device_write_record(dev, REPLAY_TOUCH_FRAME, NULL, 0);
+}
+
+static void device_destroy(struct recorder_device *dev) {
+	wl_list_remove(&dev->destroy.link);
+	wl_list_remove(&dev->keyboard_key.link);
+	wl_list_remove(&dev->pointer_motion.link);
+	wl_list_remove(&dev->pointer_motion_absolute.link);
+	wl_list_remove(&dev->pointer_button.link);
+	wl_list_remove(&dev->pointer_axis.link);
+	wl_list_remove(&dev->pointer_frame.link);
+	wl_list_remove(&dev->touch_down.link);
+	wl_list_remove(&dev->touch_up.link);
+	wl_list_remove(&dev->touch_motion.link);
+	wl_list_remove(&dev->touch_cancel.link);
+	wl_list_remove(&dev->touch_frame.link);
+	wl_list_remove(&dev->link);
+	free(dev);
+}
+
+static void handle_device_destroy(struct wl_listener *listener, void *data) {
+	struct recorder_device *dev = wl_container_of(listener, dev, destroy);
+	device_write_record(dev, REPLAY_DEVICE_REMOVE, NULL, 0);
+	device_destroy(dev);
+}
+
+struct wlr_input_recorder *wlr_input_recorder_create(const char *path) {
+	struct wlr_input_recorder *recorder = calloc(1, sizeof(*recorder));
+	if (recorder == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+
+	recorder->file = fopen(path, "wbe");
+	if (recorder->file == NULL) {
+		wlr_log_errno(WLR_ERROR, "Failed to open '%s'", path);
+		free(recorder);
+		return NULL;
+	}
+
+	struct replay_file_header header = {
+		.version = REPLAY_FILE_VERSION,
+	};
+	memcpy(header.magic, REPLAY_FILE_MAGIC, sizeof(header.magic));
+	if (fwrite(&header, 1, sizeof(header), recorder->file) != sizeof(header)) {
+		wlr_log_errno(WLR_ERROR, "Failed to write input recording");
+		fclose(recorder->file);
+		free(recorder);
+		return NULL;
+	}
+
+	recorder->start_nsec = get_now_nsec();
+	wl_list_init(&recorder->devices);
+	return recorder;
+}
+
+bool wlr_input_recorder_add_device(struct wlr_input_recorder *recorder,
+		struct wlr_input_device *device) {
+	if (device->type != WLR_INPUT_DEVICE_KEYBOARD &&
+			device->type != WLR_INPUT_DEVICE_POINTER &&
+			device->type != WLR_INPUT_DEVICE_TOUCH) {
+		return false;
+	}
+
+	struct recorder_device *dev = calloc(1, sizeof(*dev));
+	if (dev == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return false;
+	}
+	dev->recorder = recorder;
+	dev->device = device;
+	dev->id = recorder->next_device_id++;
+
+	wl_list_init(&dev->keyboard_key.link);
+	wl_list_init(&dev->pointer_motion.link);
+	wl_list_init(&dev->pointer_motion_absolute.link);
+	wl_list_init(&dev->pointer_button.link);
+	wl_list_init(&dev->pointer_axis.link);
+	wl_list_init(&dev->pointer_frame.link);
+	wl_list_init(&dev->touch_down.link);
+	wl_list_init(&dev->touch_up.link);
+	wl_list_init(&dev->touch_motion.link);
+	wl_list_init(&dev->touch_cancel.link);
+	wl_list_init(&dev->touch_frame.link);
+
+	switch (device->type) {
+	case WLR_INPUT_DEVICE_KEYBOARD:;
+		struct wlr_keyboard *keyboard = wlr_keyboard_from_input_device(device);
+		dev->keyboard_key.notify = handle_keyboard_key;
+		wl_signal_add(&keyboard->events.key, &dev->keyboard_key);
+		break;
+	case WLR_INPUT_DEVICE_POINTER:;
+		struct wlr_pointer *pointer = wlr_pointer_from_input_device(device);
+		dev->pointer_motion.notify = handle_pointer_motion;
+		wl_signal_add(&pointer->events.motion, &dev->pointer_motion);
+		dev->pointer_motion_absolute.notify = handle_pointer_motion_absolute;
+		wl_signal_add(&pointer->events.motion_absolute,
+			&dev->pointer_motion_absolute);
+		dev->pointer_button.notify = handle_pointer_button;
+		wl_signal_add(&pointer->events.button, &dev->pointer_button);
+		dev->pointer_axis.notify = handle_pointer_axis;
+		wl_signal_add(&pointer->events.axis, &dev->pointer_axis);
+		dev->pointer_frame.notify = handle_pointer_frame;
+		wl_signal_add(&pointer->events.frame, &dev->pointer_frame);
+		break;
+	case WLR_INPUT_DEVICE_TOUCH:;
+		struct wlr_touch *touch = wlr_touch_from_input_device(device);
+		dev->touch_down.notify = handle_touch_down;
+		wl_signal_add(&touch->events.down, &dev->touch_down);
+		dev->touch_up.notify = handle_touch_up;
+		wl_signal_add(&touch->events.up, &dev->touch_up);
+		dev->touch_motion.notify = handle_touch_motion;
+		wl_signal_add(&touch->events.motion, &dev->touch_motion);
+		dev->touch_cancel.notify = handle_touch_cancel;
+		wl_signal_add(&touch->events.cancel, &dev->touch_cancel);
+		dev->touch_frame.notify = handle_touch_frame;
+		wl_signal_add(&touch->events.frame, &dev->touch_frame);
+		break;
+	default:
+		abort(); // unreachable
+	}
+
+	dev->destroy.notify = handle_device_destroy;
+	wl_signal_add(&device->events.destroy, &dev->destroy);
+	wl_list_insert(&recorder->devices, &dev->link);
+
+	struct replay_device desc = {
+		.type = device->type,
+		.vendor = device->vendor,
+		.product = device->product,
+	};
+	if (device->name != NULL) {
+		snprintf(desc.name, sizeof(desc.name), "%s", device->name);
+	}
+	device_write_record(dev, REPLAY_DEVICE_ADD, &desc, sizeof(desc));
+
+	return true;
+}
+
+void wlr_input_recorder_destroy(struct wlr_input_recorder *recorder) {
+	if (recorder == NULL) {
+		return;
+	}
+
+	struct recorder_device *dev, *tmp;
+	wl_list_for_each_safe(dev, tmp, &recorder->devices, link) {
+		device_destroy(dev);
+	}
+
+	if (fclose(recorder->file) != 0) {
+		wlr_log_errno(WLR_ERROR, "Failed to write input recording");
+	}
+	free(recorder);
+}
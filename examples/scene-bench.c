@@ -0,0 +1,452 @@
+#define _POSIX_C_SOURCE 200112L
+#include <assert.h>
+#include <drm_fourcc.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <wayland-server-core.h>
+#include <wlr/backend.h>
+#include <wlr/backend/headless.h>
+#include <wlr/interfaces/wlr_buffer.h>
+#include <wlr/render/allocator.h>
+#include <wlr/render/pixman.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/util/log.h>
+
+/* Benchmark of the scene-graph rendering path, using the headless backend and
+ * the Pixman renderer so that it can run on machines without a GPU.
+ *
+ * A synthetic scene made of windows (each with a border, a main buffer,
+ * sub-surfaces and decorations) is rendered for a number of frames. Each frame
+ * a scripted sequence moves a window, updates the contents of a few others
+ * and hit-tests the pointer position. Statistics are reported for each call
+ * to wlr_scene_output_commit(). */
+
+struct bench_buffer {
+	struct wlr_buffer base;
+	void *data;
+	uint32_t format;
+	size_t stride;
+};
+
+struct window {
+	struct wlr_scene_tree *tree;
+	struct wlr_scene_buffer *content;
+	struct bench_buffer *buffers[2];
+	int current;
+	int width, height;
+};
+
+static const struct option long_options[] = {
+	{"windows", required_argument, NULL, 'n'},
+	{"subsurfaces", required_argument, NULL, 's'},
+	{"rects", required_argument, NULL, 'r'},
+	{"frames", required_argument, NULL, 'f'},
+	{"damaged", required_argument, NULL, 'd'},
+	{"size", required_argument, NULL, 'o'},
+	{"help", no_argument, NULL, 'h'},
+	{0},
+};
+
+static const char usage[] =
+	"usage: scene-bench [options]\n"
+	"\n"
+	"  -n, --windows <n>      number of windows (default: 30)\n"
+	"  -s, --subsurfaces <n>  sub-surfaces per window (default: 2)\n"
+	"  -r, --rects <n>        decoration rects per window (default: 4)\n"
+	"  -f, --frames <n>       number of frames to render (default: 500)\n"
+	"  -d, --damaged <n>      windows updated each frame (default: 3)\n"
+	"  -o, --size <w>x<h>     output size (default: 3840x2160)\n"
+	"  -h, --help             show this help\n";
+
+#if defined(__GLIBC__)
+// Count allocations made by the whole process, including wlroots and pixman
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static uint64_t alloc_count = 0;
+
+void *malloc(size_t size) {
+	alloc_count++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+	alloc_count++;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+	alloc_count++;
+	return __libc_realloc(ptr, size);
+}
+
+#define HAVE_ALLOC_COUNT 1
+#else
+static uint64_t alloc_count = 0;
+#define HAVE_ALLOC_COUNT 0
+#endif
+
+static const struct wlr_buffer_impl bench_buffer_impl;
+
+static struct bench_buffer *bench_buffer_from_buffer(
+		struct wlr_buffer *wlr_buffer) {
+	assert(wlr_buffer->impl == &bench_buffer_impl);
+	return (struct bench_buffer *)wlr_buffer;
+}
+
+static void bench_buffer_destroy(struct wlr_buffer *wlr_buffer) {
+	struct bench_buffer *buffer = bench_buffer_from_buffer(wlr_buffer);
+	free(buffer->data);
+	free(buffer);
+}
+
+static bool bench_buffer_begin_data_ptr_access(struct wlr_buffer *wlr_buffer,
+		uint32_t flags, void **data, uint32_t *format, size_t *stride) {
+	struct bench_buffer *buffer = bench_buffer_from_buffer(wlr_buffer);
+	*data = buffer->data;
+	*format = buffer->format;
+	*stride = buffer->stride;
+	return true;
+}
+
+static void bench_buffer_end_data_ptr_access(struct wlr_buffer *wlr_buffer) {
+	// This space is intentionally left blank
+}
+
+static const struct wlr_buffer_impl bench_buffer_impl = {
+	.destroy = bench_buffer_destroy,
+	.begin_data_ptr_access = bench_buffer_begin_data_ptr_access,
+	.end_data_ptr_access = bench_buffer_end_data_ptr_access,
+};
+
+static struct bench_buffer *bench_buffer_create(int width, int height,
+		uint32_t format, uint32_t color) {
+	struct bench_buffer *buffer = calloc(1, sizeof(*buffer));
+	if (buffer == NULL) {
+		return NULL;
+	}
+	wlr_buffer_init(&buffer->base, &bench_buffer_impl, width, height);
+	buffer->format = format;
+	buffer->stride = width * 4;
+	buffer->data = malloc(buffer->stride * height);
+	if (buffer->data == NULL) {
+		free(buffer);
+		return NULL;
+	}
+
+	uint32_t *pixels = buffer->data;
+	for (size_t i = 0; i < (size_t)width * height; i++) {
+		pixels[i] = color;
+	}
+
+	return buffer;
+}
+
+static void bench_buffer_fill(struct bench_buffer *buffer,
+		const pixman_box32_t *box, uint32_t color) {
+	uint32_t *pixels = buffer->data;
+	size_t row = buffer->stride / 4;
+	for (int y = box->y1; y < box->y2; y++) {
+		for (int x = box->x1; x < box->x2; x++) {
+			pixels[y * row + x] = color;
+		}
+	}
+}
+
+static bool window_init(struct window *win, struct wlr_scene_tree *parent,
+		int index, int width, int height, int subsurfaces, int rects) {
+	static const float border_color[4] = { 0.3, 0.3, 0.3, 1.0 };
+	static const float decoration_color[4] = { 0.5, 0.1, 0.1, 0.5 };
+
+	win->width = width;
+	win->height = height;
+	win->tree = wlr_scene_tree_create(parent);
+	if (win->tree == NULL) {
+		return false;
+	}
+
+	wlr_scene_rect_create(win->tree, width + 4, height + 4, border_color);
+
+	for (size_t i = 0; i < 2; i++) {
+		win->buffers[i] = bench_buffer_create(width, height,
+			DRM_FORMAT_XRGB8888, 0xFF000000 | (index * 0x10203 + i * 0x40));
+		if (win->buffers[i] == NULL) {
+			return false;
+		}
+	}
+
+	win->content = wlr_scene_buffer_create(win->tree,
+		&win->buffers[0]->base);
+	wlr_scene_node_set_position(&win->content->node, 2, 2);
+
+	for (int i = 0; i < subsurfaces; i++) {
+		int w = width / 4, h = height / 4;
+		struct bench_buffer *buffer = bench_buffer_create(w, h,
+			DRM_FORMAT_ARGB8888, 0x80204080);
+		if (buffer == NULL) {
+			return false;
+		}
+		struct wlr_scene_buffer *sub =
+			wlr_scene_buffer_create(win->tree, &buffer->base);
+		wlr_buffer_drop(&buffer->base);
+		wlr_scene_node_set_position(&sub->node,
+			2 + (i * 37) % (width - w + 1), 2 + (i * 53) % (height - h + 1));
+	}
+
+	for (int i = 0; i < rects; i++) {
+		struct wlr_scene_rect *rect = wlr_scene_rect_create(win->tree,
+			16, 16, decoration_color);
+		wlr_scene_node_set_position(&rect->node, 4 + i * 20, 4);
+	}
+
+	return true;
+}
+
+static void window_finish(struct window *win) {
+	for (size_t i = 0; i < 2; i++) {
+		if (win->buffers[i] != NULL) {
+			wlr_buffer_drop(&win->buffers[i]->base);
+		}
+	}
+}
+
+// Simulates a client update: swap to the other buffer and damage a band
+static void window_update(struct window *win, int frame) {
+	win->current = !win->current;
+	struct bench_buffer *buffer = win->buffers[win->current];
+
+	int band = win->height / 8;
+	int y = (frame * 7) % (win->height - band + 1);
+	pixman_box32_t box = { 0, y, win->width, y + band };
+	bench_buffer_fill(buffer, &box, 0xFF000000 | (frame * 0x010101));
+
+	pixman_region32_t damage;
+	pixman_region32_init_rect(&damage, box.x1, box.y1,
+		box.x2 - box.x1, box.y2 - box.y1);
+	wlr_scene_buffer_set_buffer_with_damage(win->content, &buffer->base,
+		&damage);
+	pixman_region32_fini(&damage);
+}
+
+static int compare_u64(const void *_a, const void *_b) {
+	const uint64_t *a = _a, *b = _b;
+	return (*a > *b) - (*a < *b);
+}
+
+static uint64_t percentile(const uint64_t *sorted, size_t n, double p) {
+	size_t i = (size_t)(p * (n - 1) + 0.5);
+	return sorted[i];
+}
+
+static uint64_t get_time_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t region_area(pixman_region32_t *region) {
+	uint64_t area = 0;
+	int nrects;
+	pixman_box32_t *rects = pixman_region32_rectangles(region, &nrects);
+	for (int i = 0; i < nrects; i++) {
+		area += (uint64_t)(rects[i].x2 - rects[i].x1) *
+			(rects[i].y2 - rects[i].y1);
+	}
+	return area;
+}
+
+int main(int argc, char *argv[]) {
+	int n_windows = 30, n_subsurfaces = 2, n_rects = 4, n_frames = 500;
+	int n_damaged = 3;
+	int output_width = 3840, output_height = 2160;
+
+	int c;
+	while ((c = getopt_long(argc, argv, "n:s:r:f:d:o:h", long_options,
+			NULL)) != -1) {
+		switch (c) {
+		case 'n':
+			n_windows = atoi(optarg);
+			break;
+		case 's':
+			n_subsurfaces = atoi(optarg);
+			break;
+		case 'r':
+			n_rects = atoi(optarg);
+			break;
+		case 'f':
+			n_frames = atoi(optarg);
+			break;
+		case 'd':
+			n_damaged = atoi(optarg);
+			break;
+		case 'o':
+			if (sscanf(optarg, "%dx%d", &output_width, &output_height) != 2) {
+				fprintf(stderr, "invalid output size: %s\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'h':
+		default:
+			fprintf(stderr, "%s", usage);
+			return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	if (n_windows < 1 || n_frames < 1 || n_damaged < 0 ||
+			output_width < 64 || output_height < 64) {
+		fprintf(stderr, "%s", usage);
+		return EXIT_FAILURE;
+	}
+
+	wlr_log_init(WLR_ERROR, NULL);
+
+	struct wl_display *display = wl_display_create();
+	struct wlr_backend *backend = wlr_headless_backend_create(display);
+	if (backend == NULL) {
+		return EXIT_FAILURE;
+	}
+
+	struct wlr_renderer *renderer = wlr_pixman_renderer_create();
+	if (renderer == NULL) {
+		return EXIT_FAILURE;
+	}
+
+	struct wlr_allocator *allocator =
+		wlr_allocator_autocreate(backend, renderer);
+	if (allocator == NULL) {
+		return EXIT_FAILURE;
+	}
+
+	if (!wlr_backend_start(backend)) {
+		return EXIT_FAILURE;
+	}
+
+	struct wlr_output *output =
+		wlr_headless_add_output(backend, output_width, output_height);
+	if (output == NULL || !wlr_output_init_render(output, allocator, renderer)) {
+		return EXIT_FAILURE;
+	}
+	wlr_output_enable(output, true);
+	if (!wlr_output_commit(output)) {
+		return EXIT_FAILURE;
+	}
+
+	struct wlr_scene *scene = wlr_scene_create();
+	struct wlr_scene_output *scene_output =
+		wlr_scene_output_create(scene, output);
+
+	static const float background_color[4] = { 0.1, 0.1, 0.2, 1.0 };
+	wlr_scene_rect_create(&scene->tree, output_width, output_height,
+		background_color);
+
+	int win_width = output_width / 3, win_height = output_height / 3;
+	struct window *windows = calloc(n_windows, sizeof(*windows));
+	if (windows == NULL) {
+		return EXIT_FAILURE;
+	}
+	for (int i = 0; i < n_windows; i++) {
+		if (!window_init(&windows[i], &scene->tree, i, win_width, win_height,
+				n_subsurfaces, n_rects)) {
+			fprintf(stderr, "failed to create window %d\n", i);
+			return EXIT_FAILURE;
+		}
+		wlr_scene_node_set_position(&windows[i].tree->node,
+			(i * 97) % (output_width - win_width),
+			(i * 61) % (output_height - win_height));
+	}
+
+	// Render a first full frame, which isn't part of the statistics
+	wlr_scene_output_commit(scene_output);
+
+	uint64_t *frame_times = calloc(n_frames, sizeof(*frame_times));
+	uint64_t *frame_allocs = calloc(n_frames, sizeof(*frame_allocs));
+	if (frame_times == NULL || frame_allocs == NULL) {
+		return EXIT_FAILURE;
+	}
+	uint64_t damaged_bytes = 0, hit_test_time = 0, hits = 0;
+
+	for (int frame = 0; frame < n_frames; frame++) {
+		// Move the top-most window back and forth
+		struct window *moving = &windows[n_windows - 1];
+		int offset = frame % 200 < 100 ? frame % 100 : 100 - frame % 100;
+		wlr_scene_node_set_position(&moving->tree->node,
+			output_width / 4 + offset * 4, output_height / 4 + offset * 2);
+
+		for (int i = 0; i < n_damaged; i++) {
+			window_update(&windows[(frame + i * 7) % n_windows], frame);
+		}
+
+		// Move the pointer diagonally across the output
+		double px = (frame * 13) % output_width;
+		double py = (frame * 7) % output_height;
+		uint64_t hit_start = get_time_ns();
+		double nx, ny;
+		if (wlr_scene_node_at(&scene->tree.node, px, py, &nx, &ny) != NULL) {
+			hits++;
+		}
+		hit_test_time += get_time_ns() - hit_start;
+
+		damaged_bytes += region_area(&scene_output->damage_ring.current) * 4;
+
+		uint64_t allocs_before = alloc_count;
+		uint64_t start = get_time_ns();
+		if (!wlr_scene_output_commit(scene_output)) {
+			fprintf(stderr, "failed to commit frame %d\n", frame);
+			return EXIT_FAILURE;
+		}
+		frame_times[frame] = get_time_ns() - start;
+		frame_allocs[frame] = alloc_count - allocs_before;
+	}
+
+	uint64_t total_time = 0, total_allocs = 0;
+	for (int i = 0; i < n_frames; i++) {
+		total_time += frame_times[i];
+		total_allocs += frame_allocs[i];
+	}
+	qsort(frame_times, n_frames, sizeof(*frame_times), compare_u64);
+
+	printf("scene: %d windows, %d sub-surfaces and %d rects per window, "
+		"%dx%d output, %d frames\n", n_windows, n_subsurfaces, n_rects,
+		output_width, output_height, n_frames);
+	printf("frame time (us): mean %.1f, p50 %.1f, p90 %.1f, p99 %.1f, "
+		"max %.1f\n",
+		total_time / 1000.0 / n_frames,
+		percentile(frame_times, n_frames, 0.5) / 1000.0,
+		percentile(frame_times, n_frames, 0.9) / 1000.0,
+		percentile(frame_times, n_frames, 0.99) / 1000.0,
+		frame_times[n_frames - 1] / 1000.0);
+	printf("damaged bytes per frame: %.0f\n",
+		(double)damaged_bytes / n_frames);
+	if (HAVE_ALLOC_COUNT) {
+		printf("allocations per frame: %.1f\n",
+			(double)total_allocs / n_frames);
+	} else {
+		printf("allocations per frame: unavailable\n");
+	}
+	printf("hit-test time (us): mean %.2f (%"PRIu64" hits)\n",
+		hit_test_time / 1000.0 / n_frames, hits);
+
+	free(frame_times);
+	free(frame_allocs);
+
+	wlr_scene_node_destroy(&scene->tree.node);
+	for (int i = 0; i < n_windows; i++) {
+		window_finish(&windows[i]);
+	}
+	free(windows);
+
+	wl_display_destroy_clients(display);
+	wl_display_destroy(display);
+	wlr_allocator_destroy(allocator);
+	wlr_renderer_destroy(renderer);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,228 @@
+#define _POSIX_C_SOURCE 200809L
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <wayland-client.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_seat.h>
+#include <wlr/util/log.h>
+
+/* Benchmark of wlr_seat_client_for_wl_client(), which is called on every
+ * focus change and by many seat protocol handlers.
+ *
+ * Clients are connected in-process through socket pairs and bind the seat
+ * global like regular clients do. For 1, 10, 100 and so on up to the
+ * requested number of clients, random clients are looked up with
+ * wlr_seat_client_for_wl_client() and, for reference, by walking the
+ * wlr_seat.clients list. */
+
+struct bench_client {
+	struct wl_client *client;
+	struct wl_display *remote;
+	struct wl_registry *registry;
+	struct wl_seat *seat;
+};
+
+static const struct option long_options[] = {
+	{"clients", required_argument, NULL, 'n'},
+	{"lookups", required_argument, NULL, 'l'},
+	{"help", no_argument, NULL, 'h'},
+	{0},
+};
+
+static const char usage[] =
+	"usage: seat-bench [options]\n"
+	"\n"
+	"  -n, --clients <n>  maximum number of clients (default: 1000)\n"
+	"  -l, --lookups <n>  lookups per measurement (default: 1000000)\n"
+	"  -h, --help         show this help\n";
+
+static uint64_t get_time_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void registry_handle_global(void *data, struct wl_registry *registry,
+		uint32_t name, const char *interface, uint32_t version) {
+	struct bench_client *bench_client = data;
+	if (strcmp(interface, wl_seat_interface.name) == 0) {
+		bench_client->seat =
+			wl_registry_bind(registry, name, &wl_seat_interface, 1);
+	}
+}
+
+static void registry_handle_global_remove(void *data,
+		struct wl_registry *registry, uint32_t name) {
+	// This space is intentionally left blank
+}
+
+static const struct wl_registry_listener registry_listener = {
+	.global = registry_handle_global,
+	.global_remove = registry_handle_global_remove,
+};
+
+// Process the requests sent by clients and send back the events
+static void dispatch_server(struct wl_display *display) {
+	wl_event_loop_dispatch(wl_display_get_event_loop(display), 0);
+	wl_display_flush_clients(display);
+}
+
+static bool bench_client_connect(struct bench_client *bench_client,
+		struct wl_display *display) {
+	int fds[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+		perror("socketpair");
+		return false;
+	}
+
+	bench_client->client = wl_client_create(display, fds[0]);
+	bench_client->remote = wl_display_connect_to_fd(fds[1]);
+	if (bench_client->client == NULL || bench_client->remote == NULL) {
+		return false;
+	}
+
+	bench_client->registry = wl_display_get_registry(bench_client->remote);
+	wl_registry_add_listener(bench_client->registry, &registry_listener,
+		bench_client);
+	wl_display_flush(bench_client->remote);
+	dispatch_server(display);
+
+	// Receive the globals and bind the seat
+	if (wl_display_dispatch(bench_client->remote) < 0 ||
+			bench_client->seat == NULL) {
+		return false;
+	}
+	wl_display_flush(bench_client->remote);
+	dispatch_server(display);
+	return true;
+}
+
+static void bench_client_disconnect(struct bench_client *bench_client) {
+	if (bench_client->seat != NULL) {
+		wl_seat_destroy(bench_client->seat);
+	}
+	if (bench_client->registry != NULL) {
+		wl_registry_destroy(bench_client->registry);
+	}
+	if (bench_client->remote != NULL) {
+		wl_display_disconnect(bench_client->remote);
+	}
+}
+
+static struct wlr_seat_client *list_lookup(struct wlr_seat *seat,
+		struct wl_client *client) {
+	struct wlr_seat_client *seat_client;
+	wl_list_for_each(seat_client, &seat->clients, link) {
+		if (seat_client->client == client) {
+			return seat_client;
+		}
+	}
+	return NULL;
+}
+
+int main(int argc, char *argv[]) {
+	int n_clients = 1000, n_lookups = 1000000;
+
+	int c;
+	while ((c = getopt_long(argc, argv, "n:l:h", long_options,
+			NULL)) != -1) {
+		switch (c) {
+		case 'n':
+			n_clients = atoi(optarg);
+			break;
+		case 'l':
+			n_lookups = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			fprintf(stderr, "%s", usage);
+			return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	if (n_clients < 1 || n_lookups < 1) {
+		fprintf(stderr, "%s", usage);
+		return EXIT_FAILURE;
+	}
+
+	// Each client uses two file descriptors, one for each end of its socket
+	struct rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0 &&
+			limit.rlim_cur < limit.rlim_max) {
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+
+	wlr_log_init(WLR_ERROR, NULL);
+
+	struct wl_display *display = wl_display_create();
+	if (display == NULL) {
+		return EXIT_FAILURE;
+	}
+	struct wlr_seat *seat = wlr_seat_create(display, "seat0");
+	if (seat == NULL) {
+		return EXIT_FAILURE;
+	}
+
+	struct bench_client *clients = calloc(n_clients, sizeof(*clients));
+	struct wl_client **keys = calloc(n_lookups, sizeof(*keys));
+	if (clients == NULL || keys == NULL) {
+		return EXIT_FAILURE;
+	}
+
+	printf("%8s %14s %14s\n", "clients", "list (ns)", "table (ns)");
+
+	srand(1);
+	int connected = 0;
+	for (int n = 1; n <= n_clients; n *= 10) {
+		for (; connected < n; connected++) {
+			if (!bench_client_connect(&clients[connected], display)) {
+				fprintf(stderr, "failed to connect client %d\n", connected);
+				return EXIT_FAILURE;
+			}
+		}
+
+		for (int i = 0; i < n_lookups; i++) {
+			keys[i] = clients[rand() % n].client;
+		}
+
+		size_t found = 0;
+		uint64_t start = get_time_ns();
+		for (int i = 0; i < n_lookups; i++) {
+			found += list_lookup(seat, keys[i]) != NULL;
+		}
+		uint64_t list_time = get_time_ns() - start;
+
+		start = get_time_ns();
+		for (int i = 0; i < n_lookups; i++) {
+			found += wlr_seat_client_for_wl_client(seat, keys[i]) != NULL;
+		}
+		uint64_t table_time = get_time_ns() - start;
+
+		if (found != 2 * (size_t)n_lookups) {
+			fprintf(stderr, "seat client lookup failed\n");
+			return EXIT_FAILURE;
+		}
+
+		printf("%8d %14.1f %14.1f\n", n, (double)list_time / n_lookups,
+			(double)table_time / n_lookups);
+	}
+
+	free(keys);
+
+	wl_display_destroy_clients(display);
+	for (int i = 0; i < connected; i++) {
+		bench_client_disconnect(&clients[i]);
+	}
+	free(clients);
+
+	wlr_seat_destroy(seat);
+	wl_display_destroy(display);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,177 @@
+#define _POSIX_C_SOURCE 200112L
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <wayland-util.h>
+#include "util/hash_table.h"
+
+/* Benchmark of the window ID lookups done by the Xwayland window manager for
+ * every X event referencing a window.
+ *
+ * Windows are given X resource IDs the way the X server allocates them: each
+ * client has its own resource base and numbers its windows sequentially. For
+ * an increasing number of windows, a random mix of known and unknown window
+ * IDs is looked up, both by walking a list of windows (as the window manager
+ * used to) and with the hash table it now uses. The cost of creating and
+ * destroying windows in the hash table is reported as well. */
+
+struct window {
+	uint32_t window_id;
+	struct wl_list link;
+	struct wl_list hash_link;
+};
+
+static const struct option long_options[] = {
+	{"windows", required_argument, NULL, 'n'},
+	{"clients", required_argument, NULL, 'c'},
+	{"lookups", required_argument, NULL, 'l'},
+	{"help", no_argument, NULL, 'h'},
+	{0},
+};
+
+static const char usage[] =
+	"usage: xwm-lookup-bench [options]\n"
+	"\n"
+	"  -n, --windows <n>  maximum number of windows (default: 10000)\n"
+	"  -c, --clients <n>  number of X clients owning them (default: 8)\n"
+	"  -l, --lookups <n>  lookups per measurement (default: 1000000)\n"
+	"  -h, --help         show this help\n";
+
+static uint64_t get_time_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t window_get_hash_key(struct wl_list *link) {
+	struct window *window = wl_container_of(link, window, hash_link);
+	return window->window_id;
+}
+
+static uint32_t window_id_for(int index, int n_clients) {
+	// The X server gives each client a 2^21 wide range of resource IDs
+	int client = index % n_clients;
+	return ((uint32_t)(client + 2) << 21) | (uint32_t)(index / n_clients + 1);
+}
+
+static struct window *list_lookup(struct wl_list *windows, uint32_t id) {
+	struct window *window;
+	wl_list_for_each(window, windows, link) {
+		if (window->window_id == id) {
+			return window;
+		}
+	}
+	return NULL;
+}
+
+static struct window *table_lookup(struct hash_table *table, uint32_t id) {
+	struct wl_list *link = hash_table_find(table, id);
+	if (link == NULL) {
+		return NULL;
+	}
+	struct window *window = wl_container_of(link, window, hash_link);
+	return window;
+}
+
+int main(int argc, char *argv[]) {
+	int n_windows = 10000, n_clients = 8, n_lookups = 1000000;
+
+	int c;
+	while ((c = getopt_long(argc, argv, "n:c:l:h", long_options,
+			NULL)) != -1) {
+		switch (c) {
+		case 'n':
+			n_windows = atoi(optarg);
+			break;
+		case 'c':
+			n_clients = atoi(optarg);
+			break;
+		case 'l':
+			n_lookups = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			fprintf(stderr, "%s", usage);
+			return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	if (n_windows < 1 || n_clients < 1 || n_lookups < 1) {
+		fprintf(stderr, "%s", usage);
+		return EXIT_FAILURE;
+	}
+
+	struct window *windows = calloc(n_windows, sizeof(*windows));
+	uint32_t *keys = calloc(n_lookups, sizeof(*keys));
+	if (windows == NULL || keys == NULL) {
+		return EXIT_FAILURE;
+	}
+
+	printf("%8s %14s %14s %16s\n", "windows", "list (ns)", "table (ns)",
+		"add+remove (ns)");
+
+	srand(1);
+	for (int n = 1; n <= n_windows; n *= 10) {
+		struct wl_list list;
+		wl_list_init(&list);
+		struct hash_table table;
+		hash_table_init(&table, window_get_hash_key);
+
+		uint64_t start = get_time_ns();
+		for (int i = 0; i < n; i++) {
+			windows[i].window_id = window_id_for(i, n_clients);
+			if (!hash_table_insert(&table, &windows[i].hash_link)) {
+				return EXIT_FAILURE;
+			}
+		}
+		for (int i = 0; i < n; i++) {
+			hash_table_remove(&table, &windows[i].hash_link);
+		}
+		uint64_t churn_time = get_time_ns() - start;
+
+		for (int i = 0; i < n; i++) {
+			wl_list_insert(&list, &windows[i].link);
+			hash_table_insert(&table, &windows[i].hash_link);
+		}
+
+		// A quarter of the events are about windows which aren't managed,
+		// e.g. the root window or windows already destroyed
+		for (int i = 0; i < n_lookups; i++) {
+			int index = rand() % n;
+			keys[i] = rand() % 4 == 0 ? window_id_for(n + index, n_clients) :
+				windows[index].window_id;
+		}
+
+		// The list walk is much slower, use fewer lookups with large lists
+		int list_lookups = n_lookups / (n / 100 + 1);
+		size_t found = 0;
+		start = get_time_ns();
+		for (int i = 0; i < list_lookups; i++) {
+			found += list_lookup(&list, keys[i]) != NULL;
+		}
+		uint64_t list_time = get_time_ns() - start;
+
+		start = get_time_ns();
+		for (int i = 0; i < n_lookups; i++) {
+			found += table_lookup(&table, keys[i]) != NULL;
+		}
+		uint64_t table_time = get_time_ns() - start;
+
+		printf("%8d %14.1f %14.1f %16.1f\n", n,
+			(double)list_time / list_lookups,
+			(double)table_time / n_lookups,
+			(double)churn_time / n);
+		if (found == 0) {
+			fprintf(stderr, "no window found\n");
+			return EXIT_FAILURE;
+		}
+
+		hash_table_finish(&table);
+	}
+
+	free(keys);
+	free(windows);
+	return EXIT_SUCCESS;
+}
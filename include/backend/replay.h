@@ -0,0 +1,131 @@
+#ifndef BACKEND_REPLAY_H
+#define BACKEND_REPLAY_H
+
+#include <stdint.h>
+#include <wlr/backend/interface.h>
+#include <wlr/backend/replay.h>
+#include <wlr/types/wlr_keyboard.h>
+#include <wlr/types/wlr_pointer.h>
+#include <wlr/types/wlr_touch.h>
+
+/*
+ * A recording starts with a struct replay_file_header, followed by records.
+ * Each record is a struct replay_record_header followed by size bytes of
+ * payload, one of the struct replay_* below depending on the type.
+ */
+
+#define REPLAY_FILE_MAGIC "WLRINPUT"
+#define REPLAY_FILE_VERSION 1
+#define REPLAY_DEVICE_NAME_LEN 64
+
+struct replay_file_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+};
+
+enum replay_record_type {
+	REPLAY_DEVICE_ADD = 1, // struct replay_device
+	REPLAY_DEVICE_REMOVE, // no payload
+	REPLAY_POINTER_MOTION, // struct replay_pointer_motion
+	REPLAY_POINTER_MOTION_ABSOLUTE, // struct replay_pointer_motion_absolute
+	REPLAY_POINTER_BUTTON, // struct replay_pointer_button
+	REPLAY_POINTER_AXIS, // struct replay_pointer_axis
+	REPLAY_POINTER_FRAME, // no payload
+	REPLAY_KEYBOARD_KEY, // struct replay_keyboard_key
+	REPLAY_TOUCH_DOWN, // struct replay_touch_position
+	REPLAY_TOUCH_UP, // struct replay_touch_id
+	REPLAY_TOUCH_MOTION, // struct replay_touch_position
+	REPLAY_TOUCH_CANCEL, // struct replay_touch_id
+	REPLAY_TOUCH_FRAME, // no payload
+};
+
+struct replay_record_header {
+	uint16_t type; // enum replay_record_type
+	uint16_t size;
+	uint32_t device; // device ID, unique in the recording
+	uint64_t time_nsec; // since the start of the recording
+};
+
+struct replay_device {
+	uint32_t type; // enum wlr_input_device_type
+	uint32_t vendor, product;
+	char name[REPLAY_DEVICE_NAME_LEN];
+};
+
+struct replay_pointer_motion {
+	uint32_t time_msec;
+	double delta_x, delta_y;
+	double unaccel_dx, unaccel_dy;
+};
+
+struct replay_pointer_motion_absolute {
+	uint32_t time_msec;
+	double x, y;
+};
+
+struct replay_pointer_button {
+	uint32_t time_msec;
+	uint32_t button;
+	uint32_t state; // enum wlr_button_state
+};
+
+struct replay_pointer_axis {
+	uint32_t time_msec;
+	uint32_t source; // enum wlr_axis_source
+	uint32_t orientation; // enum wlr_axis_orientation
+	int32_t delta_discrete;
+	double delta;
+};
+
+struct replay_keyboard_key {
+	uint32_t time_msec;
+	uint32_t keycode;
+	uint32_t state; // enum wl_keyboard_key_state
+	uint32_t update_state;
+};
+
+struct replay_touch_position {
+	uint32_t time_msec;
+	int32_t touch_id;
+	double x, y;
+};
+
+struct replay_touch_id {
+	uint32_t time_msec;
+	int32_t touch_id;
+};
+
+struct wlr_replay_backend {
+	struct wlr_backend backend;
+	struct wl_display *display;
+	struct wl_list devices; // wlr_replay_input_device.link
+	struct wl_listener display_destroy;
+
+	bool realtime;
+	char *data; // the whole recording
+	size_t size, offset;
+
+	struct wl_event_source *timer; // realtime replay
+	// Fast replay, driven by an always readable pipe
+	struct wl_event_source *busy;
+	int busy_fds[2];
+	int64_t start_nsec;
+	size_t records;
+	bool started, finished;
+};
+
+struct wlr_replay_input_device {
+	uint32_t id;
+	enum wlr_input_device_type type;
+	union {
+		struct wlr_keyboard keyboard;
+		struct wlr_pointer pointer;
+		struct wlr_touch touch;
+	};
+
+	struct wlr_replay_backend *backend;
+	struct wl_list link;
+};
+
+#endif
@@ -4,6 +4,7 @@
 #include <wlr/render/pixman.h>
 #include <wlr/render/wlr_renderer.h>
 #include <wlr/render/drm_format_set.h>
+#include <wlr/util/box.h>
 #include "render/pixel_format.h"
 
 struct wlr_pixman_pixel_format {
@@ -13,6 +14,44 @@ struct wlr_pixman_pixel_format {
 
 struct wlr_pixman_buffer;
 
+#define WLR_PIXMAN_SOLID_FILL_CACHE_SIZE 8
+
+struct wlr_pixman_solid_fill {
+	struct pixman_color color;
+	pixman_image_t *image; // may be NULL
+};
+
+// Solid fill images re-used across draws, replaced in round-robin order
+struct wlr_pixman_solid_fill_cache {
+	struct wlr_pixman_solid_fill fills[WLR_PIXMAN_SOLID_FILL_CACHE_SIZE];
+	size_t next;
+};
+
+enum wlr_pixman_op_type {
+	WLR_PIXMAN_OP_CLEAR,
+	WLR_PIXMAN_OP_SCISSOR,
+	WLR_PIXMAN_OP_TEXTURE,
+	WLR_PIXMAN_OP_QUAD,
+};
+
+/**
+ * A draw operation, recorded during a render pass when rendering with worker
+ * threads.
+ */
+struct wlr_pixman_op {
+	enum wlr_pixman_op_type type;
+
+	struct pixman_color color; // CLEAR, QUAD
+	float matrix[9]; // TEXTURE, QUAD
+	struct wlr_fbox src_box; // TEXTURE
+	float alpha; // TEXTURE
+	pixman_image_t *image; // TEXTURE, holds a reference
+	bool has_scissor; // SCISSOR
+	pixman_region32_t scissor; // SCISSOR, only initialized if has_scissor
+};
+
+struct wlr_pixman_worker_pool;
+
 struct wlr_pixman_renderer {
 	struct wlr_renderer wlr_renderer;
 
@@ -23,6 +62,14 @@ struct wlr_pixman_renderer {
 	int32_t width, height;
 
 	struct wlr_drm_format_set drm_formats;
+
+	struct wlr_pixman_solid_fill_cache solid_fills;
+
+	// Only set when rendering with worker threads
+	struct wlr_pixman_worker_pool *worker_pool;
+	struct wlr_pixman_solid_fill_cache *worker_solid_fills; // one per worker
+	struct wl_array ops; // struct wlr_pixman_op, recorded for this pass
+	struct wl_array accessed_buffers; // struct wlr_buffer *, for this pass
 };
 
 struct wlr_pixman_buffer {
@@ -52,4 +99,21 @@ pixman_format_code_t get_pixman_format_from_drm(uint32_t fmt);
 uint32_t get_drm_format_from_pixman(pixman_format_code_t fmt);
 const uint32_t *get_pixman_drm_formats(size_t *len);
 
+typedef void (*pixman_worker_job_func_t)(size_t job, size_t worker,
+	void *data);
+
+/**
+ * Create a pool of worker threads. Jobs are also run on the thread submitting
+ * them, so the pool has threads + 1 workers.
+ */
+struct wlr_pixman_worker_pool *pixman_worker_pool_create(size_t threads);
+void pixman_worker_pool_destroy(struct wlr_pixman_worker_pool *pool);
+size_t pixman_worker_pool_get_size(struct wlr_pixman_worker_pool *pool);
+/**
+ * Run func for each job in [0, jobs_len) and wait for all of them to finish.
+ * The worker index passed to func is in [0, pixman_worker_pool_get_size()).
+ */
+void pixman_worker_pool_run(struct wlr_pixman_worker_pool *pool,
+	size_t jobs_len, pixman_worker_job_func_t func, void *data);
+
 #endif
@@ -12,7 +12,32 @@ void output_state_attach_buffer(struct wlr_output_state *state,
 struct wlr_drm_format *output_pick_format(struct wlr_output *output,
 	const struct wlr_drm_format_set *display_formats, uint32_t format);
 void output_clear_back_buffer(struct wlr_output *output);
+/**
+ * Destroy the cached hardware cursor buffers and forget recent cache misses.
+ */
+void output_clear_cursor_buffers(struct wlr_output *output);
 bool output_ensure_buffer(struct wlr_output *output,
 	const struct wlr_output_state *state, bool *new_back_buffer);
 
+/**
+ * Send the frame event right away.
+ */
+void output_emit_frame(struct wlr_output *output);
+
+void output_frame_scheduler_finish(struct wlr_output *output);
+/**
+ * Called when the backend signals a frame. Returns true if the frame event has
+ * been delayed, in which case output_emit_frame() will be called later on.
+ */
+bool output_frame_scheduler_delay_frame(struct wlr_output *output);
+void output_frame_scheduler_handle_frame(struct wlr_output *output);
+void output_frame_scheduler_handle_commit(struct wlr_output *output);
+
+void output_frame_stats_init(struct wlr_output *output);
+void output_frame_stats_finish(struct wlr_output *output);
+void output_frame_stats_handle_frame(struct wlr_output *output);
+void output_frame_stats_handle_commit(struct wlr_output *output);
+void output_frame_stats_handle_present(struct wlr_output *output,
+	const struct wlr_output_event_present *event);
+
 #endif
@@ -5,4 +5,28 @@
 
 struct wlr_scene *scene_node_get_root(struct wlr_scene_node *node);
 
+/**
+ * Hand over a texture created from a buffer which is no longer displayed by
+ * the scene buffer. The texture may be destroyed right away if it can't be
+ * cached.
+ */
+void scene_texture_cache_put(struct wlr_scene_buffer *scene_buffer,
+	struct wlr_renderer *renderer, struct wlr_buffer *buffer,
+	struct wlr_texture *texture);
+/**
+ * Retrieve an up-to-date cached texture for the buffer, or NULL if there is
+ * none. The caller becomes the owner of the texture.
+ */
+struct wlr_texture *scene_texture_cache_take(
+	struct wlr_scene_buffer *scene_buffer, struct wlr_renderer *renderer,
+	struct wlr_buffer *buffer);
+/**
+ * Accumulate the damage submitted along with a new buffer for the scene buffer
+ * into the textures it has cached. A NULL damage damages them fully.
+ */
+void scene_texture_cache_damage(struct wlr_scene_buffer *scene_buffer,
+	struct wlr_buffer *buffer, pixman_region32_t *damage);
+void scene_texture_cache_unlink(struct wlr_scene_buffer *scene_buffer);
+void scene_texture_caches_destroy(struct wlr_scene *scene);
+
 #endif
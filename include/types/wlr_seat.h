@@ -13,6 +13,7 @@ void seat_client_create_pointer(struct wlr_seat_client *seat_client,
 void seat_client_destroy_pointer(struct wl_resource *resource);
 void seat_client_send_pointer_leave_raw(struct wlr_seat_client *seat_client,
 	struct wlr_surface *surface);
+void seat_pointer_flush_leave(struct wlr_seat *seat);
 
 void seat_client_create_keyboard(struct wlr_seat_client *seat_client,
 	uint32_t version, uint32_t id);
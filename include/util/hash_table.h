@@ -0,0 +1,40 @@
+#ifndef UTIL_HASH_TABLE_H
+#define UTIL_HASH_TABLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wayland-util.h>
+
+/**
+ * A chained hash table of objects with unique integer keys. Objects are
+ * linked into the table with a struct wl_list embedded in them, and
+ * get_key() returns the key of an object from its link.
+ *
+ * The table grows with the number of objects.
+ */
+struct hash_table {
+	uint64_t (*get_key)(struct wl_list *link);
+
+	struct wl_list *buckets; // NULL if empty
+	size_t buckets_len; // power of two
+	size_t len;
+};
+
+void hash_table_init(struct hash_table *table,
+	uint64_t (*get_key)(struct wl_list *link));
+/**
+ * Free the buckets. Objects still in the table are left with dangling links.
+ */
+void hash_table_finish(struct hash_table *table);
+/**
+ * Link an object into the table. Returns false on allocation failure.
+ */
+bool hash_table_insert(struct hash_table *table, struct wl_list *link);
+void hash_table_remove(struct hash_table *table, struct wl_list *link);
+/**
+ * Find the link of the object with the given key, or NULL if there is none.
+ */
+struct wl_list *hash_table_find(struct hash_table *table, uint64_t key);
+
+#endif
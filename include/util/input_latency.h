@@ -0,0 +1,45 @@
+#ifndef UTIL_INPUT_LATENCY_H
+#define UTIL_INPUT_LATENCY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct wlr_output;
+struct wlr_output_event_present;
+
+bool input_latency_is_enabled(void);
+
+/**
+ * Record that the backend has read an input event, with the kernel timestamp
+ * of the event in CLOCK_MONOTONIC microseconds.
+ */
+void input_latency_handle_dispatch(uint64_t time_usec);
+/**
+ * Record that the backend is done handling the last input event. If it
+ * hasn't been sent to a client, e.g. because it triggered a compositor
+ * keybinding, it isn't traced any further.
+ */
+void input_latency_handle_dispatch_done(void);
+/**
+ * Record that the last input event has been sent to a client.
+ */
+void input_latency_handle_send(void);
+/**
+ * Take over tracing of the last input event, for events which are held back
+ * and sent to a client later. Returns false if the event isn't traced.
+ * Otherwise, dispatch_nsec is set to the time the event was read and
+ * input_latency_handle_delayed_send() should be called once it's sent.
+ */
+bool input_latency_take_event(int64_t *dispatch_nsec);
+/**
+ * Record that an input event taken with input_latency_take_event() has been
+ * sent to a client.
+ */
+void input_latency_handle_delayed_send(int64_t dispatch_nsec);
+
+void input_latency_handle_output_commit(struct wlr_output *output);
+void input_latency_handle_output_present(struct wlr_output *output,
+	const struct wlr_output_event_present *event);
+void input_latency_handle_output_destroy(struct wlr_output *output);
+
+#endif
@@ -0,0 +1,56 @@
+/*
+ * This an unstable interface of wlroots. No guarantees are made regarding the
+ * future consistency of this API.
+ */
+#ifndef WLR_USE_UNSTABLE
+#error "Add -DWLR_USE_UNSTABLE to enable unstable wlroots features"
+#endif
+
+#ifndef WLR_BACKEND_REPLAY_H
+#define WLR_BACKEND_REPLAY_H
+
+#include <wlr/backend.h>
+#include <wlr/types/wlr_input_device.h>
+
+/**
+ * Records the events of input devices to a file, which can be replayed by the
+ * replay backend.
+ *
+ * The recording stores pointer, keyboard and touch events. It uses the native
+ * byte order and is meant to be replayed on the same machine.
+ */
+struct wlr_input_recorder;
+
+/**
+ * Creates a replay backend, which replays the input events recorded in the
+ * file at the specified path once started. The replay backend has no outputs.
+ *
+ * If realtime is true, events are replayed with their original timing,
+ * otherwise they are replayed as fast as possible, while still letting the
+ * event loop run between batches of events.
+ */
+struct wlr_backend *wlr_replay_backend_create(struct wl_display *display,
+	const char *path, bool realtime);
+/**
+ * Returns true once all the events have been replayed.
+ */
+bool wlr_replay_backend_is_finished(struct wlr_backend *backend);
+
+bool wlr_backend_is_replay(struct wlr_backend *backend);
+
+/**
+ * Starts recording input events to the file at the specified path.
+ */
+struct wlr_input_recorder *wlr_input_recorder_create(const char *path);
+/**
+ * Records the events of an input device. Devices are removed from the
+ * recording when destroyed. Tablet and switch devices aren't supported.
+ */
+bool wlr_input_recorder_add_device(struct wlr_input_recorder *recorder,
+	struct wlr_input_device *device);
+/**
+ * Stops recording and closes the file.
+ */
+void wlr_input_recorder_destroy(struct wlr_input_recorder *recorder);
+
+#endif
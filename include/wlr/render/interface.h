@@ -32,6 +32,13 @@ struct wlr_renderer_impl {
 		const float matrix[static 9], float alpha);
 	void (*render_quad_with_matrix)(struct wlr_renderer *renderer,
 		const float color[static 4], const float matrix[static 9]);
+	// Optional, falls back to one scissor and draw call per rectangle
+	bool (*render_subtexture_with_matrix_region)(struct wlr_renderer *renderer,
+		struct wlr_texture *texture, const struct wlr_fbox *box,
+		const float matrix[static 9], float alpha, pixman_region32_t *clip);
+	void (*render_quad_with_matrix_region)(struct wlr_renderer *renderer,
+		const float color[static 4], const float matrix[static 9],
+		pixman_region32_t *clip);
 	const uint32_t *(*get_shm_texture_formats)(
 		struct wlr_renderer *renderer, size_t *len);
 	const struct wlr_drm_format_set *(*get_dmabuf_texture_formats)(
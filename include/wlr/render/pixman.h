@@ -13,7 +13,22 @@
 #include <wlr/backend.h>
 #include <wlr/render/wlr_renderer.h>
 
+/**
+ * Create a Pixman renderer. The WLR_PIXMAN_THREADS environment variable can be
+ * set to render with worker threads, see
+ * wlr_pixman_renderer_create_with_threads().
+ */
 struct wlr_renderer *wlr_pixman_renderer_create(void);
+/**
+ * Create a Pixman renderer which uses the specified number of worker threads
+ * in addition to the calling thread.
+ *
+ * Draw operations are recorded between wlr_renderer_begin() and
+ * wlr_renderer_end(), then replayed in parallel on horizontal bands of the
+ * render target when the pass ends. The result is identical to rendering on a
+ * single thread. Passing zero threads disables this.
+ */
+struct wlr_renderer *wlr_pixman_renderer_create_with_threads(size_t threads);
 /**
  * Returns the image of current buffer.
  */
@@ -32,6 +32,10 @@ struct wlr_renderer {
 
 	struct {
 		struct wl_signal destroy;
+		// Emitted right after rendering has begun
+		struct wl_signal begin;
+		// Emitted right after rendering has ended
+		struct wl_signal end;
 	} events;
 };
 
@@ -75,6 +79,26 @@ void wlr_render_rect(struct wlr_renderer *r, const struct wlr_box *box,
  */
 void wlr_render_quad_with_matrix(struct wlr_renderer *r,
 	const float color[static 4], const float matrix[static 9]);
+/**
+ * Renders the requested texture using the provided matrix, after cropping it
+ * to the provided rectangle, only inside the clip region. The clip region is
+ * in buffer-local coordinates, like the scissor box. The scissor box is
+ * disabled afterwards.
+ *
+ * This is equivalent to drawing the texture once per rectangle of the clip
+ * region with the scissor box set to that rectangle, but lets the renderer
+ * process all rectangles at once.
+ */
+bool wlr_render_subtexture_with_matrix_region(struct wlr_renderer *r,
+	struct wlr_texture *texture, const struct wlr_fbox *box,
+	const float matrix[static 9], float alpha, pixman_region32_t *clip);
+/**
+ * Renders a solid quadrangle in the specified color with the specified matrix,
+ * only inside the clip region. See wlr_render_subtexture_with_matrix_region().
+ */
+void wlr_render_quad_with_matrix_region(struct wlr_renderer *r,
+	const float color[static 4], const float matrix[static 9],
+	pixman_region32_t *clip);
 /**
  * Get the shared-memory formats supporting import usage. Buffers allocated
  * with a format from this list may be imported via wlr_texture_from_pixels().
@@ -13,6 +13,11 @@
 
 /* For triple buffering, a history of two frames is required. */
 #define WLR_DAMAGE_RING_PREVIOUS_LEN 2
+/* Maximum history length, see wlr_damage_ring_set_previous_len(). */
+#define WLR_DAMAGE_RING_MAX_PREVIOUS_LEN 16
+
+/* Default cost of drawing a rectangle, in pixels. */
+#define WLR_DAMAGE_RING_DEFAULT_RECT_COST 4096
 
 struct wlr_box;
 
@@ -24,8 +29,11 @@ struct wlr_damage_ring {
 
 	// private state
 
-	pixman_region32_t previous[WLR_DAMAGE_RING_PREVIOUS_LEN];
+	pixman_region32_t previous[WLR_DAMAGE_RING_MAX_PREVIOUS_LEN];
+	size_t previous_len;
 	size_t previous_idx;
+
+	uint32_t rect_cost;
 };
 
 void wlr_damage_ring_init(struct wlr_damage_ring *ring);
@@ -43,6 +51,17 @@ void wlr_damage_ring_finish(struct wlr_damage_ring *ring);
 void wlr_damage_ring_set_bounds(struct wlr_damage_ring *ring,
 	int32_t width, int32_t height);
 
+/**
+ * Set the number of previous frames the ring keeps damage for. Damage can be
+ * accumulated exactly for buffers with an age up to previous_len + 1; this
+ * should match the depth of the swapchain the ring is used with.
+ *
+ * Returns false if previous_len exceeds WLR_DAMAGE_RING_MAX_PREVIOUS_LEN.
+ * By default, the history length is WLR_DAMAGE_RING_PREVIOUS_LEN.
+ */
+bool wlr_damage_ring_set_previous_len(struct wlr_damage_ring *ring,
+	size_t previous_len);
+
 /**
  * Add a region to the current damage.
  *
@@ -70,10 +89,32 @@ void wlr_damage_ring_add_whole(struct wlr_damage_ring *ring);
  */
 void wlr_damage_ring_rotate(struct wlr_damage_ring *ring);
 
+/**
+ * Set the cost of drawing one rectangle, expressed in pixels.
+ *
+ * Each rectangle of a damage region usually results in a separate draw call
+ * per surface. When simplifying a region, two rectangles are merged into their
+ * bounding box if the number of extra pixels that would be drawn is lower than
+ * this cost. Zero disables merging.
+ *
+ * Defaults to WLR_DAMAGE_RING_DEFAULT_RECT_COST.
+ */
+void wlr_damage_ring_set_rect_cost(struct wlr_damage_ring *ring,
+	uint32_t rect_cost);
+
+/**
+ * Simplify a region according to the ring's rectangle cost. The resulting
+ * region contains the original one.
+ */
+void wlr_damage_ring_simplify(struct wlr_damage_ring *ring,
+	pixman_region32_t *region);
+
 /**
  * Get accumulated damage, which is the difference between the current buffer
  * and the buffer with age of buffer_age; in context of rendering, this is
  * the region that needs to be redrawn.
+ *
+ * The damage is simplified with wlr_damage_ring_simplify().
  */
 void wlr_damage_ring_get_buffer_damage(struct wlr_damage_ring *ring,
 	int buffer_age, pixman_region32_t *damage);
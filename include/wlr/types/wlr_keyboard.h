@@ -40,6 +40,7 @@ enum wlr_keyboard_modifier {
 #define WLR_KEYBOARD_KEYS_CAP 32
 
 struct wlr_keyboard_impl;
+struct keyboard_keymap;
 
 struct wlr_keyboard_modifiers {
 	xkb_mod_mask_t depressed;
@@ -54,9 +55,10 @@ struct wlr_keyboard {
 	const struct wlr_keyboard_impl *impl;
 	struct wlr_keyboard_group *group;
 
-	char *keymap_string;
+	// Serialized keymap, shared by all keyboards with the same keymap
+	const char *keymap_string;
 	size_t keymap_size;
-	int keymap_fd;
+	int keymap_fd; // read-only
 	struct xkb_keymap *keymap;
 	struct xkb_state *xkb_state;
 	xkb_led_index_t led_indexes[WLR_LED_COUNT];
@@ -92,6 +94,10 @@ struct wlr_keyboard {
 	} events;
 
 	void *data;
+
+	// private state
+
+	struct keyboard_keymap *interned_keymap;
 };
 
 struct wlr_keyboard_key_event {
@@ -97,6 +97,59 @@ struct wlr_output_state {
 
 struct wlr_output_impl;
 
+typedef void (*wlr_output_clock_func_t)(struct timespec *now, void *data);
+
+/**
+ * Predictive frame scheduling state, see
+ * wlr_output_set_frame_scheduler_enabled().
+ *
+ * Times are in nanoseconds.
+ */
+struct wlr_output_frame_scheduler {
+	bool enabled;
+
+	// Smoothed time between the frame event and the end of the commit
+	int64_t render_time;
+	int64_t render_time_dev;
+	// Extra time kept before the deadline, grown when frames are missed
+	int64_t margin;
+
+	// private state
+
+	int64_t frame_time; // when the pending frame event was sent, or 0
+	int64_t deadline; // predicted deadline for the pending frame, or 0
+	struct wl_event_source *timer;
+	bool armed;
+	int64_t frame_due; // when the delayed frame event is due, or 0
+
+	wlr_output_clock_func_t clock;
+	void *clock_data;
+};
+
+/**
+ * Timings of a single frame, see wlr_output_enable_frame_stats().
+ *
+ * All timestamps use CLOCK_MONOTONIC, and are zero when the corresponding
+ * step didn't happen.
+ */
+struct wlr_output_frame_timing {
+	struct timespec frame; // frame event
+	struct timespec render_begin, render_end; // rendering to the back buffer
+	struct timespec commit; // buffer commit
+	struct timespec present; // as reported by the backend
+
+	uint32_t commit_seq; // only valid if committed
+	// Only valid if presented
+	unsigned int seq;
+	int refresh; // nsec, zero if unknown
+	uint32_t present_flags; // enum wlr_output_present_flag
+
+	bool committed; // false if the frame event didn't result in a commit
+	bool presented;
+};
+
+struct wlr_output_frame_stats;
+
 /**
  * A compositor output region. This typically corresponds to a monitor that
  * displays part of the compositor space.
@@ -175,10 +228,15 @@ struct wlr_output {
 
 	int attach_render_locks; // number of locks forcing rendering
 
+	struct wlr_output_frame_scheduler frame_scheduler;
+	struct wlr_output_frame_stats *frame_stats; // may be NULL
+
 	struct wl_list cursors; // wlr_output_cursor::link
 	struct wlr_output_cursor *hardware_cursor;
 	struct wlr_swapchain *cursor_swapchain;
 	struct wlr_buffer *cursor_front_buffer;
+	struct wl_list cursor_buffers; // rendered hardware cursors, most recent first
+	struct wl_list cursor_buffer_misses; // recently rendered uncached cursors
 	int software_cursor_locks; // number of locks forcing software cursors
 
 	struct wlr_allocator *allocator;
@@ -431,6 +489,58 @@ bool wlr_output_commit_state(struct wlr_output *output,
  * it is a no-op.
  */
 void wlr_output_schedule_frame(struct wlr_output *output);
+/**
+ * Enable or disable predictive frame scheduling.
+ *
+ * By default, the `frame` event is sent as soon as the backend is ready for a
+ * new frame, usually right after a vblank. The new frame then waits for almost
+ * a full refresh period before being displayed. With frame scheduling enabled,
+ * the time spent between the `frame` event and the end of the commit is
+ * measured, and the `frame` event is delayed until just before the predicted
+ * deadline for the next vblank. The safety margin grows when a deadline is
+ * missed and slowly shrinks back afterwards.
+ *
+ * Outputs without a known refresh rate are unaffected.
+ */
+void wlr_output_set_frame_scheduler_enabled(struct wlr_output *output,
+	bool enabled);
+/**
+ * Override the clock used by the frame scheduler to take measurements, predict
+ * deadlines and delay `frame` events, e.g. to use a fake clock in tests.
+ * Passing NULL restores the default CLOCK_MONOTONIC clock.
+ *
+ * With a custom clock, delayed `frame` events aren't dispatched by the event
+ * loop anymore: wlr_output_dispatch_frame_scheduler() needs to be called
+ * whenever the clock advances. A `frame` event delayed when the clock is
+ * changed is sent right away.
+ */
+void wlr_output_set_frame_scheduler_clock(struct wlr_output *output,
+	wlr_output_clock_func_t clock, void *data);
+/**
+ * Send the delayed `frame` event if it is due according to the custom clock
+ * set with wlr_output_set_frame_scheduler_clock(). Does nothing with the
+ * default clock.
+ */
+void wlr_output_dispatch_frame_scheduler(struct wlr_output *output);
+/**
+ * Start recording per-frame timings in a ring buffer of `capacity` frames:
+ * frame event, rendering, commit and presentation. Passing zero disables
+ * recording and frees the buffer. Any previously recorded timings are
+ * discarded.
+ *
+ * Recording can also be enabled for all outputs with the WLR_FRAME_STATS
+ * environment variable.
+ */
+bool wlr_output_enable_frame_stats(struct wlr_output *output,
+	size_t capacity);
+/**
+ * Copy up to `len` of the most recent frame timings into `timings`, oldest
+ * first. Returns the number of timings copied.
+ *
+ * The last frames may not have been presented yet.
+ */
+size_t wlr_output_get_frame_timings(struct wlr_output *output,
+	struct wlr_output_frame_timing *timings, size_t len);
 /**
  * Returns the maximum length of each gamma ramp, or 0 if unsupported.
  */
@@ -77,6 +77,12 @@ struct wlr_scene_tree {
 	struct wlr_scene_node node;
 
 	struct wl_list children; // wlr_scene_node.link
+
+	// private state
+
+	// Bounding box of all enabled children, relative to the tree
+	struct wlr_box bounds;
+	bool bounds_dirty;
 };
 
 /** The root scene-graph node. */
@@ -94,6 +100,9 @@ struct wlr_scene {
 
 	enum wlr_scene_debug_damage_option debug_damage_option;
 	bool direct_scanout;
+
+	struct wl_list texture_caches;
+	size_t texture_cache_budget;
 };
 
 /** A scene-graph node displaying a single surface. */
@@ -134,7 +143,7 @@ struct wlr_scene_buffer {
 		struct wl_signal frame_done; // struct timespec
 	} events;
 
-	// May be NULL
+	// May be NULL. Only called for points inside the node's bounds.
 	wlr_scene_buffer_point_accepts_input_func_t point_accepts_input;
 
 	/**
@@ -149,9 +158,13 @@ struct wlr_scene_buffer {
 
 	uint64_t active_outputs;
 	struct wlr_texture *texture;
+	struct wlr_renderer *texture_renderer;
+	struct wl_list cached_textures;
 	struct wlr_fbox src_box;
 	int dst_width, dst_height;
 	enum wl_output_transform transform;
+	pixman_region32_t opaque_region;
+	bool buffer_is_opaque;
 };
 
 /** A viewport for an output in the scene-graph */
@@ -180,6 +193,8 @@ struct wlr_scene_output {
 	struct wl_listener output_needs_frame;
 
 	struct wl_list damage_highlight_regions;
+
+	struct wl_array render_list;
 };
 
 /** A layer shell scene helper */
@@ -268,6 +283,15 @@ struct wlr_scene *wlr_scene_create(void);
 void wlr_scene_set_presentation(struct wlr_scene *scene,
 	struct wlr_presentation *presentation);
 
+/**
+ * Set the maximum amount of memory, in bytes, used to keep the textures of
+ * buffers which are no longer displayed by a scene buffer, so that they can be
+ * re-used if the buffer is displayed again. Least recently used textures are
+ * evicted first. A budget of zero disables the cache.
+ */
+void wlr_scene_set_texture_cache_budget(struct wlr_scene *scene,
+	size_t budget);
+
 /**
  * Add a node displaying nothing but its children.
  */
@@ -335,6 +359,15 @@ void wlr_scene_buffer_set_buffer(struct wlr_scene_buffer *scene_buffer,
 void wlr_scene_buffer_set_buffer_with_damage(struct wlr_scene_buffer *scene_buffer,
 	struct wlr_buffer *buffer, pixman_region32_t *region);
 
+/**
+ * Sets the buffer's opaque region. This is an optimization hint used to
+ * determine if nodes which reside under this one need to be rendered or not.
+ *
+ * The region is in node-local coordinates.
+ */
+void wlr_scene_buffer_set_opaque_region(struct wlr_scene_buffer *scene_buffer,
+	pixman_region32_t *region);
+
 /**
  * Set the source rectangle describing the region of the buffer which will be
  * sampled to render this node. This allows cropping the buffer.
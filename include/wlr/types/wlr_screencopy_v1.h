@@ -30,6 +30,7 @@ struct wlr_screencopy_v1_client {
 	int ref;
 	struct wlr_screencopy_manager_v1 *manager;
 	struct wl_list damages;
+	struct wl_list buffers;
 };
 
 struct wlr_screencopy_frame_v1 {
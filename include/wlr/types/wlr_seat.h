@@ -16,6 +16,7 @@
 #include <wlr/types/wlr_pointer.h>
 
 struct wlr_surface;
+struct hash_table;
 
 #define WLR_SERIAL_RINGSET_SIZE 128
 
@@ -67,6 +68,10 @@ struct wlr_seat_client {
 		int32_t last_discrete[2];
 		double acc_axis[2];
 	} value120;
+
+	// private state
+
+	struct wl_list hash_link; // wlr_seat.clients_by_wl_client
 };
 
 struct wlr_touch_point {
@@ -189,6 +194,27 @@ struct wlr_seat_pointer_state {
 	uint32_t grab_serial;
 	uint32_t grab_time;
 
+	// Motion coalescing, see wlr_seat_pointer_set_motion_coalescing()
+	bool coalesce_motion;
+	uint32_t coalesce_interval_ms;
+	struct wl_event_source *coalesce_timer;
+	bool motion_pending, frame_pending;
+	bool unframed_events; // button or axis events not followed by a frame yet
+	uint32_t pending_motion_time;
+	// read time of the first coalesced motion event, for input latency
+	// tracing, or 0 if not traced
+	int64_t pending_motion_dispatch_nsec;
+	double pending_sx, pending_sy;
+	double sent_sx, sent_sy; // last position sent before the pending motion
+
+	// Event bundling, see wlr_seat_pointer_set_event_bundling()
+	bool bundle_events;
+	struct wl_event_source *bundle_idle;
+	// leave event delayed until the end of the event loop iteration
+	struct wlr_seat_client *leave_client;
+	struct wlr_surface *leave_surface;
+	double leave_sx, leave_sy;
+
 	struct wl_listener surface_destroy;
 
 	struct {
@@ -298,6 +324,11 @@ struct wlr_seat {
 	} events;
 
 	void *data;
+
+	// private state
+
+	// wlr_seat_client.hash_link, indexed by wl_client
+	struct hash_table *clients_by_wl_client;
 };
 
 struct wlr_seat_pointer_request_set_cursor_event {
@@ -468,6 +499,35 @@ void wlr_seat_pointer_notify_axis(struct wlr_seat *wlr_seat, uint32_t time_msec,
  */
 void wlr_seat_pointer_notify_frame(struct wlr_seat *wlr_seat);
 
+/**
+ * Enable or disable pointer motion coalescing. When enabled, consecutive
+ * motion events for the focused client are merged into one: only the latest
+ * position is sent, followed by a frame event, when
+ * wlr_seat_pointer_flush_motion() is called (e.g. on output frame events), or
+ * after interval_ms milliseconds if interval_ms is non-zero.
+ *
+ * Pending motion is always sent before button, axis, enter and leave events.
+ * Relative motion sent by wlr_relative_pointer_manager_v1 isn't coalesced.
+ */
+void wlr_seat_pointer_set_motion_coalescing(struct wlr_seat *wlr_seat,
+	bool enabled, uint32_t interval_ms);
+
+/**
+ * Send the pending coalesced motion event, if any, to the focused client.
+ */
+void wlr_seat_pointer_flush_motion(struct wlr_seat *wlr_seat);
+
+/**
+ * Enable or disable pointer event bundling. When enabled, a leave event sent
+ * when the pointer focus is cleared is delayed until the end of the current
+ * event loop iteration. If the pointer enters the same surface at the same
+ * position before that, neither the leave nor the enter event are sent.
+ *
+ * The focus_change event is still emitted for every focus change.
+ */
+void wlr_seat_pointer_set_event_bundling(struct wlr_seat *wlr_seat,
+	bool enabled);
+
 /**
  * Start a grab of the pointer of this seat. The grabber is responsible for
  * handling all pointer events until the grab ends.
@@ -32,6 +32,10 @@ struct wlr_xcursor_manager {
 	char *name;
 	uint32_t size;
 	struct wl_list scaled_themes; // wlr_xcursor_manager_theme::link
+
+	// Load themes with wlr_xcursor_theme_load_lazy()
+	bool lazy;
+	size_t memory_budget; // per scale factor, in bytes, 0 means unlimited
 };
 
 /**
@@ -41,6 +45,16 @@ struct wlr_xcursor_manager {
 struct wlr_xcursor_manager *wlr_xcursor_manager_create(const char *name,
 	uint32_t size);
 
+/**
+ * Creates a new XCursor manager which decodes cursors on first use. If
+ * memory_budget is non-zero, least recently used cursors are unloaded when
+ * the cursors decoded at a scale factor use more than memory_budget bytes:
+ * cursors returned by wlr_xcursor_manager_get_xcursor() then remain valid only
+ * until the next lookup.
+ */
+struct wlr_xcursor_manager *wlr_xcursor_manager_create_lazy(const char *name,
+	uint32_t size, size_t memory_budget);
+
 void wlr_xcursor_manager_destroy(struct wlr_xcursor_manager *manager);
 
 /**
@@ -0,0 +1,63 @@
+/*
+ * This an unstable interface of wlroots. No guarantees are made regarding the
+ * future consistency of this API.
+ */
+#ifndef WLR_USE_UNSTABLE
+#error "Add -DWLR_USE_UNSTABLE to enable unstable wlroots features"
+#endif
+
+#ifndef WLR_UTIL_INPUT_LATENCY_H
+#define WLR_UTIL_INPUT_LATENCY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Stages of the life of an input event in the compositor.
+ */
+enum wlr_input_latency_stage {
+	// From the kernel timestamp to the backend reading the event
+	WLR_INPUT_LATENCY_DISPATCH,
+	// From the backend reading the event to sending it to a client
+	WLR_INPUT_LATENCY_HANDLING,
+	// From sending the event to a client to the presentation of the next
+	// output frame. Which output shows the result isn't known: events are
+	// attributed to the first output committing a frame after they're sent.
+	WLR_INPUT_LATENCY_SCANOUT,
+};
+
+#define WLR_INPUT_LATENCY_STAGE_COUNT 3
+#define WLR_INPUT_LATENCY_BUCKETS 24
+
+/**
+ * Histogram of the latencies measured for a stage. Bucket i counts latencies
+ * between 2^i and 2^(i+1) microseconds, except the first one which starts at
+ * zero and the last one which has no upper bound.
+ */
+struct wlr_input_latency_histogram {
+	uint64_t buckets[WLR_INPUT_LATENCY_BUCKETS];
+	uint64_t count;
+	uint64_t total_usec, max_usec;
+};
+
+/**
+ * Enable or disable input latency tracing. Only keyboard keys and pointer
+ * motion and buttons read by the libinput backend are traced.
+ *
+ * Tracing is also enabled by the WLR_INPUT_LATENCY environment variable.
+ */
+void wlr_input_latency_set_enabled(bool enabled);
+
+/**
+ * Get the histogram of latencies measured for a stage since tracing was
+ * enabled or reset.
+ */
+void wlr_input_latency_get_histogram(enum wlr_input_latency_stage stage,
+	struct wlr_input_latency_histogram *histogram);
+
+/**
+ * Clear all recorded latencies.
+ */
+void wlr_input_latency_reset(void);
+
+#endif
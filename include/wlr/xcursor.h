@@ -41,6 +41,7 @@
 #ifndef WLR_XCURSOR_H
 #define WLR_XCURSOR_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <wlr/util/edges.h>
 
@@ -78,8 +79,18 @@ struct wlr_xcursor_theme {
 	struct wlr_xcursor **cursors;
 	char *name;
 	int size;
+
+	// private state
+
+	struct xcursor_cache *cache; // may be NULL
+	struct xcursor_index_entry *index; // cursor files, if loaded lazily
+	size_t index_len;
+	size_t memory_budget, memory_used; // bytes of decoded cursor images
 };
 
+struct xcursor_cache;
+struct xcursor_index_entry;
+
 /**
  * Loads the named Xcursor theme.
  *
@@ -93,10 +104,27 @@ struct wlr_xcursor_theme {
  * If a cursor theme with the given name couldn't be loaded, a fallback theme
  * is loaded.
  *
+ * Decoded themes are cached on disk, and the cache is used as long as the
+ * theme directories are unchanged. Cursors are then only loaded when first
+ * requested with wlr_xcursor_theme_get_cursor(), and the cursors array only
+ * contains the cursors loaded so far.
+ *
  * On error, NULL is returned.
  */
 struct wlr_xcursor_theme *wlr_xcursor_theme_load(const char *name, int size);
 
+/**
+ * Loads the named Xcursor theme, without decoding any cursor yet.
+ *
+ * Only the list of cursor files is built, and cursors are decoded on first
+ * use by wlr_xcursor_theme_get_cursor(). If memory_budget is non-zero, the
+ * least recently used cursors are unloaded when the decoded images use more
+ * than memory_budget bytes. A cursor returned by
+ * wlr_xcursor_theme_get_cursor() then remains valid only until the next call.
+ */
+struct wlr_xcursor_theme *wlr_xcursor_theme_load_lazy(const char *name,
+	int size, size_t memory_budget);
+
 /**
  * Destroy a cursor theme.
  *
@@ -131,6 +131,7 @@ struct wlr_xwayland_surface {
 	struct wl_list link;
 	struct wl_list stack_link;
 	struct wl_list unpaired_link;
+	struct wl_list hash_link; // wlr_xwm::surfaces_by_id
 
 	struct wlr_surface *surface;
 	int16_t x, y;
@@ -139,6 +140,10 @@ struct wlr_xwayland_surface {
 	bool override_redirect;
 	bool mapped;
 
+	// Number of property reads in flight, mapping waits for them
+	size_t pending_properties;
+	bool map_request_pending;
+
 	char *title;
 	char *class;
 	char *instance;
@@ -0,0 +1,51 @@
+#ifndef XCURSOR_CACHE_H
+#define XCURSOR_CACHE_H
+
+#include <stdbool.h>
+#include <time.h>
+#include <wayland-util.h>
+
+struct wlr_xcursor;
+
+/**
+ * A mapped cache file holding the decoded cursors of a theme at a given size.
+ */
+struct xcursor_cache;
+
+/**
+ * A directory or file consulted while loading a theme. The cache is only
+ * valid as long as none of them change.
+ */
+struct xcursor_cache_source {
+	char *path;
+	bool exists;
+	struct timespec mtime;
+};
+
+/**
+ * Open the cache file for a theme, and check that it's up-to-date. Returns
+ * NULL if there is no valid cache.
+ */
+struct xcursor_cache *xcursor_cache_open(const char *theme, int size);
+void xcursor_cache_destroy(struct xcursor_cache *cache);
+/**
+ * Decode a cursor from the cache. Returns NULL if the theme has no cursor
+ * with this name.
+ */
+struct wlr_xcursor *xcursor_cache_load_cursor(struct xcursor_cache *cache,
+	const char *name);
+
+/**
+ * Record the current state of a path in an array of struct
+ * xcursor_cache_source.
+ */
+void xcursor_cache_add_source(struct wl_array *sources, const char *path);
+void xcursor_cache_sources_finish(struct wl_array *sources);
+/**
+ * Write the cache file for a theme loaded from the specified sources.
+ */
+bool xcursor_cache_write(const char *theme, int size,
+	struct wlr_xcursor **cursors, unsigned int cursors_len,
+	const struct wl_array *sources);
+
+#endif
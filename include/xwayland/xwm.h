@@ -8,6 +8,7 @@
 #if HAS_XCB_ERRORS
 #include <xcb/xcb_errors.h>
 #endif
+#include "util/hash_table.h"
 #include "xwayland/selection.h"
 
 /* This is in xcb/xcb_event.h, but pulling xcb-util just for a constant
@@ -115,7 +116,10 @@ struct wlr_xwm {
 	// Surfaces in bottom-to-top stacking order, for _NET_CLIENT_LIST_STACKING
 	struct wl_list surfaces_in_stack_order; // wlr_xwayland_surface::stack_link
 	struct wl_list unpaired_surfaces; // wlr_xwayland_surface::unpaired_link
+	// Surfaces by window ID
+	struct hash_table surfaces_by_id; // wlr_xwayland_surface::hash_link
 	struct wl_list pending_startup_ids; // pending_startup_id
+	struct wl_list pending_properties; // pending_property::link
 
 	struct wlr_drag *drag;
 	struct wlr_xwayland_surface *drag_focus;
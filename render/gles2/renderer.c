@@ -328,10 +328,29 @@ static void gles2_scissor(struct wlr_renderer *wlr_renderer,
 	pop_gles2_debug(renderer);
 }
 
-static bool gles2_render_subtexture_with_matrix(
+// Issues the draw call once per rectangle of the clip region, or once without
+// changing the scissor state if there is no clip region
+static void draw_clipped(pixman_region32_t *clip) {
+	if (clip == NULL) {
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+		return;
+	}
+
+	int nrects;
+	pixman_box32_t *rects = pixman_region32_rectangles(clip, &nrects);
+	glEnable(GL_SCISSOR_TEST);
+	for (int i = 0; i < nrects; ++i) {
+		glScissor(rects[i].x1, rects[i].y1,
+			rects[i].x2 - rects[i].x1, rects[i].y2 - rects[i].y1);
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	}
+	glDisable(GL_SCISSOR_TEST);
+}
+
+static bool render_subtexture(
 		struct wlr_renderer *wlr_renderer, struct wlr_texture *wlr_texture,
 		const struct wlr_fbox *box, const float matrix[static 9],
-		float alpha) {
+		float alpha, pixman_region32_t *clip) {
 	struct wlr_gles2_renderer *renderer =
 		gles2_get_renderer_in_context(wlr_renderer);
 	struct wlr_gles2_texture *texture =
@@ -423,7 +442,7 @@ static bool gles2_render_subtexture_with_matrix(
 	glEnableVertexAttribArray(shader->pos_attrib);
 	glEnableVertexAttribArray(shader->tex_attrib);
 
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	draw_clipped(clip);
 
 	glDisableVertexAttribArray(shader->pos_attrib);
 	glDisableVertexAttribArray(shader->tex_attrib);
@@ -435,8 +454,9 @@ static bool gles2_render_subtexture_with_matrix(
 	return true;
 }
 
-static void gles2_render_quad_with_matrix(struct wlr_renderer *wlr_renderer,
-		const float color[static 4], const float matrix[static 9]) {
+static void render_quad(struct wlr_renderer *wlr_renderer,
+		const float color[static 4], const float matrix[static 9],
+		pixman_region32_t *clip) {
 	struct wlr_gles2_renderer *renderer =
 		gles2_get_renderer_in_context(wlr_renderer);
 
@@ -465,13 +485,40 @@ static void gles2_render_quad_with_matrix(struct wlr_renderer *wlr_renderer,
 
 	glEnableVertexAttribArray(renderer->shaders.quad.pos_attrib);
 
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	draw_clipped(clip);
 
 	glDisableVertexAttribArray(renderer->shaders.quad.pos_attrib);
 
 	pop_gles2_debug(renderer);
 }
 
+static bool gles2_render_subtexture_with_matrix(
+		struct wlr_renderer *wlr_renderer, struct wlr_texture *wlr_texture,
+		const struct wlr_fbox *box, const float matrix[static 9],
+		float alpha) {
+	return render_subtexture(wlr_renderer, wlr_texture, box, matrix, alpha,
+		NULL);
+}
+
+static bool gles2_render_subtexture_with_matrix_region(
+		struct wlr_renderer *wlr_renderer, struct wlr_texture *wlr_texture,
+		const struct wlr_fbox *box, const float matrix[static 9],
+		float alpha, pixman_region32_t *clip) {
+	return render_subtexture(wlr_renderer, wlr_texture, box, matrix, alpha,
+		clip);
+}
+
+static void gles2_render_quad_with_matrix(struct wlr_renderer *wlr_renderer,
+		const float color[static 4], const float matrix[static 9]) {
+	render_quad(wlr_renderer, color, matrix, NULL);
+}
+
+static void gles2_render_quad_with_matrix_region(
+		struct wlr_renderer *wlr_renderer, const float color[static 4],
+		const float matrix[static 9], pixman_region32_t *clip) {
+	render_quad(wlr_renderer, color, matrix, clip);
+}
+
 static const uint32_t *gles2_get_shm_texture_formats(
 		struct wlr_renderer *wlr_renderer, size_t *len) {
 	struct wlr_gles2_renderer *renderer = gles2_get_renderer(wlr_renderer);
@@ -640,6 +687,9 @@ static const struct wlr_renderer_impl renderer_impl = {
 	.scissor = gles2_scissor,
 	.render_subtexture_with_matrix = gles2_render_subtexture_with_matrix,
 	.render_quad_with_matrix = gles2_render_quad_with_matrix,
+	.render_subtexture_with_matrix_region =
+		gles2_render_subtexture_with_matrix_region,
+	.render_quad_with_matrix_region = gles2_render_quad_with_matrix_region,
 	.get_shm_texture_formats = gles2_get_shm_texture_formats,
 	.get_dmabuf_texture_formats = gles2_get_dmabuf_texture_formats,
 	.get_render_formats = gles2_get_render_formats,
@@ -1,5 +1,7 @@
 #include <assert.h>
 #include <drm_fourcc.h>
+#include <errno.h>
+#include <math.h>
 #include <pixman.h>
 #include <stdlib.h>
 #include <wayland-server.h>
@@ -46,8 +48,16 @@ static struct wlr_pixman_texture *get_texture(
 	return (struct wlr_pixman_texture *)wlr_texture;
 }
 
+static void pixman_flush(struct wlr_pixman_renderer *renderer);
+static void pixman_flush_ops(struct wlr_pixman_renderer *renderer,
+	bool end_of_pass);
+static void pixman_release_ops(struct wlr_pixman_renderer *renderer,
+	struct wlr_pixman_op *last_scissor);
+
 static void texture_destroy(struct wlr_texture *wlr_texture) {
 	struct wlr_pixman_texture *texture = get_texture(wlr_texture);
+	// Recorded operations may still refer to the texture's data
+	pixman_flush(texture->renderer);
 	wl_list_remove(&texture->link);
 	pixman_image_unref(texture->image);
 	wlr_buffer_unlock(texture->buffer);
@@ -127,6 +137,26 @@ error_buffer:
 	return NULL;
 }
 
+// Lower bound for the height of the bands the render target is split into
+// when rendering with worker threads
+#define MIN_BAND_HEIGHT 16
+// Number of bands per worker, to balance uneven workloads
+#define BANDS_PER_WORKER 4
+
+/**
+ * The image draw operations are applied to. When rendering with worker
+ * threads, each band of the render target gets its own target, and only the
+ * pixels inside box may be written.
+ */
+struct pixman_draw_target {
+	pixman_image_t *image;
+	struct wlr_box box;
+	struct wlr_pixman_solid_fill_cache *solid_fills;
+	// Whether texture images are shared with other threads, in which case
+	// they can't be mutated
+	bool shared_textures;
+};
+
 static void pixman_begin(struct wlr_renderer *wlr_renderer, uint32_t width,
 		uint32_t height) {
 	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
@@ -136,6 +166,9 @@ static void pixman_begin(struct wlr_renderer *wlr_renderer, uint32_t width,
 	struct wlr_pixman_buffer *buffer = renderer->current_buffer;
 	assert(buffer != NULL);
 
+	// Nothing recorded before the pass applies to it
+	pixman_release_ops(renderer, NULL);
+
 	void *data = NULL;
 	uint32_t drm_format;
 	size_t stride;
@@ -153,6 +186,8 @@ static void pixman_begin(struct wlr_renderer *wlr_renderer, uint32_t width,
 		buffer->image = pixman_image_create_bits_no_clear(format,
 			buffer->buffer->width, buffer->buffer->height, data, stride);
 	}
+
+	pixman_image_set_clip_region32(buffer->image, NULL);
 }
 
 static void pixman_end(struct wlr_renderer *wlr_renderer) {
@@ -160,42 +195,53 @@ static void pixman_end(struct wlr_renderer *wlr_renderer) {
 
 	assert(renderer->current_buffer != NULL);
 
+	pixman_flush_ops(renderer, true);
+
 	wlr_buffer_end_data_ptr_access(renderer->current_buffer->buffer);
 }
 
-static void pixman_clear(struct wlr_renderer *wlr_renderer,
-		const float color[static 4]) {
-	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
-	struct wlr_pixman_buffer *buffer = renderer->current_buffer;
-
-	const struct pixman_color colour = {
+static struct pixman_color color_to_pixman(const float color[static 4]) {
+	return (struct pixman_color){
 		.red = color[0] * 0xFFFF,
 		.green = color[1] * 0xFFFF,
 		.blue = color[2] * 0xFFFF,
 		.alpha = color[3] * 0xFFFF,
 	};
+}
 
-	pixman_image_t *fill = pixman_image_create_solid_fill(&colour);
+static pixman_image_t *get_solid_fill(
+		struct wlr_pixman_solid_fill_cache *cache,
+		const struct pixman_color *colour) {
+	for (size_t i = 0; i < WLR_PIXMAN_SOLID_FILL_CACHE_SIZE; i++) {
+		struct wlr_pixman_solid_fill *fill = &cache->fills[i];
+		if (fill->image != NULL && fill->color.red == colour->red &&
+				fill->color.green == colour->green &&
+				fill->color.blue == colour->blue &&
+				fill->color.alpha == colour->alpha) {
+			return fill->image;
+		}
+	}
 
-	pixman_image_composite32(PIXMAN_OP_SRC, fill, NULL, buffer->image, 0, 0, 0,
-			0, 0, 0, renderer->width, renderer->height);
+	pixman_image_t *image = pixman_image_create_solid_fill(colour);
+	if (image == NULL) {
+		return NULL;
+	}
 
-	pixman_image_unref(fill);
+	struct wlr_pixman_solid_fill *fill = &cache->fills[cache->next];
+	cache->next = (cache->next + 1) % WLR_PIXMAN_SOLID_FILL_CACHE_SIZE;
+	if (fill->image != NULL) {
+		pixman_image_unref(fill->image);
+	}
+	fill->color = *colour;
+	fill->image = image;
+	return image;
 }
 
-static void pixman_scissor(struct wlr_renderer *wlr_renderer,
-		struct wlr_box *box) {
-	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
-	struct wlr_pixman_buffer *buffer = renderer->current_buffer;
-
-	if (box != NULL) {
-		struct pixman_region32 region = {0};
-		pixman_region32_init_rect(&region, box->x, box->y, box->width,
-				box->height);
-		pixman_image_set_clip_region32(buffer->image, &region);
-		pixman_region32_fini(&region);
-	} else {
-		pixman_image_set_clip_region32(buffer->image, NULL);
+static void solid_fill_cache_finish(struct wlr_pixman_solid_fill_cache *cache) {
+	for (size_t i = 0; i < WLR_PIXMAN_SOLID_FILL_CACHE_SIZE; i++) {
+		if (cache->fills[i].image != NULL) {
+			pixman_image_unref(cache->fills[i].image);
+		}
 	}
 }
 
@@ -215,78 +261,170 @@ static void matrix_to_pixman_transform(struct pixman_transform *transform,
 	pixman_transform_from_pixman_f_transform(transform, &ftr);
 }
 
-static bool pixman_render_subtexture_with_matrix(
-		struct wlr_renderer *wlr_renderer, struct wlr_texture *wlr_texture,
-		const struct wlr_fbox *fbox, const float matrix[static 9],
-		float alpha) {
-	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
-	struct wlr_pixman_texture *texture = get_texture(wlr_texture);
-	struct wlr_pixman_buffer *buffer = renderer->current_buffer;
+// Computes the bounding box of a rectangle once transformed by the matrix,
+// clipped to the target. Returns false if nothing needs to be drawn.
+static bool get_dst_box(const struct pixman_draw_target *target,
+		const float m[static 9], double x, double y, double width,
+		double height, struct wlr_box *box) {
+	const double corners[4][2] = {
+		{ x, y },
+		{ x + width, y },
+		{ x, y + height },
+		{ x + width, y + height },
+	};
 
-	if (texture->buffer != NULL) {
-		void *data;
-		uint32_t drm_format;
-		size_t stride;
-		if (!wlr_buffer_begin_data_ptr_access(texture->buffer,
-				WLR_BUFFER_DATA_PTR_ACCESS_READ, &data, &drm_format, &stride)) {
-			return false;
-		}
+	double x1 = INFINITY, y1 = INFINITY, x2 = -INFINITY, y2 = -INFINITY;
+	for (size_t i = 0; i < 4; i++) {
+		double cx = m[0] * corners[i][0] + m[1] * corners[i][1] + m[2];
+		double cy = m[3] * corners[i][0] + m[4] * corners[i][1] + m[5];
+		x1 = fmin(x1, cx);
+		y1 = fmin(y1, cy);
+		x2 = fmax(x2, cx);
+		y2 = fmax(y2, cy);
+	}
 
-		// If the data pointer has changed, re-create the Pixman image. This can
-		// happen if it's a client buffer and the wl_shm_pool has been resized.
-		if (data != pixman_image_get_data(texture->image)) {
-			pixman_format_code_t format = get_pixman_format_from_drm(drm_format);
-			assert(format != 0);
+	struct wlr_box bounds = {
+		.x = floor(x1),
+		.y = floor(y1),
+		.width = ceil(x2) - floor(x1),
+		.height = ceil(y2) - floor(y1),
+	};
+	return wlr_box_intersection(box, &bounds, &target->box);
+}
 
-			pixman_image_unref(texture->image);
-			texture->image = pixman_image_create_bits_no_clear(format,
-				texture->wlr_texture.width, texture->wlr_texture.height,
-				data, stride);
-		}
+static bool is_integer(float value) {
+	return fabs(value - round(value)) < 1e-4;
+}
+
+// Checks whether the matrix is a translation by a whole number of pixels
+static bool matrix_is_integer_translation(const float m[static 9]) {
+	return fabs(m[0] - 1.0) < 1e-6 && m[1] == 0.0 &&
+		m[3] == 0.0 && fabs(m[4] - 1.0) < 1e-6 &&
+		is_integer(m[2]) && is_integer(m[5]);
+}
+
+static void draw_clear(struct pixman_draw_target *target,
+		const struct wlr_pixman_op *op) {
+	const pixman_box32_t box = {
+		.x1 = target->box.x,
+		.y1 = target->box.y,
+		.x2 = target->box.x + target->box.width,
+		.y2 = target->box.y + target->box.height,
+	};
+	pixman_image_fill_boxes(PIXMAN_OP_SRC, target->image, &op->color, 1, &box);
+}
+
+static void draw_scissor(struct pixman_draw_target *target,
+		const struct wlr_pixman_op *op) {
+	struct pixman_region32 region = {0};
+	pixman_region32_init_rect(&region, target->box.x, target->box.y,
+		target->box.width, target->box.height);
+	if (op->has_scissor) {
+		pixman_region32_intersect(&region, &region,
+			(pixman_region32_t *)&op->scissor);
 	}
+	pixman_image_set_clip_region32(target->image, &region);
+	pixman_region32_fini(&region);
+}
+
+static void draw_texture(struct pixman_draw_target *target,
+		const struct wlr_pixman_op *op) {
+	const struct wlr_fbox *fbox = &op->src_box;
 
-	// TODO: don't create a mask if alpha == 1.0
-	struct pixman_color mask_colour = {0};
-	mask_colour.alpha = 0xFFFF * alpha;
-	pixman_image_t *mask = pixman_image_create_solid_fill(&mask_colour);
+	pixman_image_t *mask = NULL;
+	if (op->alpha != 1.0) {
+		struct pixman_color mask_colour = {0};
+		mask_colour.alpha = 0xFFFF * op->alpha;
+		mask = get_solid_fill(target->solid_fills, &mask_colour);
+	}
 
 	float m[9];
-	memcpy(m, matrix, sizeof(m));
+	memcpy(m, op->matrix, sizeof(m));
 	wlr_matrix_scale(m, 1.0 / fbox->width, 1.0 / fbox->height);
+	wlr_matrix_translate(m, -fbox->x, -fbox->y);
 
-	struct pixman_transform transform = {0};
-	matrix_to_pixman_transform(&transform, m);
-	pixman_transform_invert(&transform, &transform);
-
-	pixman_image_set_transform(texture->image, &transform);
-
-	// TODO clip properly with src_x and src_y
-	pixman_image_composite32(PIXMAN_OP_OVER, texture->image, mask,
-			buffer->image, 0, 0, 0, 0, 0, 0, renderer->width,
-			renderer->height);
+	struct wlr_box dst_box;
+	if (!get_dst_box(target, m, fbox->x, fbox->y, fbox->width, fbox->height,
+			&dst_box)) {
+		return;
+	}
 
-	if (texture->buffer != NULL) {
-		wlr_buffer_end_data_ptr_access(texture->buffer);
+	// The transform is stored in the image, so other threads need their own
+	pixman_image_t *image = op->image;
+	if (target->shared_textures) {
+		image = pixman_image_create_bits_no_clear(
+			pixman_image_get_format(op->image),
+			pixman_image_get_width(op->image),
+			pixman_image_get_height(op->image),
+			pixman_image_get_data(op->image),
+			pixman_image_get_stride(op->image));
+		if (image == NULL) {
+			return;
+		}
 	}
 
-	pixman_image_unref(mask);
+	if (matrix_is_integer_translation(m)) {
+		// Plain blit, no need to go through the transform code paths
+		int src_x = dst_box.x - (int)round(m[2]);
+		int src_y = dst_box.y - (int)round(m[5]);
+		pixman_image_set_transform(image, NULL);
+		pixman_image_composite32(PIXMAN_OP_OVER, image, mask,
+			target->image, src_x, src_y, 0, 0, dst_box.x, dst_box.y,
+			dst_box.width, dst_box.height);
+	} else {
+		struct pixman_transform transform = {0};
+		matrix_to_pixman_transform(&transform, m);
+		pixman_transform_invert(&transform, &transform);
+
+		pixman_image_set_transform(image, &transform);
+		pixman_image_composite32(PIXMAN_OP_OVER, image, mask,
+			target->image, dst_box.x, dst_box.y, 0, 0, dst_box.x, dst_box.y,
+			dst_box.width, dst_box.height);
+	}
 
-	return true;
+	if (image != op->image) {
+		pixman_image_unref(image);
+	}
 }
 
-static void pixman_render_quad_with_matrix(struct wlr_renderer *wlr_renderer,
-		const float color[static 4], const float matrix[static 9]) {
-	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
-	struct wlr_pixman_buffer *buffer = renderer->current_buffer;
-
-	struct pixman_color colour = {
-		.red = color[0] * 0xFFFF,
-		.green = color[1] * 0xFFFF,
-		.blue = color[2] * 0xFFFF,
-		.alpha = color[3] * 0xFFFF,
-	};
+static void draw_quad(struct pixman_draw_target *target,
+		const struct wlr_pixman_op *op) {
+	const struct pixman_color *colour = &op->color;
+	const float *matrix = op->matrix;
+
+	// Axis-aligned rectangles (including 90 degree rotations) can be filled
+	// directly, without going through an intermediate image
+	if ((matrix[1] == 0.0 && matrix[3] == 0.0) ||
+			(matrix[0] == 0.0 && matrix[4] == 0.0)) {
+		struct wlr_box dst_box;
+		if (!get_dst_box(target, matrix, 0, 0, 1, 1, &dst_box)) {
+			return;
+		}
+		const pixman_box32_t box = {
+			.x1 = dst_box.x,
+			.y1 = dst_box.y,
+			.x2 = dst_box.x + dst_box.width,
+			.y2 = dst_box.y + dst_box.height,
+		};
+
+		if (colour->alpha == 0xFFFF) {
+			pixman_image_fill_boxes(PIXMAN_OP_SRC, target->image, colour,
+				1, &box);
+		} else {
+			pixman_image_t *fill = get_solid_fill(target->solid_fills, colour);
+			if (fill != NULL) {
+				pixman_image_composite32(PIXMAN_OP_OVER, fill, NULL,
+					target->image, 0, 0, 0, 0, dst_box.x, dst_box.y,
+					dst_box.width, dst_box.height);
+			}
+		}
+		return;
+	}
 
-	pixman_image_t *fill = pixman_image_create_solid_fill(&colour);
+	pixman_image_t *fill = get_solid_fill(target->solid_fills, colour);
+	if (fill == NULL) {
+		return;
+	}
 
 	float m[9];
 	memcpy(m, matrix, sizeof(m));
@@ -303,13 +441,17 @@ static void pixman_render_quad_with_matrix(struct wlr_renderer *wlr_renderer,
 
 	wlr_matrix_scale(m, 1.0 / width, 1.0 / height);
 
+	struct wlr_box dst_box;
+	if (!get_dst_box(target, m, 0, 0, width, height, &dst_box)) {
+		return;
+	}
+
 	pixman_image_t *image = pixman_image_create_bits(PIXMAN_a8r8g8b8, width,
 			height, NULL, 0);
 
 	// TODO find a way to fill the image without allocating 2 images
 	pixman_image_composite32(PIXMAN_OP_SRC, fill, NULL, image,
 		0, 0, 0, 0, 0, 0, width, height);
-	pixman_image_unref(fill);
 
 	struct pixman_transform transform = {0};
 	matrix_to_pixman_transform(&transform, m);
@@ -317,12 +459,354 @@ static void pixman_render_quad_with_matrix(struct wlr_renderer *wlr_renderer,
 
 	pixman_image_set_transform(image, &transform);
 
-	pixman_image_composite32(PIXMAN_OP_OVER, image, NULL, buffer->image,
-			0, 0, 0, 0, 0, 0, renderer->width, renderer->height);
+	pixman_image_composite32(PIXMAN_OP_OVER, image, NULL, target->image,
+		dst_box.x, dst_box.y, 0, 0, dst_box.x, dst_box.y,
+		dst_box.width, dst_box.height);
 
 	pixman_image_unref(image);
 }
 
+static void draw_op(struct pixman_draw_target *target,
+		const struct wlr_pixman_op *op) {
+	switch (op->type) {
+	case WLR_PIXMAN_OP_CLEAR:
+		draw_clear(target, op);
+		break;
+	case WLR_PIXMAN_OP_SCISSOR:
+		draw_scissor(target, op);
+		break;
+	case WLR_PIXMAN_OP_TEXTURE:
+		draw_texture(target, op);
+		break;
+	case WLR_PIXMAN_OP_QUAD:
+		draw_quad(target, op);
+		break;
+	}
+}
+
+struct band_state {
+	struct wlr_pixman_renderer *renderer;
+	int band_height;
+};
+
+static void render_band(size_t band, size_t worker, void *data) {
+	struct band_state *state = data;
+	struct wlr_pixman_renderer *renderer = state->renderer;
+	pixman_image_t *buffer_image = renderer->current_buffer->image;
+
+	struct wlr_box target_box = {
+		.width = renderer->width,
+		.height = renderer->height,
+	};
+	struct wlr_box band_box = {
+		.y = band * state->band_height,
+		.width = renderer->width,
+		.height = state->band_height,
+	};
+	struct wlr_box box;
+	if (!wlr_box_intersection(&box, &band_box, &target_box)) {
+		return;
+	}
+
+	// Each thread needs its own image, since the clip region is stored in it
+	pixman_image_t *image = pixman_image_create_bits_no_clear(
+		pixman_image_get_format(buffer_image),
+		pixman_image_get_width(buffer_image),
+		pixman_image_get_height(buffer_image),
+		pixman_image_get_data(buffer_image),
+		pixman_image_get_stride(buffer_image));
+	if (image == NULL) {
+		wlr_log(WLR_ERROR, "Failed to create pixman image");
+		return;
+	}
+
+	struct pixman_draw_target target = {
+		.image = image,
+		.box = box,
+		.solid_fills = &renderer->worker_solid_fills[worker],
+		.shared_textures = true,
+	};
+	const struct wlr_pixman_op reset_scissor = {
+		.type = WLR_PIXMAN_OP_SCISSOR,
+	};
+	draw_op(&target, &reset_scissor);
+
+	const struct wlr_pixman_op *op;
+	wl_array_for_each(op, &renderer->ops) {
+		draw_op(&target, op);
+	}
+
+	pixman_image_unref(image);
+}
+
+// Releases the operations recorded so far. If last_scissor is non-NULL, the
+// last scissor operation is moved into it instead of being released.
+static void pixman_release_ops(struct wlr_pixman_renderer *renderer,
+		struct wlr_pixman_op *last_scissor) {
+	struct wlr_pixman_op scissor = {
+		.type = WLR_PIXMAN_OP_SCISSOR,
+	};
+	struct wlr_pixman_op *op;
+	wl_array_for_each(op, &renderer->ops) {
+		if (op->type == WLR_PIXMAN_OP_SCISSOR) {
+			if (scissor.has_scissor) {
+				pixman_region32_fini(&scissor.scissor);
+			}
+			scissor = *op;
+		} else if (op->image != NULL) {
+			pixman_image_unref(op->image);
+		}
+	}
+	renderer->ops.size = 0;
+
+	struct wlr_buffer **buffer_ptr;
+	wl_array_for_each(buffer_ptr, &renderer->accessed_buffers) {
+		wlr_buffer_end_data_ptr_access(*buffer_ptr);
+		wlr_buffer_unlock(*buffer_ptr);
+	}
+	renderer->accessed_buffers.size = 0;
+
+	if (last_scissor != NULL) {
+		*last_scissor = scissor;
+	} else if (scissor.has_scissor) {
+		pixman_region32_fini(&scissor.scissor);
+	}
+}
+
+// Replays the operations recorded so far in this pass on the worker threads.
+// When flushing in the middle of a pass, the scissor is carried over to the
+// operations recorded after the flush.
+static void pixman_flush_ops(struct wlr_pixman_renderer *renderer,
+		bool end_of_pass) {
+	if (renderer->worker_pool == NULL || renderer->ops.size == 0) {
+		return;
+	}
+
+	// Outside of a pass, there is no target to replay the operations on
+	if (renderer->current_buffer == NULL) {
+		pixman_release_ops(renderer, NULL);
+		return;
+	}
+
+	size_t workers = pixman_worker_pool_get_size(renderer->worker_pool);
+	int bands_len = workers * BANDS_PER_WORKER;
+	int band_height = (renderer->height + bands_len - 1) / bands_len;
+	if (band_height < MIN_BAND_HEIGHT) {
+		band_height = MIN_BAND_HEIGHT;
+	}
+	bands_len = (renderer->height + band_height - 1) / band_height;
+
+	struct band_state state = {
+		.renderer = renderer,
+		.band_height = band_height,
+	};
+	pixman_worker_pool_run(renderer->worker_pool, bands_len, render_band,
+		&state);
+
+	if (end_of_pass) {
+		pixman_release_ops(renderer, NULL);
+		return;
+	}
+
+	struct wlr_pixman_op scissor;
+	pixman_release_ops(renderer, &scissor);
+	if (scissor.has_scissor) {
+		struct wlr_pixman_op *new_op = wl_array_add(&renderer->ops,
+			sizeof(*new_op));
+		if (new_op != NULL) {
+			*new_op = scissor;
+		} else {
+			pixman_region32_fini(&scissor.scissor);
+		}
+	}
+}
+
+static void pixman_flush(struct wlr_pixman_renderer *renderer) {
+	pixman_flush_ops(renderer, false);
+}
+
+// Takes ownership of the op's scissor region
+static void pixman_submit(struct wlr_pixman_renderer *renderer,
+		struct wlr_pixman_op *op) {
+	if (renderer->worker_pool == NULL) {
+		struct pixman_draw_target target = {
+			.image = renderer->current_buffer->image,
+			.box = { .width = renderer->width, .height = renderer->height },
+			.solid_fills = &renderer->solid_fills,
+		};
+		draw_op(&target, op);
+		if (op->has_scissor) {
+			pixman_region32_fini(&op->scissor);
+		}
+		return;
+	}
+
+	struct wlr_pixman_op *new_op = wl_array_add(&renderer->ops,
+		sizeof(*new_op));
+	if (new_op == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		if (op->has_scissor) {
+			pixman_region32_fini(&op->scissor);
+		}
+		return;
+	}
+	*new_op = *op;
+	if (new_op->image != NULL) {
+		pixman_image_ref(new_op->image);
+	}
+}
+
+static void pixman_clear(struct wlr_renderer *wlr_renderer,
+		const float color[static 4]) {
+	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
+
+	struct wlr_pixman_op op = {
+		.type = WLR_PIXMAN_OP_CLEAR,
+		.color = color_to_pixman(color),
+	};
+	pixman_submit(renderer, &op);
+}
+
+static void pixman_scissor(struct wlr_renderer *wlr_renderer,
+		struct wlr_box *box) {
+	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
+
+	struct wlr_pixman_op op = {
+		.type = WLR_PIXMAN_OP_SCISSOR,
+	};
+	if (box != NULL) {
+		op.has_scissor = true;
+		pixman_region32_init_rect(&op.scissor, box->x, box->y,
+			box->width, box->height);
+	}
+	pixman_submit(renderer, &op);
+}
+
+static void pixman_scissor_region(struct wlr_pixman_renderer *renderer,
+		pixman_region32_t *region) {
+	struct wlr_pixman_op op = {
+		.type = WLR_PIXMAN_OP_SCISSOR,
+		.has_scissor = true,
+	};
+	pixman_region32_init(&op.scissor);
+	pixman_region32_copy(&op.scissor, region);
+	pixman_submit(renderer, &op);
+}
+
+// Keeps the texture's buffer accessible until the recorded operations have
+// been replayed
+static bool begin_deferred_access(struct wlr_pixman_renderer *renderer,
+		struct wlr_buffer *buffer, void **data, uint32_t *drm_format,
+		size_t *stride) {
+	struct wlr_buffer **buffer_ptr;
+	wl_array_for_each(buffer_ptr, &renderer->accessed_buffers) {
+		if (*buffer_ptr == buffer) {
+			*data = NULL;
+			return true;
+		}
+	}
+
+	buffer_ptr = wl_array_add(&renderer->accessed_buffers, sizeof(*buffer_ptr));
+	if (buffer_ptr == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return false;
+	}
+	if (!wlr_buffer_begin_data_ptr_access(buffer,
+			WLR_BUFFER_DATA_PTR_ACCESS_READ, data, drm_format, stride)) {
+		renderer->accessed_buffers.size -= sizeof(*buffer_ptr);
+		return false;
+	}
+	*buffer_ptr = wlr_buffer_lock(buffer);
+	return true;
+}
+
+static bool pixman_render_subtexture_with_matrix(
+		struct wlr_renderer *wlr_renderer, struct wlr_texture *wlr_texture,
+		const struct wlr_fbox *fbox, const float matrix[static 9],
+		float alpha) {
+	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
+	struct wlr_pixman_texture *texture = get_texture(wlr_texture);
+
+	bool deferred = renderer->worker_pool != NULL;
+	if (texture->buffer != NULL) {
+		void *data;
+		uint32_t drm_format;
+		size_t stride;
+		if (deferred) {
+			if (!begin_deferred_access(renderer, texture->buffer, &data,
+					&drm_format, &stride)) {
+				return false;
+			}
+		} else if (!wlr_buffer_begin_data_ptr_access(texture->buffer,
+				WLR_BUFFER_DATA_PTR_ACCESS_READ, &data, &drm_format, &stride)) {
+			return false;
+		}
+
+		// If the data pointer has changed, re-create the Pixman image. This can
+		// happen if it's a client buffer and the wl_shm_pool has been resized.
+		if (data != NULL && data != pixman_image_get_data(texture->image)) {
+			pixman_format_code_t format = get_pixman_format_from_drm(drm_format);
+			assert(format != 0);
+
+			pixman_image_unref(texture->image);
+			texture->image = pixman_image_create_bits_no_clear(format,
+				texture->wlr_texture.width, texture->wlr_texture.height,
+				data, stride);
+		}
+	}
+
+	struct wlr_pixman_op op = {
+		.type = WLR_PIXMAN_OP_TEXTURE,
+		.src_box = *fbox,
+		.alpha = alpha,
+		.image = texture->image,
+	};
+	memcpy(op.matrix, matrix, sizeof(op.matrix));
+	pixman_submit(renderer, &op);
+
+	if (texture->buffer != NULL && !deferred) {
+		wlr_buffer_end_data_ptr_access(texture->buffer);
+	}
+
+	return true;
+}
+
+static void pixman_render_quad_with_matrix(struct wlr_renderer *wlr_renderer,
+		const float color[static 4], const float matrix[static 9]) {
+	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
+
+	struct wlr_pixman_op op = {
+		.type = WLR_PIXMAN_OP_QUAD,
+		.color = color_to_pixman(color),
+	};
+	if (op.color.alpha == 0) {
+		return;
+	}
+	memcpy(op.matrix, matrix, sizeof(op.matrix));
+	pixman_submit(renderer, &op);
+}
+
+static bool pixman_render_subtexture_with_matrix_region(
+		struct wlr_renderer *wlr_renderer, struct wlr_texture *wlr_texture,
+		const struct wlr_fbox *fbox, const float matrix[static 9],
+		float alpha, pixman_region32_t *clip) {
+	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
+	pixman_scissor_region(renderer, clip);
+	bool ok = pixman_render_subtexture_with_matrix(wlr_renderer, wlr_texture,
+		fbox, matrix, alpha);
+	pixman_scissor(wlr_renderer, NULL);
+	return ok;
+}
+
+static void pixman_render_quad_with_matrix_region(
+		struct wlr_renderer *wlr_renderer, const float color[static 4],
+		const float matrix[static 9], pixman_region32_t *clip) {
+	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
+	pixman_scissor_region(renderer, clip);
+	pixman_render_quad_with_matrix(wlr_renderer, color, matrix);
+	pixman_scissor(wlr_renderer, NULL);
+}
+
 static const uint32_t *pixman_get_shm_texture_formats(
 		struct wlr_renderer *wlr_renderer, size_t *len) {
 	return get_pixman_drm_formats(len);
@@ -440,6 +924,18 @@ static void pixman_destroy(struct wlr_renderer *wlr_renderer) {
 		wlr_texture_destroy(&tex->wlr_texture);
 	}
 
+	solid_fill_cache_finish(&renderer->solid_fills);
+	if (renderer->worker_pool != NULL) {
+		size_t workers = pixman_worker_pool_get_size(renderer->worker_pool);
+		for (size_t i = 0; i < workers; i++) {
+			solid_fill_cache_finish(&renderer->worker_solid_fills[i]);
+		}
+		pixman_worker_pool_destroy(renderer->worker_pool);
+	}
+	free(renderer->worker_solid_fills);
+	wl_array_release(&renderer->ops);
+	wl_array_release(&renderer->accessed_buffers);
+
 	wlr_drm_format_set_finish(&renderer->drm_formats);
 
 	free(renderer);
@@ -463,6 +959,8 @@ static bool pixman_read_pixels(struct wlr_renderer *wlr_renderer,
 	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
 	struct wlr_pixman_buffer *buffer = renderer->current_buffer;
 
+	pixman_flush(renderer);
+
 	pixman_format_code_t fmt = get_pixman_format_from_drm(drm_format);
 	if (fmt == 0) {
 		wlr_log(WLR_ERROR, "Cannot read pixels: unsupported pixel format");
@@ -473,8 +971,9 @@ static bool pixman_read_pixels(struct wlr_renderer *wlr_renderer,
 		drm_get_pixel_format_info(drm_format);
 	assert(drm_fmt);
 
-	pixman_image_t *dst = pixman_image_create_bits_no_clear(fmt, width, height,
-			data, stride);
+	// The destination image must cover the offset destination rectangle
+	pixman_image_t *dst = pixman_image_create_bits_no_clear(fmt,
+		dst_x + width, dst_y + height, data, stride);
 
 	pixman_image_composite32(PIXMAN_OP_SRC, buffer->image, NULL, dst,
 			src_x, src_y, 0, 0, dst_x, dst_y, width, height);
@@ -495,6 +994,9 @@ static const struct wlr_renderer_impl renderer_impl = {
 	.scissor = pixman_scissor,
 	.render_subtexture_with_matrix = pixman_render_subtexture_with_matrix,
 	.render_quad_with_matrix = pixman_render_quad_with_matrix,
+	.render_subtexture_with_matrix_region =
+		pixman_render_subtexture_with_matrix_region,
+	.render_quad_with_matrix_region = pixman_render_quad_with_matrix_region,
 	.get_shm_texture_formats = pixman_get_shm_texture_formats,
 	.get_render_formats = pixman_get_render_formats,
 	.texture_from_buffer = pixman_texture_from_buffer,
@@ -505,17 +1007,56 @@ static const struct wlr_renderer_impl renderer_impl = {
 	.get_render_buffer_caps = pixman_get_render_buffer_caps,
 };
 
+static size_t get_env_threads(void) {
+	const char *str = getenv("WLR_PIXMAN_THREADS");
+	if (str == NULL) {
+		return 0;
+	}
+
+	char *end;
+	errno = 0;
+	unsigned long threads = strtoul(str, &end, 10);
+	if (errno != 0 || *end != '\0' || end == str) {
+		wlr_log(WLR_ERROR, "Invalid WLR_PIXMAN_THREADS value: '%s'", str);
+		return 0;
+	}
+	return threads;
+}
+
 struct wlr_renderer *wlr_pixman_renderer_create(void) {
+	return wlr_pixman_renderer_create_with_threads(get_env_threads());
+}
+
+struct wlr_renderer *wlr_pixman_renderer_create_with_threads(size_t threads) {
 	struct wlr_pixman_renderer *renderer =
 		calloc(1, sizeof(struct wlr_pixman_renderer));
 	if (renderer == NULL) {
 		return NULL;
 	}
 
-	wlr_log(WLR_INFO, "Creating pixman renderer");
+	if (threads > 0) {
+		renderer->worker_pool = pixman_worker_pool_create(threads);
+		if (renderer->worker_pool == NULL) {
+			free(renderer);
+			return NULL;
+		}
+		size_t workers = pixman_worker_pool_get_size(renderer->worker_pool);
+		renderer->worker_solid_fills =
+			calloc(workers, sizeof(renderer->worker_solid_fills[0]));
+		if (renderer->worker_solid_fills == NULL) {
+			wlr_log_errno(WLR_ERROR, "Allocation failed");
+			pixman_worker_pool_destroy(renderer->worker_pool);
+			free(renderer);
+			return NULL;
+		}
+	}
+
+	wlr_log(WLR_INFO, "Creating pixman renderer (%zu worker threads)", threads);
 	wlr_renderer_init(&renderer->wlr_renderer, &renderer_impl);
 	wl_list_init(&renderer->buffers);
 	wl_list_init(&renderer->textures);
+	wl_array_init(&renderer->ops);
+	wl_array_init(&renderer->accessed_buffers);
 
 	size_t len = 0;
 	const uint32_t *formats = get_pixman_drm_formats(&len);
@@ -537,5 +1078,7 @@ pixman_image_t *wlr_pixman_renderer_get_current_image(
 		struct wlr_renderer *wlr_renderer) {
 	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
 	assert(renderer->current_buffer);
+	// The caller may draw to the image directly
+	pixman_flush(renderer);
 	return renderer->current_buffer->image;
 }
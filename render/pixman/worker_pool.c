@@ -0,0 +1,179 @@
+#define _POSIX_C_SOURCE 200809L
+#include <assert.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <wlr/util/log.h>
+#include "render/pixman.h"
+
+struct wlr_pixman_worker_pool {
+	pthread_t *threads;
+	size_t threads_len;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t work_cond, done_cond;
+	uint64_t generation; // bumped each time a batch is submitted
+	size_t busy; // number of threads which haven't finished the current batch
+	bool stopping;
+
+	// Current batch
+	pixman_worker_job_func_t func;
+	void *data;
+	size_t jobs_len;
+	atomic_size_t next_job;
+};
+
+struct worker_args {
+	struct wlr_pixman_worker_pool *pool;
+	size_t index;
+};
+
+// Jobs are handed out one at a time from a shared counter, so that threads
+// which finish early keep picking up the remaining work
+static void run_jobs(struct wlr_pixman_worker_pool *pool, size_t worker) {
+	while (true) {
+		size_t job = atomic_fetch_add(&pool->next_job, 1);
+		if (job >= pool->jobs_len) {
+			break;
+		}
+		pool->func(job, worker, pool->data);
+	}
+}
+
+static void *worker_run(void *data) {
+	struct worker_args *args = data;
+	struct wlr_pixman_worker_pool *pool = args->pool;
+	size_t index = args->index;
+	free(args);
+
+	uint64_t generation = 0;
+	pthread_mutex_lock(&pool->mutex);
+	while (true) {
+		while (!pool->stopping && pool->generation == generation) {
+			pthread_cond_wait(&pool->work_cond, &pool->mutex);
+		}
+		if (pool->stopping) {
+			break;
+		}
+		generation = pool->generation;
+		pthread_mutex_unlock(&pool->mutex);
+
+		run_jobs(pool, index);
+
+		pthread_mutex_lock(&pool->mutex);
+		pool->busy--;
+		if (pool->busy == 0) {
+			pthread_cond_signal(&pool->done_cond);
+		}
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	return NULL;
+}
+
+struct wlr_pixman_worker_pool *pixman_worker_pool_create(size_t threads) {
+	struct wlr_pixman_worker_pool *pool = calloc(1, sizeof(*pool));
+	if (pool == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+
+	pool->threads = calloc(threads, sizeof(pool->threads[0]));
+	if (pool->threads == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		free(pool);
+		return NULL;
+	}
+
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->work_cond, NULL);
+	pthread_cond_init(&pool->done_cond, NULL);
+	atomic_init(&pool->next_job, 0);
+
+	// Block all signals in the workers, so that they are delivered to the
+	// compositor's threads only
+	sigset_t all_signals, old_signals;
+	sigfillset(&all_signals);
+	pthread_sigmask(SIG_SETMASK, &all_signals, &old_signals);
+
+	for (size_t i = 0; i < threads; i++) {
+		struct worker_args *args = calloc(1, sizeof(*args));
+		if (args == NULL) {
+			wlr_log_errno(WLR_ERROR, "Allocation failed");
+			pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+			goto error;
+		}
+		args->pool = pool;
+		args->index = i;
+
+		int ret = pthread_create(&pool->threads[i], NULL, worker_run, args);
+		if (ret != 0) {
+			wlr_log(WLR_ERROR, "Failed to create worker thread: %d", ret);
+			free(args);
+			pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+			goto error;
+		}
+		pool->threads_len++;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+
+	return pool;
+
+error:
+	pixman_worker_pool_destroy(pool);
+	return NULL;
+}
+
+void pixman_worker_pool_destroy(struct wlr_pixman_worker_pool *pool) {
+	if (pool == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->stopping = true;
+	pthread_cond_broadcast(&pool->work_cond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (size_t i = 0; i < pool->threads_len; i++) {
+		pthread_join(pool->threads[i], NULL);
+	}
+
+	pthread_cond_destroy(&pool->done_cond);
+	pthread_cond_destroy(&pool->work_cond);
+	pthread_mutex_destroy(&pool->mutex);
+	free(pool->threads);
+	free(pool);
+}
+
+size_t pixman_worker_pool_get_size(struct wlr_pixman_worker_pool *pool) {
+	// The calling thread takes part in running jobs too
+	return pool->threads_len + 1;
+}
+
+void pixman_worker_pool_run(struct wlr_pixman_worker_pool *pool,
+		size_t jobs_len, pixman_worker_job_func_t func, void *data) {
+	if (jobs_len == 0) {
+		return;
+	}
+
+	pthread_mutex_lock(&pool->mutex);
+	assert(pool->busy == 0);
+	pool->func = func;
+	pool->data = data;
+	pool->jobs_len = jobs_len;
+	atomic_store(&pool->next_job, 0);
+	pool->busy = pool->threads_len;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->work_cond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	run_jobs(pool, pool->threads_len);
+
+	pthread_mutex_lock(&pool->mutex);
+	while (pool->busy > 0) {
+		pthread_cond_wait(&pool->done_cond, &pool->mutex);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+}
@@ -740,9 +740,37 @@ static void vulkan_end(struct wlr_renderer *wlr_renderer) {
 	}
 }
 
-static bool vulkan_render_subtexture_with_matrix(struct wlr_renderer *wlr_renderer,
+static void vulkan_scissor(struct wlr_renderer *wlr_renderer,
+	struct wlr_box *box);
+
+// Records the draw once per rectangle of the clip region, or once with the
+// current scissor if there is no clip region
+static void draw_clipped(struct wlr_vk_renderer *renderer,
+		pixman_region32_t *clip) {
+	VkCommandBuffer cb = renderer->cb;
+	if (clip == NULL) {
+		vkCmdDraw(cb, 4, 1, 0, 0);
+		return;
+	}
+
+	int nrects;
+	pixman_box32_t *rects = pixman_region32_rectangles(clip, &nrects);
+	for (int i = 0; i < nrects; ++i) {
+		struct wlr_box box = {
+			.x = rects[i].x1,
+			.y = rects[i].y1,
+			.width = rects[i].x2 - rects[i].x1,
+			.height = rects[i].y2 - rects[i].y1,
+		};
+		vulkan_scissor(&renderer->wlr_renderer, &box);
+		vkCmdDraw(cb, 4, 1, 0, 0);
+	}
+	vulkan_scissor(&renderer->wlr_renderer, NULL);
+}
+
+static bool render_subtexture(struct wlr_renderer *wlr_renderer,
 		struct wlr_texture *wlr_texture, const struct wlr_fbox *box,
-		const float matrix[static 9], float alpha) {
+		const float matrix[static 9], float alpha, pixman_region32_t *clip) {
 	struct wlr_vk_renderer *renderer = vulkan_get_renderer(wlr_renderer);
 	VkCommandBuffer cb = renderer->cb;
 
@@ -786,12 +814,27 @@ static bool vulkan_render_subtexture_with_matrix(struct wlr_renderer *wlr_render
 	vkCmdPushConstants(cb, renderer->pipe_layout,
 		VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(vert_pcr_data), sizeof(float),
 		&alpha);
-	vkCmdDraw(cb, 4, 1, 0, 0);
+	draw_clipped(renderer, clip);
 	texture->last_used = renderer->frame;
 
 	return true;
 }
 
+static bool vulkan_render_subtexture_with_matrix(struct wlr_renderer *wlr_renderer,
+		struct wlr_texture *wlr_texture, const struct wlr_fbox *box,
+		const float matrix[static 9], float alpha) {
+	return render_subtexture(wlr_renderer, wlr_texture, box, matrix, alpha,
+		NULL);
+}
+
+static bool vulkan_render_subtexture_with_matrix_region(
+		struct wlr_renderer *wlr_renderer, struct wlr_texture *wlr_texture,
+		const struct wlr_fbox *box, const float matrix[static 9], float alpha,
+		pixman_region32_t *clip) {
+	return render_subtexture(wlr_renderer, wlr_texture, box, matrix, alpha,
+		clip);
+}
+
 static void vulkan_clear(struct wlr_renderer *wlr_renderer,
 		const float color[static 4]) {
 	struct wlr_vk_renderer *renderer = vulkan_get_renderer(wlr_renderer);
@@ -842,8 +885,9 @@ static const uint32_t *vulkan_get_shm_texture_formats(
 	return renderer->dev->shm_formats;
 }
 
-static void vulkan_render_quad_with_matrix(struct wlr_renderer *wlr_renderer,
-		const float color[static 4], const float matrix[static 9]) {
+static void render_quad(struct wlr_renderer *wlr_renderer,
+		const float color[static 4], const float matrix[static 9],
+		pixman_region32_t *clip) {
 	struct wlr_vk_renderer *renderer = vulkan_get_renderer(wlr_renderer);
 	VkCommandBuffer cb = renderer->cb;
 
@@ -881,7 +925,18 @@ static void vulkan_render_quad_with_matrix(struct wlr_renderer *wlr_renderer,
 	vkCmdPushConstants(cb, renderer->pipe_layout,
 		VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(vert_pcr_data), sizeof(float) * 4,
 		linear_color);
-	vkCmdDraw(cb, 4, 1, 0, 0);
+	draw_clipped(renderer, clip);
+}
+
+static void vulkan_render_quad_with_matrix(struct wlr_renderer *wlr_renderer,
+		const float color[static 4], const float matrix[static 9]) {
+	render_quad(wlr_renderer, color, matrix, NULL);
+}
+
+static void vulkan_render_quad_with_matrix_region(
+		struct wlr_renderer *wlr_renderer, const float color[static 4],
+		const float matrix[static 9], pixman_region32_t *clip) {
+	render_quad(wlr_renderer, color, matrix, clip);
 }
 
 static const struct wlr_drm_format_set *vulkan_get_dmabuf_texture_formats(
@@ -984,6 +1039,9 @@ static const struct wlr_renderer_impl renderer_impl = {
 	.scissor = vulkan_scissor,
 	.render_subtexture_with_matrix = vulkan_render_subtexture_with_matrix,
 	.render_quad_with_matrix = vulkan_render_quad_with_matrix,
+	.render_subtexture_with_matrix_region =
+		vulkan_render_subtexture_with_matrix_region,
+	.render_quad_with_matrix_region = vulkan_render_quad_with_matrix_region,
 	.get_shm_texture_formats = vulkan_get_shm_texture_formats,
 	.get_dmabuf_texture_formats = vulkan_get_dmabuf_texture_formats,
 	.get_render_formats = vulkan_get_render_formats,
@@ -46,6 +46,8 @@ void wlr_renderer_init(struct wlr_renderer *renderer,
 	renderer->impl = impl;
 
 	wl_signal_init(&renderer->events.destroy);
+	wl_signal_init(&renderer->events.begin);
+	wl_signal_init(&renderer->events.end);
 }
 
 void wlr_renderer_destroy(struct wlr_renderer *r) {
@@ -87,6 +89,8 @@ void wlr_renderer_begin(struct wlr_renderer *r, uint32_t width, uint32_t height)
 	r->impl->begin(r, width, height);
 
 	r->rendering = true;
+
+	wlr_signal_emit_safe(&r->events.begin, r);
 }
 
 bool wlr_renderer_begin_with_buffer(struct wlr_renderer *r,
@@ -108,6 +112,8 @@ void wlr_renderer_end(struct wlr_renderer *r) {
 
 	r->rendering = false;
 
+	wlr_signal_emit_safe(&r->events.end, r);
+
 	if (r->rendering_with_buffer) {
 		renderer_bind_buffer(r, NULL);
 		r->rendering_with_buffer = false;
@@ -179,6 +185,55 @@ void wlr_render_quad_with_matrix(struct wlr_renderer *r,
 	r->impl->render_quad_with_matrix(r, color, matrix);
 }
 
+static void scissor_rect(struct wlr_renderer *r, const pixman_box32_t *rect) {
+	struct wlr_box box = {
+		.x = rect->x1,
+		.y = rect->y1,
+		.width = rect->x2 - rect->x1,
+		.height = rect->y2 - rect->y1,
+	};
+	r->impl->scissor(r, &box);
+}
+
+bool wlr_render_subtexture_with_matrix_region(struct wlr_renderer *r,
+		struct wlr_texture *texture, const struct wlr_fbox *box,
+		const float matrix[static 9], float alpha, pixman_region32_t *clip) {
+	assert(r->rendering);
+	if (r->impl->render_subtexture_with_matrix_region) {
+		return r->impl->render_subtexture_with_matrix_region(r, texture,
+			box, matrix, alpha, clip);
+	}
+
+	bool ok = true;
+	int nrects;
+	pixman_box32_t *rects = pixman_region32_rectangles(clip, &nrects);
+	for (int i = 0; i < nrects && ok; ++i) {
+		scissor_rect(r, &rects[i]);
+		ok = r->impl->render_subtexture_with_matrix(r, texture,
+			box, matrix, alpha);
+	}
+	r->impl->scissor(r, NULL);
+	return ok;
+}
+
+void wlr_render_quad_with_matrix_region(struct wlr_renderer *r,
+		const float color[static 4], const float matrix[static 9],
+		pixman_region32_t *clip) {
+	assert(r->rendering);
+	if (r->impl->render_quad_with_matrix_region) {
+		r->impl->render_quad_with_matrix_region(r, color, matrix, clip);
+		return;
+	}
+
+	int nrects;
+	pixman_box32_t *rects = pixman_region32_rectangles(clip, &nrects);
+	for (int i = 0; i < nrects; ++i) {
+		scissor_rect(r, &rects[i]);
+		r->impl->render_quad_with_matrix(r, color, matrix);
+	}
+	r->impl->scissor(r, NULL);
+}
+
 const uint32_t *wlr_renderer_get_shm_texture_formats(struct wlr_renderer *r,
 		size_t *len) {
 	return r->impl->get_shm_texture_formats(r, len);
@@ -1,17 +1,43 @@
 #include <assert.h>
 #include <drm_fourcc.h>
 #include <stdlib.h>
+#include <string.h>
 #include <wlr/interfaces/wlr_output.h>
 #include <wlr/render/wlr_renderer.h>
 #include <wlr/types/wlr_compositor.h>
 #include <wlr/types/wlr_matrix.h>
 #include <wlr/util/log.h>
 #include "render/allocator/allocator.h"
+#include "render/pixel_format.h"
 #include "render/swapchain.h"
 #include "types/wlr_buffer.h"
 #include "types/wlr_output.h"
 #include "util/signal.h"
 
+// Maximum number of rendered cursor buffers kept per output, and of recent
+// cache misses remembered to decide which images to cache
+#define CURSOR_BUFFER_CACHE_SIZE 16
+
+/**
+ * A cursor image rendered into a buffer suitable for the output's hardware
+ * cursor plane.
+ *
+ * Recent cache misses are tracked with entries without data nor buffer.
+ */
+struct output_cursor_buffer {
+	struct wl_list link; // wlr_output.cursor_buffers or cursor_buffer_misses
+
+	// Copy of the source image
+	uint32_t format;
+	uint32_t width, height;
+	size_t stride;
+	void *data;
+	uint64_t hash;
+
+	enum wl_output_transform transform; // output transform
+	struct wlr_buffer *buffer;
+};
+
 static bool output_set_hardware_cursor(struct wlr_output *output,
 		struct wlr_buffer *buffer, int hotspot_x, int hotspot_y) {
 	if (!output->impl->set_cursor) {
@@ -229,7 +255,224 @@ static struct wlr_drm_format *output_pick_cursor_format(struct wlr_output *outpu
 	return output_pick_format(output, display_formats, DRM_FORMAT_ARGB8888);
 }
 
-static struct wlr_buffer *render_cursor_buffer(struct wlr_output_cursor *cursor) {
+static void cursor_buffer_destroy(struct output_cursor_buffer *cursor_buffer) {
+	wl_list_remove(&cursor_buffer->link);
+	wlr_buffer_unlock(cursor_buffer->buffer);
+	free(cursor_buffer->data);
+	free(cursor_buffer);
+}
+
+void output_clear_cursor_buffers(struct wlr_output *output) {
+	struct output_cursor_buffer *cursor_buffer, *tmp;
+	wl_list_for_each_safe(cursor_buffer, tmp, &output->cursor_buffers, link) {
+		cursor_buffer_destroy(cursor_buffer);
+	}
+	wl_list_for_each_safe(cursor_buffer, tmp, &output->cursor_buffer_misses,
+			link) {
+		cursor_buffer_destroy(cursor_buffer);
+	}
+}
+
+/**
+ * Contents of a cursor image, used to find it in the cache.
+ */
+struct cursor_image {
+	uint32_t format;
+	uint32_t width, height;
+	size_t row_size, stride;
+	const void *data;
+	uint64_t hash;
+};
+
+static bool cursor_image_begin(struct cursor_image *image,
+		struct wlr_buffer *buffer) {
+	void *data;
+	uint32_t format;
+	size_t stride;
+	if (!wlr_buffer_begin_data_ptr_access(buffer,
+			WLR_BUFFER_DATA_PTR_ACCESS_READ, &data, &format, &stride)) {
+		return false;
+	}
+
+	const struct wlr_pixel_format_info *info =
+		drm_get_pixel_format_info(format);
+	if (info == NULL) {
+		wlr_buffer_end_data_ptr_access(buffer);
+		return false;
+	}
+
+	*image = (struct cursor_image){
+		.format = format,
+		.width = buffer->width,
+		.height = buffer->height,
+		.row_size = buffer->width * info->bpp / 8,
+		.stride = stride,
+		.data = data,
+	};
+
+	// FNV-1a
+	uint64_t hash = 0xcbf29ce484222325;
+	for (uint32_t y = 0; y < image->height; y++) {
+		const uint8_t *row = (const uint8_t *)data + y * stride;
+		for (size_t x = 0; x < image->row_size; x++) {
+			hash = (hash ^ row[x]) * 0x100000001b3;
+		}
+	}
+	image->hash = hash;
+
+	return true;
+}
+
+static bool cursor_buffer_matches(struct output_cursor_buffer *cursor_buffer,
+		const struct cursor_image *image, enum wl_output_transform transform) {
+	if (cursor_buffer->hash != image->hash ||
+			cursor_buffer->format != image->format ||
+			cursor_buffer->width != image->width ||
+			cursor_buffer->height != image->height ||
+			cursor_buffer->transform != transform) {
+		return false;
+	}
+	for (uint32_t y = 0; y < image->height; y++) {
+		const uint8_t *a =
+			(const uint8_t *)cursor_buffer->data + y * cursor_buffer->stride;
+		const uint8_t *b = (const uint8_t *)image->data + y * image->stride;
+		if (memcmp(a, b, image->row_size) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static struct output_cursor_buffer *cursor_buffer_create(
+		struct wlr_output *output, const struct cursor_image *image,
+		struct wlr_buffer *buffer) {
+	struct output_cursor_buffer *cursor_buffer =
+		calloc(1, sizeof(*cursor_buffer));
+	if (cursor_buffer == NULL) {
+		return NULL;
+	}
+
+	cursor_buffer->data = malloc(image->row_size * image->height);
+	if (cursor_buffer->data == NULL) {
+		free(cursor_buffer);
+		return NULL;
+	}
+	for (uint32_t y = 0; y < image->height; y++) {
+		memcpy((uint8_t *)cursor_buffer->data + y * image->row_size,
+			(const uint8_t *)image->data + y * image->stride, image->row_size);
+	}
+
+	cursor_buffer->format = image->format;
+	cursor_buffer->width = image->width;
+	cursor_buffer->height = image->height;
+	cursor_buffer->stride = image->row_size;
+	cursor_buffer->hash = image->hash;
+	cursor_buffer->transform = output->transform;
+	cursor_buffer->buffer = wlr_buffer_lock(buffer);
+
+	wl_list_insert(&output->cursor_buffers, &cursor_buffer->link);
+
+	// Evict the least recently used buffers
+	size_t len = 0;
+	struct output_cursor_buffer *iter, *tmp;
+	wl_list_for_each_safe(iter, tmp, &output->cursor_buffers, link) {
+		if (++len > CURSOR_BUFFER_CACHE_SIZE) {
+			cursor_buffer_destroy(iter);
+		}
+	}
+
+	return cursor_buffer;
+}
+
+/**
+ * Record a cache miss. Returns true if the same image missed the cache within
+ * the last CURSOR_BUFFER_CACHE_SIZE misses, i.e. if it is set again often
+ * enough for caching it to pay off. Animations with more frames than the
+ * cache can hold never get there, and don't evict other cursors.
+ */
+static bool cursor_buffer_record_miss(struct wlr_output *output,
+		const struct cursor_image *image) {
+	size_t len = 0;
+	struct output_cursor_buffer *miss, *last = NULL;
+	wl_list_for_each(miss, &output->cursor_buffer_misses, link) {
+		if (miss->hash == image->hash && miss->format == image->format &&
+				miss->width == image->width &&
+				miss->height == image->height &&
+				miss->transform == output->transform) {
+			cursor_buffer_destroy(miss);
+			return true;
+		}
+		last = miss;
+		len++;
+	}
+
+	if (len >= CURSOR_BUFFER_CACHE_SIZE) {
+		// Reuse the oldest entry
+		miss = last;
+		wl_list_remove(&miss->link);
+	} else {
+		miss = calloc(1, sizeof(*miss));
+		if (miss == NULL) {
+			return false;
+		}
+	}
+
+	miss->format = image->format;
+	miss->width = image->width;
+	miss->height = image->height;
+	miss->hash = image->hash;
+	miss->transform = output->transform;
+	wl_list_insert(&output->cursor_buffer_misses, &miss->link);
+	return false;
+}
+
+static bool render_cursor_texture(struct wlr_output *output,
+		struct wlr_texture *texture, float scale,
+		enum wl_output_transform transform, struct wlr_buffer *buffer) {
+	struct wlr_renderer *renderer = output->renderer;
+
+	struct wlr_box cursor_box = {
+		.width = texture->width * output->scale / scale,
+		.height = texture->height * output->scale / scale,
+	};
+
+	float output_matrix[9];
+	wlr_matrix_identity(output_matrix);
+	if (output->transform != WL_OUTPUT_TRANSFORM_NORMAL) {
+		struct wlr_box tr_size = {
+			.width = buffer->width,
+			.height = buffer->height,
+		};
+		wlr_box_transform(&tr_size, &tr_size, output->transform, 0, 0);
+
+		wlr_matrix_translate(output_matrix, buffer->width / 2.0,
+			buffer->height / 2.0);
+		wlr_matrix_transform(output_matrix, output->transform);
+		wlr_matrix_translate(output_matrix, - tr_size.width / 2.0,
+			- tr_size.height / 2.0);
+	}
+
+	float matrix[9];
+	wlr_matrix_project_box(matrix, &cursor_box, transform, 0, output_matrix);
+
+	if (!wlr_renderer_begin_with_buffer(renderer, buffer)) {
+		return false;
+	}
+
+	wlr_renderer_clear(renderer, (float[]){ 0.0, 0.0, 0.0, 0.0 });
+	wlr_render_texture_with_matrix(renderer, texture, matrix, 1.0);
+
+	wlr_renderer_end(renderer);
+	return true;
+}
+
+/**
+ * Render the cursor into a buffer for the hardware cursor plane. If the
+ * cursor has been set from a buffer with CPU-accessible contents, the result
+ * is cached and rendering is skipped the next time the same image is set.
+ */
+static struct wlr_buffer *render_cursor_buffer(struct wlr_output_cursor *cursor,
+		struct wlr_buffer *source) {
 	struct wlr_output *output = cursor->output;
 
 	float scale = output->scale;
@@ -245,8 +488,7 @@ static struct wlr_buffer *render_cursor_buffer(struct wlr_output_cursor *cursor)
 	}
 
 	struct wlr_allocator *allocator = output->allocator;
-	struct wlr_renderer *renderer = output->renderer;
-	assert(allocator != NULL && renderer != NULL);
+	assert(allocator != NULL && output->renderer != NULL);
 
 	int width = texture->width;
 	int height = texture->height;
@@ -261,6 +503,59 @@ static struct wlr_buffer *render_cursor_buffer(struct wlr_output_cursor *cursor)
 		}
 	}
 
+	struct cursor_image image;
+	bool cacheable = source != NULL && cursor_image_begin(&image, source);
+	if (cacheable) {
+		struct output_cursor_buffer *cursor_buffer;
+		wl_list_for_each(cursor_buffer, &output->cursor_buffers, link) {
+			if (cursor_buffer->buffer->width == width &&
+					cursor_buffer->buffer->height == height &&
+					cursor_buffer_matches(cursor_buffer, &image,
+						output->transform)) {
+				wlr_buffer_end_data_ptr_access(source);
+				wl_list_remove(&cursor_buffer->link);
+				wl_list_insert(&output->cursor_buffers, &cursor_buffer->link);
+				return wlr_buffer_lock(cursor_buffer->buffer);
+			}
+		}
+
+		if (!cursor_buffer_record_miss(output, &image)) {
+			// Render into the swapchain until the image shows up again
+			wlr_buffer_end_data_ptr_access(source);
+			cacheable = false;
+		}
+	}
+	if (cacheable) {
+		// Cached buffers are kept out of the swapchain, which only has a
+		// few slots
+		struct wlr_drm_format *format = output_pick_cursor_format(output);
+		if (format == NULL) {
+			wlr_buffer_end_data_ptr_access(source);
+			wlr_log(WLR_ERROR, "Failed to pick cursor format");
+			return NULL;
+		}
+		struct wlr_buffer *buffer =
+			wlr_allocator_create_buffer(allocator, width, height, format,
+			NULL);
+		free(format);
+		if (buffer == NULL) {
+			wlr_buffer_end_data_ptr_access(source);
+			return NULL;
+		}
+
+		if (!render_cursor_texture(output, texture, scale, transform, buffer)) {
+			wlr_buffer_end_data_ptr_access(source);
+			wlr_buffer_drop(buffer);
+			return NULL;
+		}
+
+		if (cursor_buffer_create(output, &image, buffer) == NULL) {
+			wlr_log(WLR_ERROR, "Failed to cache cursor buffer");
+		}
+		wlr_buffer_end_data_ptr_access(source);
+		return buffer;
+	}
+
 	if (output->cursor_swapchain == NULL ||
 			output->cursor_swapchain->width != width ||
 			output->cursor_swapchain->height != height) {
@@ -287,44 +582,20 @@ static struct wlr_buffer *render_cursor_buffer(struct wlr_output_cursor *cursor)
 		return NULL;
 	}
 
-	struct wlr_box cursor_box = {
-		.width = texture->width * output->scale / scale,
-		.height = texture->height * output->scale / scale,
-	};
-
-	float output_matrix[9];
-	wlr_matrix_identity(output_matrix);
-	if (output->transform != WL_OUTPUT_TRANSFORM_NORMAL) {
-		struct wlr_box tr_size = {
-			.width = buffer->width,
-			.height = buffer->height,
-		};
-		wlr_box_transform(&tr_size, &tr_size, output->transform, 0, 0);
-
-		wlr_matrix_translate(output_matrix, buffer->width / 2.0,
-			buffer->height / 2.0);
-		wlr_matrix_transform(output_matrix, output->transform);
-		wlr_matrix_translate(output_matrix, - tr_size.width / 2.0,
-			- tr_size.height / 2.0);
-	}
-
-	float matrix[9];
-	wlr_matrix_project_box(matrix, &cursor_box, transform, 0, output_matrix);
-
-	if (!wlr_renderer_begin_with_buffer(renderer, buffer)) {
+	if (!render_cursor_texture(output, texture, scale, transform, buffer)) {
 		wlr_buffer_unlock(buffer);
 		return NULL;
 	}
 
-	wlr_renderer_clear(renderer, (float[]){ 0.0, 0.0, 0.0, 0.0 });
-	wlr_render_texture_with_matrix(renderer, texture, matrix, 1.0);
-
-	wlr_renderer_end(renderer);
-
 	return buffer;
 }
 
-static bool output_cursor_attempt_hardware(struct wlr_output_cursor *cursor) {
+/**
+ * Try to use the hardware cursor plane. `source` is the buffer the cursor has
+ * been set from, if any.
+ */
+static bool output_cursor_attempt_hardware(struct wlr_output_cursor *cursor,
+		struct wlr_buffer *source) {
 	struct wlr_output *output = cursor->output;
 
 	if (!output->impl->set_cursor ||
@@ -350,7 +621,7 @@ static bool output_cursor_attempt_hardware(struct wlr_output_cursor *cursor) {
 
 	struct wlr_buffer *buffer = NULL;
 	if (texture != NULL) {
-		buffer = render_cursor_buffer(cursor);
+		buffer = render_cursor_buffer(cursor, source);
 		if (buffer == NULL) {
 			wlr_log(WLR_ERROR, "Failed to render cursor buffer");
 			return false;
@@ -426,7 +697,7 @@ bool wlr_output_cursor_set_buffer(struct wlr_output_cursor *cursor,
 		cursor->enabled = true;
 	}
 
-	if (output_cursor_attempt_hardware(cursor)) {
+	if (output_cursor_attempt_hardware(cursor, buffer)) {
 		return true;
 	}
 
@@ -455,7 +726,7 @@ static void output_cursor_commit(struct wlr_output_cursor *cursor,
 		cursor->hotspot_y -= surface->current.dy * cursor->output->scale;
 	}
 
-	if (output_cursor_attempt_hardware(cursor)) {
+	if (output_cursor_attempt_hardware(cursor, NULL)) {
 		return;
 	}
 
@@ -0,0 +1,207 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <time.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/util/log.h>
+#include "types/wlr_output.h"
+#include "util/time.h"
+
+#define NSEC_PER_MSEC 1000000
+// Bounds of the safety margin, grown on missed deadlines
+#define MIN_MARGIN_NSEC (1 * NSEC_PER_MSEC)
+#define MAX_MARGIN_PERIOD_FRACTION 2 // at most half a refresh period
+
+static int64_t scheduler_now(struct wlr_output *output) {
+	struct wlr_output_frame_scheduler *scheduler = &output->frame_scheduler;
+	struct timespec now;
+	if (scheduler->clock != NULL) {
+		scheduler->clock(&now, scheduler->clock_data);
+	} else {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+	}
+	return timespec_to_nsec(&now);
+}
+
+static int64_t refresh_period(struct wlr_output *output) {
+	return 1000000000000LL / output->refresh;
+}
+
+static void scheduler_cancel(struct wlr_output_frame_scheduler *scheduler) {
+	if (scheduler->armed) {
+		wl_event_source_timer_update(scheduler->timer, 0);
+		scheduler->armed = false;
+		scheduler->frame_due = 0;
+	}
+}
+
+static void scheduler_emit_frame(struct wlr_output *output) {
+	struct wlr_output_frame_scheduler *scheduler = &output->frame_scheduler;
+	scheduler->armed = false;
+	scheduler->frame_due = 0;
+	output_emit_frame(output);
+}
+
+static int handle_timer(void *data) {
+	struct wlr_output *output = data;
+	scheduler_emit_frame(output);
+	return 0;
+}
+
+void wlr_output_set_frame_scheduler_enabled(struct wlr_output *output,
+		bool enabled) {
+	struct wlr_output_frame_scheduler *scheduler = &output->frame_scheduler;
+	if (scheduler->enabled == enabled) {
+		return;
+	}
+
+	if (enabled) {
+		struct wl_event_loop *ev = wl_display_get_event_loop(output->display);
+		scheduler->timer = wl_event_loop_add_timer(ev, handle_timer, output);
+		if (scheduler->timer == NULL) {
+			wlr_log(WLR_ERROR, "Failed to create frame scheduler timer");
+			return;
+		}
+		scheduler->render_time = 0;
+		scheduler->render_time_dev = 0;
+		scheduler->margin = MIN_MARGIN_NSEC;
+		scheduler->frame_time = 0;
+		scheduler->deadline = 0;
+		scheduler->frame_due = 0;
+		scheduler->enabled = true;
+	} else {
+		// Don't hold back a frame which is already delayed
+		bool armed = scheduler->armed;
+		output_frame_scheduler_finish(output);
+		if (armed) {
+			output_emit_frame(output);
+		}
+	}
+}
+
+void wlr_output_set_frame_scheduler_clock(struct wlr_output *output,
+		wlr_output_clock_func_t clock, void *data) {
+	struct wlr_output_frame_scheduler *scheduler = &output->frame_scheduler;
+	if (scheduler->clock == clock && scheduler->clock_data == data) {
+		return;
+	}
+
+	// The delay of a pending frame was computed with the previous clock
+	bool armed = scheduler->armed;
+	scheduler_cancel(scheduler);
+
+	scheduler->clock = clock;
+	scheduler->clock_data = data;
+
+	if (armed) {
+		output_emit_frame(output);
+	}
+}
+
+void wlr_output_dispatch_frame_scheduler(struct wlr_output *output) {
+	struct wlr_output_frame_scheduler *scheduler = &output->frame_scheduler;
+	if (!scheduler->armed || scheduler->clock == NULL) {
+		return;
+	}
+	if (scheduler_now(output) >= scheduler->frame_due) {
+		scheduler_emit_frame(output);
+	}
+}
+
+void output_frame_scheduler_finish(struct wlr_output *output) {
+	struct wlr_output_frame_scheduler *scheduler = &output->frame_scheduler;
+	if (scheduler->timer != NULL) {
+		wl_event_source_remove(scheduler->timer);
+	}
+	scheduler->timer = NULL;
+	scheduler->armed = false;
+	scheduler->frame_due = 0;
+	scheduler->enabled = false;
+}
+
+bool output_frame_scheduler_delay_frame(struct wlr_output *output) {
+	struct wlr_output_frame_scheduler *scheduler = &output->frame_scheduler;
+	scheduler->deadline = 0;
+	if (!scheduler->enabled || output->refresh <= 0) {
+		return false;
+	}
+
+	// The backend signals a frame right after a vblank: the next deadline
+	// is one refresh period away
+	int64_t now = scheduler_now(output);
+	int64_t period = refresh_period(output);
+	scheduler->deadline = now + period;
+
+	if (scheduler->render_time == 0) {
+		// No estimate yet
+		return false;
+	}
+
+	int64_t budget = scheduler->render_time + 2 * scheduler->render_time_dev +
+		scheduler->margin;
+	int64_t delay_ms = (period - budget) / NSEC_PER_MSEC;
+	if (delay_ms <= 0) {
+		return false;
+	}
+
+	// With a custom clock, the frame is sent by
+	// wlr_output_dispatch_frame_scheduler() instead of the event loop
+	scheduler->frame_due = now + delay_ms * NSEC_PER_MSEC;
+	if (scheduler->clock == NULL) {
+		wl_event_source_timer_update(scheduler->timer, delay_ms);
+	}
+	scheduler->armed = true;
+	return true;
+}
+
+void output_frame_scheduler_handle_frame(struct wlr_output *output) {
+	struct wlr_output_frame_scheduler *scheduler = &output->frame_scheduler;
+	if (scheduler->enabled) {
+		scheduler->frame_time = scheduler_now(output);
+	}
+}
+
+void output_frame_scheduler_handle_commit(struct wlr_output *output) {
+	struct wlr_output_frame_scheduler *scheduler = &output->frame_scheduler;
+	// A new frame has been submitted, the next one will be signalled by the
+	// backend
+	scheduler_cancel(scheduler);
+
+	if (!scheduler->enabled || scheduler->frame_time == 0) {
+		return;
+	}
+
+	int64_t now = scheduler_now(output);
+	int64_t duration = now - scheduler->frame_time;
+	scheduler->frame_time = 0;
+
+	// Smoothed estimate and mean deviation, as used for TCP round-trip times
+	if (scheduler->render_time == 0) {
+		scheduler->render_time = duration;
+		scheduler->render_time_dev = duration / 2;
+	} else {
+		int64_t err = duration - scheduler->render_time;
+		scheduler->render_time += err / 8;
+		scheduler->render_time_dev +=
+			((err < 0 ? -err : err) - scheduler->render_time_dev) / 4;
+	}
+
+	if (scheduler->deadline == 0 || output->refresh <= 0) {
+		return;
+	}
+
+	if (now > scheduler->deadline) {
+		// Missed the deadline, back off quickly
+		int64_t max_margin = refresh_period(output) / MAX_MARGIN_PERIOD_FRACTION;
+		scheduler->margin *= 2;
+		if (scheduler->margin > max_margin) {
+			scheduler->margin = max_margin;
+		}
+	} else {
+		scheduler->margin -= scheduler->margin / 16;
+		if (scheduler->margin < MIN_MARGIN_NSEC) {
+			scheduler->margin = MIN_MARGIN_NSEC;
+		}
+	}
+	scheduler->deadline = 0;
+}
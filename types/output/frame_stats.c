@@ -0,0 +1,388 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/util/log.h>
+#include "types/wlr_output.h"
+#include "util/time.h"
+
+#define DEFAULT_ENV_CAPACITY 600
+// Vblanks less than refresh / MISSED_VBLANK_SLACK_DIVISOR after a commit
+// aren't counted as missed
+#define MISSED_VBLANK_SLACK_DIVISOR 8
+
+struct wlr_output_frame_stats {
+	struct wlr_output *output;
+
+	struct wlr_output_frame_timing *timings; // ring buffer
+	size_t capacity, len, head;
+
+	// Frame currently being rendered, not yet in the ring buffer
+	struct wlr_output_frame_timing current;
+	bool has_current;
+
+	// Dump percentiles every capacity frames, set by WLR_FRAME_STATS
+	bool dump;
+	size_t frames_since_dump;
+
+	struct wlr_renderer *renderer;
+	struct wl_listener renderer_begin;
+	struct wl_listener renderer_end;
+	struct wl_listener renderer_destroy;
+};
+
+static void get_now(struct timespec *now) {
+	clock_gettime(CLOCK_MONOTONIC, now);
+}
+
+static bool timespec_is_set(const struct timespec *t) {
+	return t->tv_sec != 0 || t->tv_nsec != 0;
+}
+
+static int64_t timespec_diff_nsec(const struct timespec *a,
+		const struct timespec *b) {
+	return timespec_to_nsec(a) - timespec_to_nsec(b);
+}
+
+static int compare_int64(const void *a, const void *b) {
+	int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+	return (x > y) - (x < y);
+}
+
+static void log_percentiles(struct wlr_output *output, const char *name,
+		int64_t *values, size_t len) {
+	if (len == 0) {
+		return;
+	}
+	qsort(values, len, sizeof(values[0]), compare_int64);
+	wlr_log(WLR_INFO, "Frame stats for %s: %-14s "
+		"p50 %6.2f ms, p90 %6.2f ms, p99 %6.2f ms, max %6.2f ms",
+		output->name, name,
+		values[len * 50 / 100] / 1e6, values[len * 90 / 100] / 1e6,
+		values[len * 99 / 100] / 1e6, values[len - 1] / 1e6);
+}
+
+static const struct wlr_output_frame_timing *get_timing(
+		struct wlr_output_frame_stats *stats, size_t i) {
+	// i = 0 is the oldest record
+	size_t idx = (stats->head + stats->capacity - stats->len + i) %
+		stats->capacity;
+	return &stats->timings[idx];
+}
+
+// Number of vblanks which passed while the frame was committed but not
+// presented yet. Idle periods between frames aren't counted.
+static size_t timing_missed_vblanks(
+		const struct wlr_output_frame_timing *timing) {
+	// The commit time isn't set yet if the frame was presented from within
+	// the commit
+	if (timing->refresh <= 0 || !timespec_is_set(&timing->present) ||
+			!timespec_is_set(&timing->commit)) {
+		return 0;
+	}
+
+	// The frame is expected on the first vblank after the commit. A vblank
+	// right after the commit can't be told apart from presentation timestamp
+	// jitter, leave some slack.
+	int64_t delay = timespec_diff_nsec(&timing->present, &timing->commit);
+	delay -= timing->refresh / MISSED_VBLANK_SLACK_DIVISOR;
+	if (delay <= 0) {
+		return 0;
+	}
+	return delay / timing->refresh;
+}
+
+static void stats_dump(struct wlr_output_frame_stats *stats) {
+	struct wlr_output *output = stats->output;
+	if (stats->len == 0) {
+		return;
+	}
+
+	int64_t *values = calloc(stats->len, sizeof(values[0]));
+	if (values == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return;
+	}
+
+	static const struct {
+		const char *name;
+		size_t from, to; // offsets in struct wlr_output_frame_timing
+	} intervals[] = {
+		{ "frame→render", offsetof(struct wlr_output_frame_timing, frame),
+			offsetof(struct wlr_output_frame_timing, render_begin) },
+		{ "render", offsetof(struct wlr_output_frame_timing, render_begin),
+			offsetof(struct wlr_output_frame_timing, render_end) },
+		{ "render→commit", offsetof(struct wlr_output_frame_timing, render_end),
+			offsetof(struct wlr_output_frame_timing, commit) },
+		{ "commit→present", offsetof(struct wlr_output_frame_timing, commit),
+			offsetof(struct wlr_output_frame_timing, present) },
+		{ "frame→present", offsetof(struct wlr_output_frame_timing, frame),
+			offsetof(struct wlr_output_frame_timing, present) },
+	};
+
+	for (size_t i = 0; i < sizeof(intervals) / sizeof(intervals[0]); i++) {
+		size_t n = 0;
+		for (size_t j = 0; j < stats->len; j++) {
+			const char *timing = (const char *)get_timing(stats, j);
+			const struct timespec *from =
+				(const struct timespec *)(timing + intervals[i].from);
+			const struct timespec *to =
+				(const struct timespec *)(timing + intervals[i].to);
+			if (timespec_is_set(from) && timespec_is_set(to)) {
+				values[n++] = timespec_diff_nsec(to, from);
+			}
+		}
+		log_percentiles(output, intervals[i].name, values, n);
+	}
+
+	size_t skipped = 0, discarded = 0, missed_vblanks = 0;
+	for (size_t j = 0; j < stats->len; j++) {
+		const struct wlr_output_frame_timing *timing = get_timing(stats, j);
+		if (!timing->committed) {
+			skipped++;
+		} else if (!timing->presented) {
+			discarded++;
+		} else {
+			missed_vblanks += timing_missed_vblanks(timing);
+		}
+	}
+	wlr_log(WLR_INFO, "Frame stats for %s: %zu frames, %zu skipped, "
+		"%zu not presented, %zu missed vblanks", output->name, stats->len,
+		skipped, discarded, missed_vblanks);
+
+	free(values);
+}
+
+static void stats_push(struct wlr_output_frame_stats *stats,
+		const struct wlr_output_frame_timing *timing) {
+	stats->timings[stats->head] = *timing;
+	stats->head = (stats->head + 1) % stats->capacity;
+	if (stats->len < stats->capacity) {
+		stats->len++;
+	}
+
+	stats->frames_since_dump++;
+	if (stats->dump && stats->frames_since_dump >= stats->capacity) {
+		stats_dump(stats);
+		stats->frames_since_dump = 0;
+	}
+}
+
+static struct wlr_output_frame_timing *stats_get_current(
+		struct wlr_output_frame_stats *stats) {
+	if (!stats->has_current) {
+		memset(&stats->current, 0, sizeof(stats->current));
+		stats->has_current = true;
+	}
+	return &stats->current;
+}
+
+static void stats_unlisten_renderer(struct wlr_output_frame_stats *stats) {
+	if (stats->renderer == NULL) {
+		return;
+	}
+	wl_list_remove(&stats->renderer_begin.link);
+	wl_list_remove(&stats->renderer_end.link);
+	wl_list_remove(&stats->renderer_destroy.link);
+	stats->renderer = NULL;
+}
+
+static void handle_renderer_begin(struct wl_listener *listener, void *data) {
+	struct wlr_output_frame_stats *stats =
+		wl_container_of(listener, stats, renderer_begin);
+	// The renderer may be shared with other outputs
+	if (stats->output->back_buffer == NULL) {
+		return;
+	}
+	get_now(&stats_get_current(stats)->render_begin);
+}
+
+static void handle_renderer_end(struct wl_listener *listener, void *data) {
+	struct wlr_output_frame_stats *stats =
+		wl_container_of(listener, stats, renderer_end);
+	if (stats->output->back_buffer == NULL) {
+		return;
+	}
+	get_now(&stats_get_current(stats)->render_end);
+}
+
+static void handle_renderer_destroy(struct wl_listener *listener, void *data) {
+	struct wlr_output_frame_stats *stats =
+		wl_container_of(listener, stats, renderer_destroy);
+	stats_unlisten_renderer(stats);
+}
+
+static void stats_update_renderer(struct wlr_output_frame_stats *stats) {
+	struct wlr_renderer *renderer = stats->output->renderer;
+	if (renderer == stats->renderer) {
+		return;
+	}
+
+	stats_unlisten_renderer(stats);
+	if (renderer == NULL) {
+		return;
+	}
+
+	stats->renderer = renderer;
+	stats->renderer_begin.notify = handle_renderer_begin;
+	wl_signal_add(&renderer->events.begin, &stats->renderer_begin);
+	stats->renderer_end.notify = handle_renderer_end;
+	wl_signal_add(&renderer->events.end, &stats->renderer_end);
+	stats->renderer_destroy.notify = handle_renderer_destroy;
+	wl_signal_add(&renderer->events.destroy, &stats->renderer_destroy);
+}
+
+static void stats_destroy(struct wlr_output_frame_stats *stats) {
+	if (stats == NULL) {
+		return;
+	}
+	if (stats->dump) {
+		stats_dump(stats);
+	}
+	stats_unlisten_renderer(stats);
+	free(stats->timings);
+	free(stats);
+}
+
+bool wlr_output_enable_frame_stats(struct wlr_output *output,
+		size_t capacity) {
+	stats_destroy(output->frame_stats);
+	output->frame_stats = NULL;
+	if (capacity == 0) {
+		return true;
+	}
+
+	struct wlr_output_frame_stats *stats = calloc(1, sizeof(*stats));
+	if (stats == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return false;
+	}
+	stats->timings = calloc(capacity, sizeof(stats->timings[0]));
+	if (stats->timings == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		free(stats);
+		return false;
+	}
+	stats->output = output;
+	stats->capacity = capacity;
+
+	output->frame_stats = stats;
+	stats_update_renderer(stats);
+	return true;
+}
+
+size_t wlr_output_get_frame_timings(struct wlr_output *output,
+		struct wlr_output_frame_timing *timings, size_t len) {
+	struct wlr_output_frame_stats *stats = output->frame_stats;
+	if (stats == NULL) {
+		return 0;
+	}
+
+	if (len > stats->len) {
+		len = stats->len;
+	}
+	size_t start = stats->len - len;
+	for (size_t i = 0; i < len; i++) {
+		timings[i] = *get_timing(stats, start + i);
+	}
+	return len;
+}
+
+void output_frame_stats_init(struct wlr_output *output) {
+	const char *str = getenv("WLR_FRAME_STATS");
+	if (str == NULL || strcmp(str, "0") == 0) {
+		return;
+	}
+
+	char *end;
+	errno = 0;
+	unsigned long capacity = strtoul(str, &end, 10);
+	if (errno != 0 || *end != '\0' || end == str) {
+		wlr_log(WLR_ERROR, "Invalid WLR_FRAME_STATS value: '%s'", str);
+		return;
+	}
+	if (capacity < 2) {
+		capacity = DEFAULT_ENV_CAPACITY;
+	}
+
+	if (wlr_output_enable_frame_stats(output, capacity)) {
+		output->frame_stats->dump = true;
+	}
+}
+
+void output_frame_stats_finish(struct wlr_output *output) {
+	stats_destroy(output->frame_stats);
+	output->frame_stats = NULL;
+}
+
+void output_frame_stats_handle_frame(struct wlr_output *output) {
+	struct wlr_output_frame_stats *stats = output->frame_stats;
+	if (stats == NULL) {
+		return;
+	}
+
+	stats_update_renderer(stats);
+
+	if (stats->has_current) {
+		// The previous frame event didn't result in a commit
+		stats_push(stats, &stats->current);
+		stats->has_current = false;
+	}
+	get_now(&stats_get_current(stats)->frame);
+}
+
+void output_frame_stats_handle_commit(struct wlr_output *output) {
+	struct wlr_output_frame_stats *stats = output->frame_stats;
+	if (stats == NULL) {
+		return;
+	}
+
+	struct wlr_output_frame_timing *timing = stats_get_current(stats);
+	get_now(&timing->commit);
+	timing->committed = true;
+	timing->commit_seq = output->commit_seq;
+	stats_push(stats, timing);
+	stats->has_current = false;
+}
+
+void output_frame_stats_handle_present(struct wlr_output *output,
+		const struct wlr_output_event_present *event) {
+	struct wlr_output_frame_stats *stats = output->frame_stats;
+	if (stats == NULL) {
+		return;
+	}
+
+	struct wlr_output_frame_timing *timing = NULL;
+	if (event->commit_seq == output->commit_seq + 1) {
+		// Some backends send the event from within the commit
+		timing = stats_get_current(stats);
+	} else {
+		// Presentation events arrive in order, look for the frame from the
+		// most recent one
+		for (size_t i = stats->len; i > 0; i--) {
+			struct wlr_output_frame_timing *t =
+				(struct wlr_output_frame_timing *)get_timing(stats, i - 1);
+			if (t->committed && t->commit_seq == event->commit_seq) {
+				timing = t;
+				break;
+			}
+		}
+	}
+	if (timing == NULL) {
+		return;
+	}
+
+	timing->presented = event->presented;
+	if (event->presented) {
+		if (event->when != NULL) {
+			timing->present = *event->when;
+		}
+		timing->seq = event->seq;
+		timing->refresh = event->refresh;
+		timing->present_flags = event->flags;
+	}
+}
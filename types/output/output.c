@@ -11,6 +11,7 @@
 #include "render/swapchain.h"
 #include "types/wlr_output.h"
 #include "util/global.h"
+#include "util/input_latency.h"
 #include "util/signal.h"
 #include "backend/drm/drm.h"
 
@@ -354,6 +355,8 @@ void wlr_output_init(struct wlr_output *output, struct wlr_backend *backend,
 	output->scale = 1;
 	output->commit_seq = 0;
 	wl_list_init(&output->cursors);
+	wl_list_init(&output->cursor_buffers);
+	wl_list_init(&output->cursor_buffer_misses);
 	wl_list_init(&output->resources);
 	wl_signal_init(&output->events.frame);
 	wl_signal_init(&output->events.damage);
@@ -377,6 +380,8 @@ void wlr_output_init(struct wlr_output *output, struct wlr_backend *backend,
 
 	wlr_addon_set_init(&output->addons);
 
+	output_frame_stats_init(output);
+
 	output->display_destroy.notify = handle_display_destroy;
 	wl_display_add_destroy_listener(display, &output->display_destroy);
 }
@@ -401,6 +406,7 @@ void wlr_output_destroy(struct wlr_output *output) {
 	}
 
 	wlr_swapchain_destroy(output->cursor_swapchain);
+	output_clear_cursor_buffers(output);
 	wlr_buffer_unlock(output->cursor_front_buffer);
 
 	wlr_swapchain_destroy(output->swapchain);
@@ -413,6 +419,10 @@ void wlr_output_destroy(struct wlr_output *output) {
 		wl_event_source_remove(output->idle_done);
 	}
 
+	output_frame_scheduler_finish(output);
+	output_frame_stats_finish(output);
+	input_latency_handle_output_destroy(output);
+
 	free(output->name);
 	free(output->description);
 	free(output->make);
@@ -825,11 +835,15 @@ bool wlr_output_commit_state(struct wlr_output *output,
 		output->swapchain = NULL;
 		wlr_swapchain_destroy(output->cursor_swapchain);
 		output->cursor_swapchain = NULL;
+		output_clear_cursor_buffers(output);
 	}
 
 	if (pending.committed & WLR_OUTPUT_STATE_BUFFER) {
 		output->frame_pending = true;
 		output->needs_frame = false;
+		output_frame_scheduler_handle_commit(output);
+		output_frame_stats_handle_commit(output);
+		input_latency_handle_output_commit(output);
 	}
 
 	if (back_buffer != NULL) {
@@ -878,18 +892,29 @@ void wlr_output_attach_buffer(struct wlr_output *output,
 	output_state_attach_buffer(&output->pending, buffer);
 }
 
-void wlr_output_send_frame(struct wlr_output *output) {
+void output_emit_frame(struct wlr_output *output) {
 	output->frame_pending = false;
 	if (output->enabled) {
+		output_frame_scheduler_handle_frame(output);
+		output_frame_stats_handle_frame(output);
 		wlr_signal_emit_safe(&output->events.frame, output);
 	}
 }
 
+void wlr_output_send_frame(struct wlr_output *output) {
+	if (output_frame_scheduler_delay_frame(output)) {
+		// The frame is still pending until the scheduler sends it
+		return;
+	}
+	output_emit_frame(output);
+}
+
 static void schedule_frame_handle_idle_timer(void *data) {
 	struct wlr_output *output = data;
 	output->idle_frame = NULL;
 	if (!output->frame_pending) {
-		wlr_output_send_frame(output);
+		// Not driven by a vblank, nothing to wait for
+		output_emit_frame(output);
 	}
 }
 
@@ -927,6 +952,9 @@ void wlr_output_send_present(struct wlr_output *output,
 		event->when = &now;
 	}
 
+	output_frame_stats_handle_present(output, event);
+	input_latency_handle_output_present(output, event);
+
 	wlr_signal_emit_safe(&output->events.present, event);
 }
 
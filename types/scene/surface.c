@@ -65,6 +65,7 @@ static void set_buffer_with_surface_state(struct wlr_scene_buffer *scene_buffer,
 
 	wlr_scene_buffer_set_dest_size(scene_buffer, state->width, state->height);
 	wlr_scene_buffer_set_transform(scene_buffer, state->transform);
+	wlr_scene_buffer_set_opaque_region(scene_buffer, &surface->opaque_region);
 
 	if (surface->buffer) {
 		wlr_scene_buffer_set_buffer_with_damage(scene_buffer,
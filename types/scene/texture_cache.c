@@ -0,0 +1,261 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <wlr/render/pixman.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/render/wlr_texture.h>
+#include <wlr/types/wlr_buffer.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/util/log.h>
+#include "types/wlr_scene.h"
+
+/**
+ * Textures created from buffers which are no longer displayed by a scene
+ * buffer, kept around so that they can be reused when the buffer comes back
+ * (e.g. a compositor-owned swapchain cycling through a few buffers).
+ *
+ * The producer may have modified the buffer in the meantime. To know which
+ * parts of a cached texture are out of date, each entry accumulates the
+ * damage subsequently submitted to the scene buffer it was detached from.
+ */
+struct scene_texture_cache {
+	struct wlr_scene *scene;
+	struct wlr_renderer *renderer;
+
+	struct wl_list entries; // scene_texture_cache_entry.link, LRU first
+	size_t size;
+
+	struct wl_list link; // wlr_scene.texture_caches
+
+	struct wl_listener renderer_destroy;
+};
+
+struct scene_texture_cache_entry {
+	struct scene_texture_cache *cache;
+	struct wlr_buffer *buffer;
+	struct wlr_texture *texture;
+	size_t size;
+
+	// May be NULL, in which case the whole texture is out of date
+	struct wlr_scene_buffer *scene_buffer;
+	// Buffer-local region changed since the texture was last in sync
+	pixman_region32_t damage;
+
+	struct wlr_addon addon; // wlr_buffer.addons
+	struct wl_list link; // scene_texture_cache.entries
+	struct wl_list scene_buffer_link; // wlr_scene_buffer.cached_textures
+};
+
+static void entry_destroy(struct scene_texture_cache_entry *entry,
+		bool destroy_texture) {
+	if (destroy_texture) {
+		wlr_texture_destroy(entry->texture);
+	}
+	entry->cache->size -= entry->size;
+	wlr_addon_finish(&entry->addon);
+	wl_list_remove(&entry->link);
+	wl_list_remove(&entry->scene_buffer_link);
+	pixman_region32_fini(&entry->damage);
+	free(entry);
+}
+
+static void entry_handle_buffer_destroy(struct wlr_addon *addon) {
+	struct scene_texture_cache_entry *entry =
+		wl_container_of(addon, entry, addon);
+	entry_destroy(entry, true);
+}
+
+static const struct wlr_addon_interface entry_addon_impl = {
+	.name = "wlr_scene_texture_cache_entry",
+	.destroy = entry_handle_buffer_destroy,
+};
+
+static void cache_evict(struct scene_texture_cache *cache, size_t budget) {
+	struct scene_texture_cache_entry *entry, *tmp;
+	wl_list_for_each_safe(entry, tmp, &cache->entries, link) {
+		if (cache->size <= budget) {
+			break;
+		}
+		entry_destroy(entry, true);
+	}
+}
+
+static void cache_destroy(struct scene_texture_cache *cache) {
+	cache_evict(cache, 0);
+	assert(wl_list_empty(&cache->entries));
+	wl_list_remove(&cache->renderer_destroy.link);
+	wl_list_remove(&cache->link);
+	free(cache);
+}
+
+static void cache_handle_renderer_destroy(struct wl_listener *listener,
+		void *data) {
+	struct scene_texture_cache *cache =
+		wl_container_of(listener, cache, renderer_destroy);
+	cache_destroy(cache);
+}
+
+static struct scene_texture_cache *cache_get(struct wlr_scene *scene,
+		struct wlr_renderer *renderer, bool create) {
+	struct scene_texture_cache *cache;
+	wl_list_for_each(cache, &scene->texture_caches, link) {
+		if (cache->renderer == renderer) {
+			return cache;
+		}
+	}
+
+	if (!create) {
+		return NULL;
+	}
+
+	cache = calloc(1, sizeof(*cache));
+	if (cache == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+
+	cache->scene = scene;
+	cache->renderer = renderer;
+	wl_list_init(&cache->entries);
+
+	cache->renderer_destroy.notify = cache_handle_renderer_destroy;
+	wl_signal_add(&renderer->events.destroy, &cache->renderer_destroy);
+
+	wl_list_insert(&scene->texture_caches, &cache->link);
+	return cache;
+}
+
+// Textures wrapping the buffer's storage (DMA-BUFs, or any buffer with the
+// Pixman renderer) keep the buffer locked, which would prevent producers from
+// re-using it. Renderers already make re-importing these cheap.
+static bool texture_is_cacheable(struct wlr_renderer *renderer,
+		struct wlr_buffer *buffer) {
+	struct wlr_dmabuf_attributes dmabuf;
+	return !wlr_renderer_is_pixman(renderer) &&
+		!wlr_buffer_get_dmabuf(buffer, &dmabuf);
+}
+
+void scene_texture_cache_put(struct wlr_scene_buffer *scene_buffer,
+		struct wlr_renderer *renderer, struct wlr_buffer *buffer,
+		struct wlr_texture *texture) {
+	struct wlr_scene *scene = scene_node_get_root(&scene_buffer->node);
+	struct scene_texture_cache *cache = NULL;
+	if (scene->texture_cache_budget > 0 &&
+			texture_is_cacheable(renderer, buffer)) {
+		cache = cache_get(scene, renderer, true);
+	}
+	if (cache == NULL) {
+		wlr_texture_destroy(texture);
+		return;
+	}
+
+	struct wlr_addon *addon =
+		wlr_addon_find(&buffer->addons, cache, &entry_addon_impl);
+	if (addon != NULL) {
+		// The buffer was displayed by another scene buffer in the meantime
+		struct scene_texture_cache_entry *old =
+			wl_container_of(addon, old, addon);
+		entry_destroy(old, true);
+	}
+
+	struct scene_texture_cache_entry *entry = calloc(1, sizeof(*entry));
+	if (entry == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		wlr_texture_destroy(texture);
+		return;
+	}
+
+	entry->cache = cache;
+	entry->buffer = buffer;
+	entry->texture = texture;
+	entry->size = (size_t)texture->width * texture->height * 4;
+	entry->scene_buffer = scene_buffer;
+	pixman_region32_init(&entry->damage);
+
+	wlr_addon_init(&entry->addon, &buffer->addons, cache, &entry_addon_impl);
+	wl_list_insert(cache->entries.prev, &entry->link);
+	wl_list_insert(&scene_buffer->cached_textures, &entry->scene_buffer_link);
+	cache->size += entry->size;
+
+	cache_evict(cache, scene->texture_cache_budget);
+}
+
+struct wlr_texture *scene_texture_cache_take(
+		struct wlr_scene_buffer *scene_buffer, struct wlr_renderer *renderer,
+		struct wlr_buffer *buffer) {
+	struct wlr_scene *scene = scene_node_get_root(&scene_buffer->node);
+	struct scene_texture_cache *cache = cache_get(scene, renderer, false);
+	if (cache == NULL) {
+		return NULL;
+	}
+
+	struct wlr_addon *addon =
+		wlr_addon_find(&buffer->addons, cache, &entry_addon_impl);
+	if (addon == NULL) {
+		return NULL;
+	}
+	struct scene_texture_cache_entry *entry =
+		wl_container_of(addon, entry, addon);
+
+	if (entry->scene_buffer != scene_buffer) {
+		pixman_region32_fini(&entry->damage);
+		pixman_region32_init_rect(&entry->damage,
+			0, 0, buffer->width, buffer->height);
+	}
+
+	struct wlr_texture *texture = entry->texture;
+	if (pixman_region32_not_empty(&entry->damage) &&
+			!wlr_texture_update_from_buffer(texture, buffer, &entry->damage)) {
+		entry_destroy(entry, true);
+		return NULL;
+	}
+
+	entry_destroy(entry, false);
+	return texture;
+}
+
+void scene_texture_cache_damage(struct wlr_scene_buffer *scene_buffer,
+		struct wlr_buffer *buffer, pixman_region32_t *damage) {
+	struct scene_texture_cache_entry *entry;
+	wl_list_for_each(entry, &scene_buffer->cached_textures, scene_buffer_link) {
+		struct wlr_buffer *cached = entry->buffer;
+		if (damage == NULL || buffer == NULL ||
+				cached->width != buffer->width ||
+				cached->height != buffer->height) {
+			pixman_region32_union_rect(&entry->damage, &entry->damage,
+				0, 0, cached->width, cached->height);
+		} else {
+			pixman_region32_union(&entry->damage, &entry->damage, damage);
+			pixman_region32_intersect_rect(&entry->damage, &entry->damage,
+				0, 0, cached->width, cached->height);
+		}
+	}
+}
+
+void scene_texture_cache_unlink(struct wlr_scene_buffer *scene_buffer) {
+	struct scene_texture_cache_entry *entry, *tmp;
+	wl_list_for_each_safe(entry, tmp, &scene_buffer->cached_textures,
+			scene_buffer_link) {
+		// Damage won't be tracked anymore, the texture will be fully updated
+		// if it's ever used again
+		entry->scene_buffer = NULL;
+		wl_list_remove(&entry->scene_buffer_link);
+		wl_list_init(&entry->scene_buffer_link);
+	}
+}
+
+void scene_texture_caches_destroy(struct wlr_scene *scene) {
+	struct scene_texture_cache *cache, *tmp;
+	wl_list_for_each_safe(cache, tmp, &scene->texture_caches, link) {
+		cache_destroy(cache);
+	}
+}
+
+void wlr_scene_set_texture_cache_budget(struct wlr_scene *scene,
+		size_t budget) {
+	scene->texture_cache_budget = budget;
+
+	struct scene_texture_cache *cache;
+	wl_list_for_each(cache, &scene->texture_caches, link) {
+		cache_evict(cache, budget);
+	}
+}
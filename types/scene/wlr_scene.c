@@ -1,5 +1,6 @@
 #define _POSIX_C_SOURCE 200809L
 #include <assert.h>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 #include <wlr/backend.h>
@@ -11,11 +12,14 @@
 #include <wlr/types/wlr_scene.h>
 #include <wlr/util/log.h>
 #include <wlr/util/region.h>
+#include "render/swapchain.h"
+#include "types/wlr_buffer.h"
 #include "types/wlr_scene.h"
 #include "util/signal.h"
 #include "util/time.h"
 
 #define HIGHLIGHT_DAMAGE_FADEOUT_TIME 250
+#define DEFAULT_TEXTURE_CACHE_BUDGET (64 * 1024 * 1024)
 
 static struct wlr_scene_tree *scene_tree_from_node(struct wlr_scene_node *node) {
 	assert(node->type == WLR_SCENE_NODE_TREE);
@@ -66,6 +70,17 @@ static void scene_node_init(struct wlr_scene_node *node,
 	wlr_addon_set_init(&node->addons);
 }
 
+// This function must be called whenever the position, the size or the enabled
+// state of a node change, or when it is added to or removed from a tree. The
+// bounding boxes of its ancestors will be recomputed on the next lookup.
+static void scene_node_invalidate_bounds(struct wlr_scene_node *node) {
+	// If a tree is dirty, all of its ancestors are dirty as well
+	for (struct wlr_scene_tree *tree = node->parent;
+			tree != NULL && !tree->bounds_dirty; tree = tree->node.parent) {
+		tree->bounds_dirty = true;
+	}
+}
+
 static void scene_node_damage_whole(struct wlr_scene_node *node);
 
 struct highlight_region {
@@ -101,8 +116,10 @@ void wlr_scene_node_destroy(struct wlr_scene_node *node) {
 			}
 		}
 
+		scene_texture_cache_unlink(scene_buffer);
 		wlr_texture_destroy(scene_buffer->texture);
 		wlr_buffer_unlock(scene_buffer->buffer);
+		pixman_region32_fini(&scene_buffer->opaque_region);
 	} else if (node->type == WLR_SCENE_NODE_TREE) {
 		struct wlr_scene_tree *scene_tree = scene_tree_from_node(node);
 
@@ -123,10 +140,15 @@ void wlr_scene_node_destroy(struct wlr_scene_node *node) {
 				&scene_tree->children, link) {
 			wlr_scene_node_destroy(child);
 		}
+
+		if (scene_tree == &scene->tree) {
+			scene_texture_caches_destroy(scene);
+		}
 	}
 
 	wlr_addon_set_finish(&node->addons);
 	wl_list_remove(&node->link);
+	scene_node_invalidate_bounds(node);
 	free(node);
 }
 
@@ -147,6 +169,8 @@ struct wlr_scene *wlr_scene_create(void) {
 
 	wl_list_init(&scene->outputs);
 	wl_list_init(&scene->presentation_destroy.link);
+	wl_list_init(&scene->texture_caches);
+	scene->texture_cache_budget = DEFAULT_TEXTURE_CACHE_BUDGET;
 
 	char *debug_damage = getenv("WLR_SCENE_DEBUG_DAMAGE");
 	if (debug_damage) {
@@ -190,6 +214,7 @@ struct wlr_scene_tree *wlr_scene_tree_create(struct wlr_scene_tree *parent) {
 	}
 
 	scene_tree_init(tree, parent);
+	scene_node_invalidate_bounds(&tree->node);
 	return tree;
 }
 
@@ -297,6 +322,7 @@ struct wlr_scene_rect *wlr_scene_rect_create(struct wlr_scene_tree *parent,
 	scene_rect->height = height;
 	memcpy(scene_rect->color, color, sizeof(scene_rect->color));
 
+	scene_node_invalidate_bounds(&scene_rect->node);
 	scene_node_damage_whole(&scene_rect->node);
 
 	return scene_rect;
@@ -310,6 +336,7 @@ void wlr_scene_rect_set_size(struct wlr_scene_rect *rect, int width, int height)
 	scene_node_damage_whole(&rect->node);
 	rect->width = width;
 	rect->height = height;
+	scene_node_invalidate_bounds(&rect->node);
 	scene_node_damage_whole(&rect->node);
 }
 
@@ -333,13 +360,17 @@ struct wlr_scene_buffer *wlr_scene_buffer_create(struct wlr_scene_tree *parent,
 
 	if (buffer) {
 		scene_buffer->buffer = wlr_buffer_lock(buffer);
+		scene_buffer->buffer_is_opaque = buffer_is_opaque(buffer);
 	}
 
 	wl_signal_init(&scene_buffer->events.output_enter);
 	wl_signal_init(&scene_buffer->events.output_leave);
 	wl_signal_init(&scene_buffer->events.output_present);
 	wl_signal_init(&scene_buffer->events.frame_done);
+	pixman_region32_init(&scene_buffer->opaque_region);
+	wl_list_init(&scene_buffer->cached_textures);
 
+	scene_node_invalidate_bounds(&scene_buffer->node);
 	scene_node_damage_whole(&scene_buffer->node);
 
 	scene_node_update_outputs(&scene_buffer->node, NULL);
@@ -354,21 +385,30 @@ void wlr_scene_buffer_set_buffer_with_damage(struct wlr_scene_buffer *scene_buff
 	// coordinates. 
 	assert(buffer || !damage);
 
-	if (buffer != scene_buffer->buffer) {
+	bool buffer_changed = buffer != scene_buffer->buffer;
+	if (buffer_changed) {
 		if (!damage) {
 			scene_node_damage_whole(&scene_buffer->node);
 		}
 
-		wlr_texture_destroy(scene_buffer->texture);
-		scene_buffer->texture = NULL;
+		if (scene_buffer->texture != NULL) {
+			scene_texture_cache_put(scene_buffer,
+				scene_buffer->texture_renderer, scene_buffer->buffer,
+				scene_buffer->texture);
+			scene_buffer->texture = NULL;
+		}
 		wlr_buffer_unlock(scene_buffer->buffer);
 
 		if (buffer) {
 			scene_buffer->buffer = wlr_buffer_lock(buffer);
+			scene_buffer->buffer_is_opaque = buffer_is_opaque(buffer);
 		} else {
 			scene_buffer->buffer = NULL;
+			scene_buffer->buffer_is_opaque = false;
 		}
 
+		scene_node_invalidate_bounds(&scene_buffer->node);
+
 		scene_node_update_outputs(&scene_buffer->node, NULL);
 
 		if (!damage) {
@@ -376,6 +416,10 @@ void wlr_scene_buffer_set_buffer_with_damage(struct wlr_scene_buffer *scene_buff
 		}
 	}
 
+	if (buffer_changed || damage) {
+		scene_texture_cache_damage(scene_buffer, buffer, damage);
+	}
+
 	if (!damage) {
 		return;
 	}
@@ -440,6 +484,16 @@ void wlr_scene_buffer_set_buffer(struct wlr_scene_buffer *scene_buffer,
 	wlr_scene_buffer_set_buffer_with_damage(scene_buffer, buffer, NULL);
 }
 
+void wlr_scene_buffer_set_opaque_region(struct wlr_scene_buffer *scene_buffer,
+		pixman_region32_t *region) {
+	if (pixman_region32_equal(&scene_buffer->opaque_region, region)) {
+		return;
+	}
+
+	pixman_region32_copy(&scene_buffer->opaque_region, region);
+	scene_node_damage_whole(&scene_buffer->node);
+}
+
 void wlr_scene_buffer_set_source_box(struct wlr_scene_buffer *scene_buffer,
 		const struct wlr_fbox *box) {
 	struct wlr_fbox *cur = &scene_buffer->src_box;
@@ -466,6 +520,7 @@ void wlr_scene_buffer_set_dest_size(struct wlr_scene_buffer *scene_buffer,
 	scene_node_damage_whole(&scene_buffer->node);
 	scene_buffer->dst_width = width;
 	scene_buffer->dst_height = height;
+	scene_node_invalidate_bounds(&scene_buffer->node);
 	scene_node_damage_whole(&scene_buffer->node);
 
 	scene_node_update_outputs(&scene_buffer->node, NULL);
@@ -479,6 +534,7 @@ void wlr_scene_buffer_set_transform(struct wlr_scene_buffer *scene_buffer,
 
 	scene_node_damage_whole(&scene_buffer->node);
 	scene_buffer->transform = transform;
+	scene_node_invalidate_bounds(&scene_buffer->node);
 	scene_node_damage_whole(&scene_buffer->node);
 
 	scene_node_update_outputs(&scene_buffer->node, NULL);
@@ -501,8 +557,13 @@ static struct wlr_texture *scene_buffer_get_texture(
 		return scene_buffer->texture;
 	}
 
-	scene_buffer->texture =
-		wlr_texture_from_buffer(renderer, scene_buffer->buffer);
+	scene_buffer->texture = scene_texture_cache_take(scene_buffer, renderer,
+		scene_buffer->buffer);
+	if (scene_buffer->texture == NULL) {
+		scene_buffer->texture =
+			wlr_texture_from_buffer(renderer, scene_buffer->buffer);
+	}
+	scene_buffer->texture_renderer = renderer;
 	return scene_buffer->texture;
 }
 
@@ -605,6 +666,7 @@ void wlr_scene_node_set_enabled(struct wlr_scene_node *node, bool enabled) {
 	// One of these damage_whole() calls will short-circuit and be a no-op
 	scene_node_damage_whole(node);
 	node->enabled = enabled;
+	scene_node_invalidate_bounds(node);
 	scene_node_damage_whole(node);
 }
 
@@ -616,6 +678,7 @@ void wlr_scene_node_set_position(struct wlr_scene_node *node, int x, int y) {
 	scene_node_damage_whole(node);
 	node->x = x;
 	node->y = y;
+	scene_node_invalidate_bounds(node);
 	scene_node_damage_whole(node);
 
 	scene_node_update_outputs(node, NULL);
@@ -688,8 +751,10 @@ void wlr_scene_node_reparent(struct wlr_scene_node *node,
 	scene_node_damage_whole(node);
 
 	wl_list_remove(&node->link);
+	scene_node_invalidate_bounds(node);
 	node->parent = new_parent;
 	wl_list_insert(new_parent->children.prev, &node->link);
+	scene_node_invalidate_bounds(node);
 
 	scene_node_damage_whole(node);
 
@@ -745,16 +810,78 @@ void wlr_scene_node_for_each_buffer(struct wlr_scene_node *node,
 	scene_node_for_each_scene_buffer(node, 0, 0, user_iterator, user_data);
 }
 
+static void box_union(struct wlr_box *dest, const struct wlr_box *box) {
+	if (wlr_box_empty(box)) {
+		return;
+	}
+	if (wlr_box_empty(dest)) {
+		*dest = *box;
+		return;
+	}
+
+	int x1 = dest->x < box->x ? dest->x : box->x;
+	int y1 = dest->y < box->y ? dest->y : box->y;
+	int x2 = dest->x + dest->width > box->x + box->width ?
+		dest->x + dest->width : box->x + box->width;
+	int y2 = dest->y + dest->height > box->y + box->height ?
+		dest->y + dest->height : box->y + box->height;
+	*dest = (struct wlr_box){
+		.x = x1,
+		.y = y1,
+		.width = x2 - x1,
+		.height = y2 - y1,
+	};
+}
+
+// Get the bounding box of the node and its enabled children, relative to the
+// node's position.
+static void scene_node_get_bounds(struct wlr_scene_node *node,
+		struct wlr_box *bounds) {
+	if (node->type != WLR_SCENE_NODE_TREE) {
+		*bounds = (struct wlr_box){0};
+		scene_node_get_size(node, &bounds->width, &bounds->height);
+		return;
+	}
+
+	struct wlr_scene_tree *scene_tree = scene_tree_from_node(node);
+	if (scene_tree->bounds_dirty) {
+		struct wlr_box tree_bounds = {0};
+		struct wlr_scene_node *child;
+		wl_list_for_each(child, &scene_tree->children, link) {
+			if (!child->enabled) {
+				continue;
+			}
+
+			struct wlr_box child_bounds;
+			scene_node_get_bounds(child, &child_bounds);
+			child_bounds.x += child->x;
+			child_bounds.y += child->y;
+			box_union(&tree_bounds, &child_bounds);
+		}
+
+		scene_tree->bounds = tree_bounds;
+		scene_tree->bounds_dirty = false;
+	}
+
+	*bounds = scene_tree->bounds;
+}
+
 struct wlr_scene_node *wlr_scene_node_at(struct wlr_scene_node *node,
 		double lx, double ly, double *nx, double *ny) {
 	if (!node->enabled) {
 		return NULL;
 	}
 
-	// TODO: optimize by storing a bounding box in each node?
 	lx -= node->x;
 	ly -= node->y;
 
+	// Reject whole sub-trees which don't contain the point
+	struct wlr_box bounds;
+	scene_node_get_bounds(node, &bounds);
+	if (!wlr_box_contains_point(&bounds, lx, ly)) {
+		return NULL;
+	}
+
 	bool intersects = false;
 	switch (node->type) {
 	case WLR_SCENE_NODE_TREE:;
@@ -820,6 +947,18 @@ static void scissor_output(struct wlr_output *output, pixman_box32_t *rect) {
 	wlr_renderer_scissor(renderer, &box);
 }
 
+// Converts a region from output-local to buffer-local coordinates, as used by
+// the renderer for scissoring
+static void transform_output_damage(struct wlr_output *output,
+		pixman_region32_t *damage) {
+	int ow, oh;
+	wlr_output_transformed_resolution(output, &ow, &oh);
+
+	enum wl_output_transform transform =
+		wlr_output_transform_invert(output->transform);
+	wlr_region_transform(damage, damage, transform, ow, oh);
+}
+
 static void render_rect(struct wlr_output *output,
 		pixman_region32_t *output_damage, const float color[static 4],
 		const struct wlr_box *box, const float matrix[static 9]) {
@@ -830,12 +969,14 @@ static void render_rect(struct wlr_output *output,
 	pixman_region32_init(&damage);
 	pixman_region32_init_rect(&damage, box->x, box->y, box->width, box->height);
 	pixman_region32_intersect(&damage, &damage, output_damage);
+	if (pixman_region32_not_empty(&damage)) {
+		transform_output_damage(output, &damage);
 
-	int nrects;
-	pixman_box32_t *rects = pixman_region32_rectangles(&damage, &nrects);
-	for (int i = 0; i < nrects; ++i) {
-		scissor_output(output, &rects[i]);
-		wlr_render_rect(renderer, box, color, matrix);
+		float quad_matrix[9];
+		wlr_matrix_project_box(quad_matrix, box, WL_OUTPUT_TRANSFORM_NORMAL,
+			0, matrix);
+		wlr_render_quad_with_matrix_region(renderer, color, quad_matrix,
+			&damage);
 	}
 
 	pixman_region32_fini(&damage);
@@ -860,32 +1001,183 @@ static void render_texture(struct wlr_output *output,
 	pixman_region32_init_rect(&damage, dst_box->x, dst_box->y,
 		dst_box->width, dst_box->height);
 	pixman_region32_intersect(&damage, &damage, output_damage);
-
-	int nrects;
-	pixman_box32_t *rects = pixman_region32_rectangles(&damage, &nrects);
-	for (int i = 0; i < nrects; ++i) {
-		scissor_output(output, &rects[i]);
-		wlr_render_subtexture_with_matrix(renderer, texture, src_box, matrix, 1.0);
+	if (pixman_region32_not_empty(&damage)) {
+		transform_output_damage(output, &damage);
+		wlr_render_subtexture_with_matrix_region(renderer, texture, src_box,
+			matrix, 1.0, &damage);
 	}
 
 	pixman_region32_fini(&damage);
 }
 
-struct render_data {
-	struct wlr_scene_output *scene_output;
-	pixman_region32_t *damage;
+struct render_list_entry {
+	struct wlr_scene_node *node;
+	int x, y; // output-local, in logical coordinates
+	// Part of the node not covered by opaque nodes above it, in output
+	// buffer-local coordinates
+	pixman_region32_t visible;
 };
 
-static void render_node_iterator(struct wlr_scene_node *node,
+struct render_list_data {
+	struct wlr_box viewport_box;
+	struct wl_array *render_list;
+};
+
+static void render_list_iterator(struct wlr_scene_node *node,
 		int x, int y, void *_data) {
-	struct render_data *data = _data;
-	struct wlr_scene_output *scene_output = data->scene_output;
+	struct render_list_data *data = _data;
+
+	if (node->type == WLR_SCENE_NODE_TREE) {
+		return;
+	}
+
+	struct wlr_box node_box = { .x = x, .y = y };
+	scene_node_get_size(node, &node_box.width, &node_box.height);
+
+	struct wlr_box intersection;
+	if (!wlr_box_intersection(&intersection, &data->viewport_box, &node_box)) {
+		return;
+	}
+
+	struct render_list_entry *entry =
+		wl_array_add(data->render_list, sizeof(*entry));
+	if (entry == NULL) {
+		return;
+	}
+
+	entry->node = node;
+	entry->x = x;
+	entry->y = y;
+}
+
+// Shrinks the region to whole output pixels, so that pixels only partially
+// covered by the region after scaling are left out.
+static void scale_region_inwards(pixman_region32_t *region, float scale) {
+	if (scale == 1.0) {
+		return;
+	}
+
+	int nrects;
+	pixman_box32_t *src_rects = pixman_region32_rectangles(region, &nrects);
+
+	pixman_box32_t *dst_rects = malloc(nrects * sizeof(pixman_box32_t));
+	if (dst_rects == NULL) {
+		pixman_region32_clear(region);
+		return;
+	}
+
+	int n = 0;
+	for (int i = 0; i < nrects; ++i) {
+		pixman_box32_t box = {
+			.x1 = ceil(src_rects[i].x1 * scale),
+			.y1 = ceil(src_rects[i].y1 * scale),
+			.x2 = floor(src_rects[i].x2 * scale),
+			.y2 = floor(src_rects[i].y2 * scale),
+		};
+		if (box.x1 < box.x2 && box.y1 < box.y2) {
+			dst_rects[n++] = box;
+		}
+	}
+
+	pixman_region32_fini(region);
+	pixman_region32_init_rects(region, dst_rects, n);
+	free(dst_rects);
+}
+
+// Computes the part of the node which is known to be fully opaque, in
+// output-local logical coordinates.
+static void scene_node_get_opaque_region(struct wlr_scene_node *node,
+		int x, int y, struct wlr_renderer *renderer,
+		pixman_region32_t *opaque) {
+	int width, height;
+	scene_node_get_size(node, &width, &height);
+
+	pixman_region32_clear(opaque);
+
+	switch (node->type) {
+	case WLR_SCENE_NODE_TREE:
+		return;
+	case WLR_SCENE_NODE_RECT:;
+		struct wlr_scene_rect *scene_rect = scene_rect_from_node(node);
+		if (scene_rect->color[3] != 1.0) {
+			return;
+		}
+		break;
+	case WLR_SCENE_NODE_BUFFER:;
+		struct wlr_scene_buffer *scene_buffer = wlr_scene_buffer_from_node(node);
+		if (scene_buffer->buffer == NULL) {
+			return;
+		}
+		// The node draws nothing if the buffer can't be imported, so it
+		// can't hide what's below it
+		if (scene_buffer_get_texture(scene_buffer, renderer) == NULL) {
+			return;
+		}
+
+		if (!scene_buffer->buffer_is_opaque) {
+			pixman_region32_intersect_rect(opaque,
+				&scene_buffer->opaque_region, 0, 0, width, height);
+			pixman_region32_translate(opaque, x, y);
+			return;
+		}
+		break;
+	}
+
+	pixman_region32_union_rect(opaque, opaque, x, y, width, height);
+}
+
+// Walks the render list front to back and computes the visible region of
+// each entry. The union of all opaque regions is stored in opaque.
+static void scene_output_compute_visibility(
+		struct wlr_scene_output *scene_output, pixman_region32_t *opaque) {
 	struct wlr_output *output = scene_output->output;
-	pixman_region32_t *output_damage = data->damage;
+
+	pixman_region32_t node_opaque;
+	pixman_region32_init(&node_opaque);
+
+	struct render_list_entry *entries = scene_output->render_list.data;
+	size_t len = scene_output->render_list.size / sizeof(*entries);
+	for (size_t i = len; i-- > 0;) {
+		struct render_list_entry *entry = &entries[i];
+
+		struct wlr_box box = { .x = entry->x, .y = entry->y };
+		scene_node_get_size(entry->node, &box.width, &box.height);
+		scale_box(&box, output->scale);
+
+		pixman_region32_init_rect(&entry->visible,
+			box.x, box.y, box.width, box.height);
+		pixman_region32_subtract(&entry->visible, &entry->visible, opaque);
+		if (!pixman_region32_not_empty(&entry->visible)) {
+			// Fully hidden, so it cannot hide anything which isn't already
+			// hidden
+			continue;
+		}
+
+		scene_node_get_opaque_region(entry->node, entry->x, entry->y,
+			output->renderer, &node_opaque);
+		scale_region_inwards(&node_opaque, output->scale);
+		pixman_region32_union(opaque, opaque, &node_opaque);
+	}
+
+	pixman_region32_fini(&node_opaque);
+}
+
+static void render_list_entry_render(struct wlr_scene_output *scene_output,
+		struct render_list_entry *entry, pixman_region32_t *output_damage) {
+	struct wlr_scene_node *node = entry->node;
+	struct wlr_output *output = scene_output->output;
+
+	if (!pixman_region32_not_empty(&entry->visible)) {
+		return;
+	}
+
+	pixman_region32_t render_region;
+	pixman_region32_init(&render_region);
+	pixman_region32_intersect(&render_region, &entry->visible, output_damage);
 
 	struct wlr_box dst_box = {
-		.x = x,
-		.y = y,
+		.x = entry->x,
+		.y = entry->y,
 	};
 	scene_node_get_size(node, &dst_box.width, &dst_box.height);
 	scale_box(&dst_box, output->scale);
@@ -900,31 +1192,33 @@ static void render_node_iterator(struct wlr_scene_node *node,
 	case WLR_SCENE_NODE_RECT:;
 		struct wlr_scene_rect *scene_rect = scene_rect_from_node(node);
 
-		render_rect(output, output_damage, scene_rect->color, &dst_box,
+		render_rect(output, &render_region, scene_rect->color, &dst_box,
 			output->transform_matrix);
 		break;
 	case WLR_SCENE_NODE_BUFFER:;
 		struct wlr_scene_buffer *scene_buffer = wlr_scene_buffer_from_node(node);
 		if (!scene_buffer->buffer) {
-			return;
+			break;
 		}
 
 		struct wlr_renderer *renderer = output->renderer;
 		texture = scene_buffer_get_texture(scene_buffer, renderer);
 		if (texture == NULL) {
-			return;
+			break;
 		}
 
 		transform = wlr_output_transform_invert(scene_buffer->transform);
 		wlr_matrix_project_box(matrix, &dst_box, transform, 0.0,
 			output->transform_matrix);
 
-		render_texture(output, output_damage, texture, &scene_buffer->src_box,
+		render_texture(output, &render_region, texture, &scene_buffer->src_box,
 			&dst_box, matrix);
 
 		wlr_signal_emit_safe(&scene_buffer->events.output_present, scene_output);
 		break;
 	}
+
+	pixman_region32_fini(&render_region);
 }
 
 static void scene_node_for_each_node(struct wlr_scene_node *node,
@@ -1031,6 +1325,7 @@ struct wlr_scene_output *wlr_scene_output_create(struct wlr_scene *scene,
 
 	wlr_damage_ring_init(&scene_output->damage_ring);
 	wl_list_init(&scene_output->damage_highlight_regions);
+	wl_array_init(&scene_output->render_list);
 
 	int prev_output_index = -1;
 	struct wl_list *prev_output_link = &scene->outputs;
@@ -1090,6 +1385,7 @@ void wlr_scene_output_destroy(struct wlr_scene_output *scene_output) {
 
 	wlr_addon_finish(&scene_output->addon);
 	wlr_damage_ring_finish(&scene_output->damage_ring);
+	wl_array_release(&scene_output->render_list);
 	wl_list_remove(&scene_output->link);
 	wl_list_remove(&scene_output->output_commit.link);
 	wl_list_remove(&scene_output->output_mode.link);
@@ -1211,6 +1507,27 @@ static bool scene_output_scanout(struct wlr_scene_output *scene_output) {
 	return wlr_output_commit(output);
 }
 
+// Keep enough damage history for every buffer of the output's swapchain
+static void scene_output_update_damage_history(
+		struct wlr_scene_output *scene_output) {
+	struct wlr_swapchain *swapchain = scene_output->output->swapchain;
+	if (swapchain == NULL) {
+		return;
+	}
+
+	size_t depth = 0;
+	for (size_t i = 0; i < WLR_SWAPCHAIN_CAP; i++) {
+		if (swapchain->slots[i].buffer != NULL) {
+			depth++;
+		}
+	}
+
+	struct wlr_damage_ring *ring = &scene_output->damage_ring;
+	if (depth > ring->previous_len + 1) {
+		wlr_damage_ring_set_previous_len(ring, depth - 1);
+	}
+}
+
 bool wlr_scene_output_commit(struct wlr_scene_output *scene_output) {
 	struct wlr_output *output = scene_output->output;
 	enum wlr_scene_debug_damage_option debug_damage =
@@ -1279,6 +1596,8 @@ bool wlr_scene_output_commit(struct wlr_scene_output *scene_output) {
 		return false;
 	}
 
+	scene_output_update_damage_history(scene_output);
+
 	pixman_region32_t damage;
 	pixman_region32_init(&damage);
 	wlr_damage_ring_get_buffer_damage(&scene_output->damage_ring,
@@ -1290,22 +1609,47 @@ bool wlr_scene_output_commit(struct wlr_scene_output *scene_output) {
 		return true;
 	}
 
+	struct render_list_data list_data = {
+		.render_list = &scene_output->render_list,
+	};
+	wlr_output_effective_resolution(output,
+		&list_data.viewport_box.width, &list_data.viewport_box.height);
+	scene_output->render_list.size = 0;
+	scene_node_for_each_node(&scene_output->scene->tree.node,
+		-scene_output->x, -scene_output->y,
+		render_list_iterator, &list_data);
+
+	pixman_region32_t opaque;
+	pixman_region32_init(&opaque);
+	scene_output_compute_visibility(scene_output, &opaque);
+
 	wlr_renderer_begin(renderer, output->width, output->height);
 
+	// Only clear the parts of the damage not covered by an opaque node
+	pixman_region32_t background;
+	pixman_region32_init(&background);
+	pixman_region32_subtract(&background, &damage, &opaque);
+	// Parts of the background covered by opaque nodes will be painted over,
+	// drawing them is fine if that avoids extra clears. Simplifying may grow
+	// the region past the damage, which nodes don't repaint, so clip it again.
+	wlr_damage_ring_simplify(&scene_output->damage_ring, &background);
+	pixman_region32_intersect(&background, &background, &damage);
+
 	int nrects;
-	pixman_box32_t *rects = pixman_region32_rectangles(&damage, &nrects);
+	pixman_box32_t *rects = pixman_region32_rectangles(&background, &nrects);
 	for (int i = 0; i < nrects; ++i) {
 		scissor_output(output, &rects[i]);
 		wlr_renderer_clear(renderer, (float[4]){ 0.0, 0.0, 0.0, 1.0 });
 	}
 
-	struct render_data data = {
-		.scene_output = scene_output,
-		.damage = &damage,
-	};
-	scene_node_for_each_node(&scene_output->scene->tree.node,
-		-scene_output->x, -scene_output->y,
-		render_node_iterator, &data);
+	pixman_region32_fini(&background);
+	pixman_region32_fini(&opaque);
+
+	struct render_list_entry *entry;
+	wl_array_for_each(entry, &scene_output->render_list) {
+		render_list_entry_render(scene_output, entry, &damage);
+		pixman_region32_fini(&entry->visible);
+	}
 	wlr_renderer_scissor(renderer, NULL);
 
 	if (debug_damage == WLR_SCENE_DEBUG_DAMAGE_HIGHLIGHT) {
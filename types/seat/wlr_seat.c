@@ -11,10 +11,16 @@
 #include <wlr/util/log.h>
 #include "types/wlr_seat.h"
 #include "util/global.h"
+#include "util/hash_table.h"
 #include "util/signal.h"
 
 #define SEAT_VERSION 8
 
+static uint64_t seat_client_get_hash_key(struct wl_list *link) {
+	struct wlr_seat_client *client = wl_container_of(link, client, hash_link);
+	return (uintptr_t)client->client;
+}
+
 static void seat_handle_get_pointer(struct wl_client *client,
 		struct wl_resource *seat_resource, uint32_t id) {
 	struct wlr_seat_client *seat_client =
@@ -72,6 +78,9 @@ static void seat_client_handle_resource_destroy(
 	if (client == client->seat->pointer_state.focused_client) {
 		client->seat->pointer_state.focused_client = NULL;
 	}
+	if (client == client->seat->pointer_state.leave_client) {
+		client->seat->pointer_state.leave_client = NULL;
+	}
 	if (client == client->seat->keyboard_state.focused_client) {
 		client->seat->keyboard_state.focused_client = NULL;
 	}
@@ -95,6 +104,7 @@ static void seat_client_handle_resource_destroy(
 		wl_list_init(link);
 	}
 
+	hash_table_remove(client->seat->clients_by_wl_client, &client->hash_link);
 	wl_list_remove(&client->link);
 	free(client);
 }
@@ -135,6 +145,13 @@ static void seat_handle_bind(struct wl_client *client, void *_wlr_seat,
 
 		seat_client->client = client;
 		seat_client->seat = wlr_seat;
+		if (!hash_table_insert(wlr_seat->clients_by_wl_client,
+				&seat_client->hash_link)) {
+			free(seat_client);
+			wl_resource_destroy(wl_resource);
+			wl_client_post_no_memory(client);
+			return;
+		}
 		wl_list_init(&seat_client->resources);
 		wl_list_init(&seat_client->pointers);
 		wl_list_init(&seat_client->keyboards);
@@ -173,7 +190,9 @@ void wlr_seat_destroy(struct wlr_seat *seat) {
 		return;
 	}
 
+	wlr_seat_pointer_set_event_bundling(seat, false);
 	wlr_seat_pointer_clear_focus(seat);
+	wlr_seat_pointer_set_motion_coalescing(seat, false, 0);
 	wlr_seat_keyboard_clear_focus(seat);
 
 	struct wlr_touch_point *point;
@@ -206,6 +225,8 @@ void wlr_seat_destroy(struct wlr_seat *seat) {
 	}
 
 	wlr_global_destroy_safe(seat->global);
+	hash_table_finish(seat->clients_by_wl_client);
+	free(seat->clients_by_wl_client);
 	free(seat->pointer_state.default_grab);
 	free(seat->keyboard_state.default_grab);
 	free(seat->touch_state.default_grab);
@@ -286,6 +307,18 @@ struct wlr_seat *wlr_seat_create(struct wl_display *display, const char *name) {
 		free(seat);
 		return NULL;
 	}
+
+	seat->clients_by_wl_client = calloc(1, sizeof(struct hash_table));
+	if (seat->clients_by_wl_client == NULL) {
+		wl_global_destroy(seat->global);
+		free(touch_grab);
+		free(pointer_grab);
+		free(keyboard_grab);
+		free(seat);
+		return NULL;
+	}
+	hash_table_init(seat->clients_by_wl_client, seat_client_get_hash_key);
+
 	seat->display = display;
 	seat->name = strdup(name);
 	wl_list_init(&seat->clients);
@@ -321,13 +354,14 @@ struct wlr_seat *wlr_seat_create(struct wl_display *display, const char *name) {
 
 struct wlr_seat_client *wlr_seat_client_for_wl_client(struct wlr_seat *wlr_seat,
 		struct wl_client *wl_client) {
-	struct wlr_seat_client *seat_client;
-	wl_list_for_each(seat_client, &wlr_seat->clients, link) {
-		if (seat_client->client == wl_client) {
-			return seat_client;
-		}
+	struct wl_list *link =
+		hash_table_find(wlr_seat->clients_by_wl_client, (uintptr_t)wl_client);
+	if (link == NULL) {
+		return NULL;
 	}
-	return NULL;
+	struct wlr_seat_client *seat_client =
+		wl_container_of(link, seat_client, hash_link);
+	return seat_client;
 }
 
 void wlr_seat_set_capabilities(struct wlr_seat *wlr_seat,
@@ -340,6 +374,10 @@ void wlr_seat_set_capabilities(struct wlr_seat *wlr_seat,
 	wlr_seat->capabilities = capabilities;
 	wlr_seat->accumulated_capabilities |= capabilities;
 
+	if ((capabilities & WL_SEAT_CAPABILITY_POINTER) == 0) {
+		seat_pointer_flush_leave(wlr_seat);
+	}
+
 	struct wlr_seat_client *client;
 	wl_list_for_each(client, &wlr_seat->clients, link) {
 		// Make resources inert if necessary
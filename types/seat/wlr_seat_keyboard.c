@@ -8,6 +8,7 @@
 #include <wlr/util/log.h>
 #include "types/wlr_data_device.h"
 #include "types/wlr_seat.h"
+#include "util/input_latency.h"
 #include "util/signal.h"
 
 static void default_keyboard_enter(struct wlr_seat_keyboard_grab *grab,
@@ -81,6 +82,7 @@ void wlr_seat_keyboard_send_key(struct wlr_seat *wlr_seat, uint32_t time,
 
 		wl_keyboard_send_key(resource, serial, time, key, state);
 	}
+	input_latency_handle_send();
 }
 
 static void seat_client_send_keymap(struct wlr_seat_client *client,
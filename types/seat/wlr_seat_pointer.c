@@ -7,6 +7,7 @@
 #include <wlr/types/wlr_compositor.h>
 #include <wlr/util/log.h>
 #include "types/wlr_seat.h"
+#include "util/input_latency.h"
 #include "util/signal.h"
 #include "util/array.h"
 
@@ -132,10 +133,12 @@ static void seat_pointer_handle_surface_destroy(struct wl_listener *listener,
 	wl_list_remove(&state->surface_destroy.link);
 	wl_list_init(&state->surface_destroy.link);
 	wlr_seat_pointer_clear_focus(state->seat);
+	// The leave event can't be delayed past the surface destruction
+	seat_pointer_flush_leave(state->seat);
 }
 
-void seat_client_send_pointer_leave_raw(struct wlr_seat_client *seat_client,
-		struct wlr_surface *surface) {
+static void seat_client_send_pointer_leave(struct wlr_seat_client *seat_client,
+		struct wlr_surface *surface, bool send_frame) {
 	uint32_t serial = wlr_seat_client_next_serial(seat_client);
 	struct wl_resource *resource;
 	wl_resource_for_each(resource, &seat_client->pointers) {
@@ -144,35 +147,215 @@ void seat_client_send_pointer_leave_raw(struct wlr_seat_client *seat_client,
 		}
 
 		wl_pointer_send_leave(resource, serial, surface->resource);
-		pointer_send_frame(resource);
+		if (send_frame) {
+			pointer_send_frame(resource);
+		}
+	}
+}
+
+void seat_client_send_pointer_leave_raw(struct wlr_seat_client *seat_client,
+		struct wlr_surface *surface) {
+	seat_client_send_pointer_leave(seat_client, surface, true);
+}
+
+static void seat_client_send_motion(struct wlr_seat_client *client,
+		uint32_t time, wl_fixed_t sx, wl_fixed_t sy) {
+	struct wl_resource *resource;
+	wl_resource_for_each(resource, &client->pointers) {
+		if (wlr_seat_client_from_pointer_resource(resource) == NULL) {
+			continue;
+		}
+
+		wl_pointer_send_motion(resource, time, sx, sy);
+	}
+}
+
+void wlr_seat_pointer_flush_motion(struct wlr_seat *wlr_seat) {
+	struct wlr_seat_pointer_state *state = &wlr_seat->pointer_state;
+	if (!state->motion_pending) {
+		return;
+	}
+	state->motion_pending = false;
+	if (state->coalesce_timer != NULL) {
+		wl_event_source_timer_update(state->coalesce_timer, 0);
+	}
+
+	bool frame_pending = state->frame_pending;
+	state->frame_pending = false;
+	int64_t dispatch_nsec = state->pending_motion_dispatch_nsec;
+	state->pending_motion_dispatch_nsec = 0;
+
+	struct wlr_seat_client *client = state->focused_client;
+	if (client == NULL) {
+		return;
 	}
+
+	wl_fixed_t sx_fixed = wl_fixed_from_double(state->pending_sx);
+	wl_fixed_t sy_fixed = wl_fixed_from_double(state->pending_sy);
+	if (wl_fixed_from_double(state->sent_sx) != sx_fixed ||
+			wl_fixed_from_double(state->sent_sy) != sy_fixed) {
+		seat_client_send_motion(client, state->pending_motion_time,
+			sx_fixed, sy_fixed);
+		if (dispatch_nsec != 0) {
+			input_latency_handle_delayed_send(dispatch_nsec);
+		}
+	}
+
+	if (frame_pending) {
+		wlr_seat_pointer_send_frame(wlr_seat);
+	}
+}
+
+static int handle_coalesce_timer(void *data) {
+	struct wlr_seat *wlr_seat = data;
+	wlr_seat_pointer_flush_motion(wlr_seat);
+	return 0;
+}
+
+void wlr_seat_pointer_set_motion_coalescing(struct wlr_seat *wlr_seat,
+		bool enabled, uint32_t interval_ms) {
+	struct wlr_seat_pointer_state *state = &wlr_seat->pointer_state;
+	wlr_seat_pointer_flush_motion(wlr_seat);
+
+	if (state->coalesce_timer != NULL) {
+		wl_event_source_remove(state->coalesce_timer);
+		state->coalesce_timer = NULL;
+	}
+
+	state->coalesce_motion = enabled;
+	state->coalesce_interval_ms = enabled ? interval_ms : 0;
+	if (state->coalesce_interval_ms == 0) {
+		return;
+	}
+
+	struct wl_event_loop *loop = wl_display_get_event_loop(wlr_seat->display);
+	state->coalesce_timer =
+		wl_event_loop_add_timer(loop, handle_coalesce_timer, wlr_seat);
+	if (state->coalesce_timer == NULL) {
+		wlr_log(WLR_ERROR, "Failed to create pointer motion timer");
+		state->coalesce_interval_ms = 0;
+	}
+}
+
+void seat_pointer_flush_leave(struct wlr_seat *wlr_seat) {
+	struct wlr_seat_pointer_state *state = &wlr_seat->pointer_state;
+	if (state->leave_surface == NULL) {
+		return;
+	}
+	if (state->bundle_idle != NULL) {
+		wl_event_source_remove(state->bundle_idle);
+		state->bundle_idle = NULL;
+	}
+
+	struct wlr_seat_client *client = state->leave_client;
+	struct wlr_surface *surface = state->leave_surface;
+	state->leave_client = NULL;
+	state->leave_surface = NULL;
+
+	// The pointer focus is empty, the listener tracks the left surface
+	assert(state->focused_surface == NULL);
+	wl_list_remove(&state->surface_destroy.link);
+	wl_list_init(&state->surface_destroy.link);
+
+	if (client != NULL) {
+		seat_client_send_pointer_leave_raw(client, surface);
+	}
+}
+
+static void handle_bundle_idle(void *data) {
+	struct wlr_seat *wlr_seat = data;
+	wlr_seat->pointer_state.bundle_idle = NULL;
+	seat_pointer_flush_leave(wlr_seat);
+}
+
+void wlr_seat_pointer_set_event_bundling(struct wlr_seat *wlr_seat,
+		bool enabled) {
+	if (!enabled) {
+		seat_pointer_flush_leave(wlr_seat);
+	}
+	wlr_seat->pointer_state.bundle_events = enabled;
+}
+
+static bool seat_pointer_defer_leave(struct wlr_seat *wlr_seat,
+		struct wlr_seat_client *client, struct wlr_surface *surface) {
+	struct wlr_seat_pointer_state *state = &wlr_seat->pointer_state;
+	if (state->bundle_idle == NULL) {
+		struct wl_event_loop *loop =
+			wl_display_get_event_loop(wlr_seat->display);
+		state->bundle_idle =
+			wl_event_loop_add_idle(loop, handle_bundle_idle, wlr_seat);
+		if (state->bundle_idle == NULL) {
+			return false;
+		}
+	}
+
+	state->leave_client = client;
+	state->leave_surface = surface;
+	state->leave_sx = state->sx;
+	state->leave_sy = state->sy;
+	return true;
 }
 
 void wlr_seat_pointer_enter(struct wlr_seat *wlr_seat,
 		struct wlr_surface *surface, double sx, double sy) {
-	if (wlr_seat->pointer_state.focused_surface == surface) {
+	struct wlr_seat_pointer_state *state = &wlr_seat->pointer_state;
+	if (state->focused_surface == surface) {
 		// this surface already got an enter notify
 		return;
 	}
 
+	wlr_seat_pointer_flush_motion(wlr_seat);
+
 	struct wlr_seat_client *client = NULL;
 	if (surface) {
 		struct wl_client *wl_client = wl_resource_get_client(surface->resource);
 		client = wlr_seat_client_for_wl_client(wlr_seat, wl_client);
 	}
 
-	struct wlr_seat_client *focused_client =
-		wlr_seat->pointer_state.focused_client;
-	struct wlr_surface *focused_surface =
-		wlr_seat->pointer_state.focused_surface;
+	struct wlr_surface *old_surface = state->focused_surface;
+	struct wlr_seat_client *focused_client = state->focused_client;
+	struct wlr_surface *focused_surface = state->focused_surface;
+
+	bool send_events = true;
+	if (state->leave_surface != NULL) {
+		// The pointer left a surface earlier in this event loop iteration
+		if (surface == state->leave_surface && client == state->leave_client &&
+				wl_fixed_from_double(sx) ==
+					wl_fixed_from_double(state->leave_sx) &&
+				wl_fixed_from_double(sy) ==
+					wl_fixed_from_double(state->leave_sy)) {
+			// ... and is back where it was: the leave and enter events
+			// cancel out
+			send_events = false;
+		} else {
+			focused_client = state->leave_client;
+			focused_surface = state->leave_surface;
+		}
+
+		if (state->bundle_idle != NULL) {
+			wl_event_source_remove(state->bundle_idle);
+			state->bundle_idle = NULL;
+		}
+		state->leave_client = NULL;
+		state->leave_surface = NULL;
+	}
+
+	if (send_events && surface == NULL && state->bundle_events &&
+			focused_client != NULL && focused_surface != NULL &&
+			seat_pointer_defer_leave(wlr_seat, focused_client,
+				focused_surface)) {
+		send_events = false;
+	}
 
-	// leave the previously entered surface
-	if (focused_client != NULL && focused_surface != NULL) {
-		seat_client_send_pointer_leave_raw(focused_client, focused_surface);
+	// leave the previously entered surface, the events are part of the same
+	// frame as the enter event if both are sent to the same client
+	if (send_events && focused_client != NULL && focused_surface != NULL) {
+		seat_client_send_pointer_leave(focused_client, focused_surface,
+			surface == NULL || client != focused_client);
 	}
 
 	// enter the current surface
-	if (client != NULL && surface != NULL) {
+	if (send_events && client != NULL && surface != NULL) {
 		uint32_t serial = wlr_seat_client_next_serial(client);
 		struct wl_resource *resource;
 		wl_resource_for_each(resource, &client->pointers) {
@@ -186,11 +369,14 @@ void wlr_seat_pointer_enter(struct wlr_seat *wlr_seat,
 		}
 	}
 
-	// reinitialize the focus destroy events
+	// reinitialize the focus destroy events, a surface with a delayed leave
+	// event is tracked as well
+	struct wlr_surface *tracked_surface =
+		surface != NULL ? surface : state->leave_surface;
 	wl_list_remove(&wlr_seat->pointer_state.surface_destroy.link);
 	wl_list_init(&wlr_seat->pointer_state.surface_destroy.link);
-	if (surface != NULL) {
-		wl_signal_add(&surface->events.destroy,
+	if (tracked_surface != NULL) {
+		wl_signal_add(&tracked_surface->events.destroy,
 			&wlr_seat->pointer_state.surface_destroy);
 		wlr_seat->pointer_state.surface_destroy.notify =
 			seat_pointer_handle_surface_destroy;
@@ -207,7 +393,7 @@ void wlr_seat_pointer_enter(struct wlr_seat *wlr_seat,
 	struct wlr_seat_pointer_focus_change_event event = {
 		.seat = wlr_seat,
 		.new_surface = surface,
-		.old_surface = focused_surface,
+		.old_surface = old_surface,
 		.sx = sx,
 		.sy = sy,
 	};
@@ -225,26 +411,46 @@ void wlr_seat_pointer_warp(struct wlr_seat *wlr_seat, double sx, double sy) {
 
 void wlr_seat_pointer_send_motion(struct wlr_seat *wlr_seat, uint32_t time,
 		double sx, double sy) {
-	struct wlr_seat_client *client = wlr_seat->pointer_state.focused_client;
+	struct wlr_seat_pointer_state *state = &wlr_seat->pointer_state;
+	struct wlr_seat_client *client = state->focused_client;
 	if (client == NULL) {
 		return;
 	}
 
+	if (state->coalesce_motion) {
+		if (!state->motion_pending) {
+			state->motion_pending = true;
+			state->sent_sx = state->sx;
+			state->sent_sy = state->sy;
+			if (state->coalesce_timer != NULL) {
+				wl_event_source_timer_update(state->coalesce_timer,
+					state->coalesce_interval_ms);
+			}
+		}
+		state->pending_motion_time = time;
+		state->pending_sx = sx;
+		state->pending_sy = sy;
+		wlr_seat_pointer_warp(wlr_seat, sx, sy);
+
+		// The motion is sent when flushed, trace it from the first
+		// coalesced event
+		int64_t dispatch_nsec;
+		if (input_latency_take_event(&dispatch_nsec) &&
+				state->pending_motion_dispatch_nsec == 0) {
+			state->pending_motion_dispatch_nsec = dispatch_nsec;
+		}
+		return;
+	}
+
 	// Ensure we don't send duplicate motion events. Instead of comparing with an
 	// epsilon, chop off some precision by converting to a `wl_fixed_t` first,
 	// since that is what a client receives.
 	wl_fixed_t sx_fixed = wl_fixed_from_double(sx);
 	wl_fixed_t sy_fixed = wl_fixed_from_double(sy);
-	if (wl_fixed_from_double(wlr_seat->pointer_state.sx) != sx_fixed ||
-			wl_fixed_from_double(wlr_seat->pointer_state.sy) != sy_fixed) {
-		struct wl_resource *resource;
-		wl_resource_for_each(resource, &client->pointers) {
-			if (wlr_seat_client_from_pointer_resource(resource) == NULL) {
-				continue;
-			}
-
-			wl_pointer_send_motion(resource, time, sx_fixed, sy_fixed);
-		}
+	if (wl_fixed_from_double(state->sx) != sx_fixed ||
+			wl_fixed_from_double(state->sy) != sy_fixed) {
+		seat_client_send_motion(client, time, sx_fixed, sy_fixed);
+		input_latency_handle_send();
 	}
 
 	wlr_seat_pointer_warp(wlr_seat, sx, sy);
@@ -252,10 +458,13 @@ void wlr_seat_pointer_send_motion(struct wlr_seat *wlr_seat, uint32_t time,
 
 uint32_t wlr_seat_pointer_send_button(struct wlr_seat *wlr_seat, uint32_t time,
 		uint32_t button, enum wlr_button_state state) {
+	wlr_seat_pointer_flush_motion(wlr_seat);
+
 	struct wlr_seat_client *client = wlr_seat->pointer_state.focused_client;
 	if (client == NULL) {
 		return 0;
 	}
+	wlr_seat->pointer_state.unframed_events = true;
 
 	uint32_t serial = wlr_seat_client_next_serial(client);
 	struct wl_resource *resource;
@@ -266,6 +475,7 @@ uint32_t wlr_seat_pointer_send_button(struct wlr_seat *wlr_seat, uint32_t time,
 
 		wl_pointer_send_button(resource, serial, time, button, state);
 	}
+	input_latency_handle_send();
 	return serial;
 }
 
@@ -313,10 +523,13 @@ static void update_value120_accumulators(struct wlr_seat_client *client,
 void wlr_seat_pointer_send_axis(struct wlr_seat *wlr_seat, uint32_t time,
 		enum wlr_axis_orientation orientation, double value,
 		int32_t value_discrete, enum wlr_axis_source source) {
+	wlr_seat_pointer_flush_motion(wlr_seat);
+
 	struct wlr_seat_client *client = wlr_seat->pointer_state.focused_client;
 	if (client == NULL) {
 		return;
 	}
+	wlr_seat->pointer_state.unframed_events = true;
 
 	bool send_source = false;
 	if (wlr_seat->pointer_state.sent_axis_source) {
@@ -380,12 +593,25 @@ void wlr_seat_pointer_send_axis(struct wlr_seat *wlr_seat, uint32_t time,
 }
 
 void wlr_seat_pointer_send_frame(struct wlr_seat *wlr_seat) {
-	struct wlr_seat_client *client = wlr_seat->pointer_state.focused_client;
+	struct wlr_seat_pointer_state *state = &wlr_seat->pointer_state;
+	if (state->motion_pending) {
+		if (!state->unframed_events) {
+			// The frame only ends coalesced motion, delay it as well
+			state->frame_pending = true;
+			return;
+		}
+		// Send the motion as part of this frame
+		state->frame_pending = false;
+		wlr_seat_pointer_flush_motion(wlr_seat);
+	}
+
+	struct wlr_seat_client *client = state->focused_client;
 	if (client == NULL) {
 		return;
 	}
 
-	wlr_seat->pointer_state.sent_axis_source = false;
+	state->sent_axis_source = false;
+	state->unframed_events = false;
 
 	struct wl_resource *resource;
 	wl_resource_for_each(resource, &client->pointers) {
@@ -7,22 +7,27 @@
 #include "util/signal.h"
 
 #define WLR_DAMAGE_RING_MAX_RECTS 20
+// Number of preceding rectangles a rectangle can be merged with
+#define SIMPLIFY_WINDOW 4
+#define SIMPLIFY_MAX_PASSES 4
 
 void wlr_damage_ring_init(struct wlr_damage_ring *ring) {
 	memset(ring, 0, sizeof(*ring));
 
 	ring->width = INT_MAX;
 	ring->height = INT_MAX;
+	ring->rect_cost = WLR_DAMAGE_RING_DEFAULT_RECT_COST;
+	ring->previous_len = WLR_DAMAGE_RING_PREVIOUS_LEN;
 
 	pixman_region32_init(&ring->current);
-	for (size_t i = 0; i < WLR_DAMAGE_RING_PREVIOUS_LEN; ++i) {
+	for (size_t i = 0; i < WLR_DAMAGE_RING_MAX_PREVIOUS_LEN; ++i) {
 		pixman_region32_init(&ring->previous[i]);
 	}
 }
 
 void wlr_damage_ring_finish(struct wlr_damage_ring *ring) {
 	pixman_region32_fini(&ring->current);
-	for (size_t i = 0; i < WLR_DAMAGE_RING_PREVIOUS_LEN; ++i) {
+	for (size_t i = 0; i < WLR_DAMAGE_RING_MAX_PREVIOUS_LEN; ++i) {
 		pixman_region32_fini(&ring->previous[i]);
 	}
 }
@@ -39,6 +44,38 @@ void wlr_damage_ring_set_bounds(struct wlr_damage_ring *ring,
 	wlr_damage_ring_add_whole(ring);
 }
 
+bool wlr_damage_ring_set_previous_len(struct wlr_damage_ring *ring,
+		size_t previous_len) {
+	if (previous_len > WLR_DAMAGE_RING_MAX_PREVIOUS_LEN) {
+		return false;
+	}
+	if (previous_len == ring->previous_len) {
+		return true;
+	}
+
+	// Re-order the history from the most recent frame to the oldest one,
+	// starting at index 0
+	pixman_region32_t ordered[WLR_DAMAGE_RING_MAX_PREVIOUS_LEN];
+	for (size_t i = 0; i < ring->previous_len; ++i) {
+		ordered[i] = ring->previous[(ring->previous_idx + i) % ring->previous_len];
+	}
+	memcpy(ring->previous, ordered, ring->previous_len * sizeof(ordered[0]));
+	ring->previous_idx = 0;
+
+	// Damage for frames which weren't tracked is unknown
+	for (size_t i = ring->previous_len; i < previous_len; ++i) {
+		pixman_region32_clear(&ring->previous[i]);
+		pixman_region32_union_rect(&ring->previous[i], &ring->previous[i],
+			0, 0, ring->width, ring->height);
+	}
+	for (size_t i = previous_len; i < ring->previous_len; ++i) {
+		pixman_region32_clear(&ring->previous[i]);
+	}
+
+	ring->previous_len = previous_len;
+	return true;
+}
+
 bool wlr_damage_ring_add(struct wlr_damage_ring *ring,
 		pixman_region32_t *damage) {
 	pixman_region32_t clipped;
@@ -76,18 +113,112 @@ void wlr_damage_ring_add_whole(struct wlr_damage_ring *ring) {
 }
 
 void wlr_damage_ring_rotate(struct wlr_damage_ring *ring) {
-	// modular decrement
-	ring->previous_idx = ring->previous_idx +
-		WLR_DAMAGE_RING_PREVIOUS_LEN - 1;
-	ring->previous_idx %= WLR_DAMAGE_RING_PREVIOUS_LEN;
+	if (ring->previous_len > 0) {
+		// modular decrement
+		ring->previous_idx = ring->previous_idx + ring->previous_len - 1;
+		ring->previous_idx %= ring->previous_len;
 
-	pixman_region32_copy(&ring->previous[ring->previous_idx], &ring->current);
+		pixman_region32_copy(&ring->previous[ring->previous_idx],
+			&ring->current);
+	}
 	pixman_region32_clear(&ring->current);
 }
 
+void wlr_damage_ring_set_rect_cost(struct wlr_damage_ring *ring,
+		uint32_t rect_cost) {
+	ring->rect_cost = rect_cost;
+}
+
+static int64_t box_area(const pixman_box32_t *box) {
+	return (int64_t)(box->x2 - box->x1) * (box->y2 - box->y1);
+}
+
+// Merges each rectangle with one of the few preceding ones if that is cheaper
+// than drawing it separately. Returns false if nothing was merged.
+static bool merge_rects(pixman_region32_t *region, int64_t rect_cost) {
+	int n_rects;
+	pixman_box32_t *rects = pixman_region32_rectangles(region, &n_rects);
+	if (n_rects <= 1) {
+		return false;
+	}
+
+	pixman_box32_t *boxes = calloc(n_rects, sizeof(boxes[0]));
+	if (boxes == NULL) {
+		return false;
+	}
+
+	int len = 0;
+	for (int i = 0; i < n_rects; i++) {
+		const pixman_box32_t *rect = &rects[i];
+
+		bool merged = false;
+		for (int j = len - 1; j >= 0 && j >= len - SIMPLIFY_WINDOW; j--) {
+			pixman_box32_t bbox = {
+				.x1 = rect->x1 < boxes[j].x1 ? rect->x1 : boxes[j].x1,
+				.y1 = rect->y1 < boxes[j].y1 ? rect->y1 : boxes[j].y1,
+				.x2 = rect->x2 > boxes[j].x2 ? rect->x2 : boxes[j].x2,
+				.y2 = rect->y2 > boxes[j].y2 ? rect->y2 : boxes[j].y2,
+			};
+			int64_t overdraw = box_area(&bbox) - box_area(&boxes[j]) -
+				box_area(rect);
+			if (overdraw < rect_cost) {
+				boxes[j] = bbox;
+				merged = true;
+				break;
+			}
+		}
+		if (!merged) {
+			boxes[len++] = *rect;
+		}
+	}
+
+	bool changed = len < n_rects;
+	if (changed) {
+		pixman_region32_fini(region);
+		pixman_region32_init_rects(region, boxes, len);
+	}
+
+	free(boxes);
+	return changed;
+}
+
+void wlr_damage_ring_simplify(struct wlr_damage_ring *ring,
+		pixman_region32_t *region) {
+	if (ring->rect_cost > 0) {
+		pixman_region32_t prev;
+		pixman_region32_init(&prev);
+
+		// Merged boxes may overlap, and get split again into several bands
+		// when turned back into a region: iterate until that stops paying off
+		for (int i = 0; i < SIMPLIFY_MAX_PASSES; i++) {
+			int n_rects = pixman_region32_n_rects(region);
+			pixman_region32_copy(&prev, region);
+			if (!merge_rects(region, ring->rect_cost)) {
+				break;
+			}
+			if (pixman_region32_n_rects(region) >= n_rects) {
+				pixman_region32_copy(region, &prev);
+				break;
+			}
+		}
+
+		pixman_region32_fini(&prev);
+	}
+
+	// Check the number of rectangles
+	int n_rects = pixman_region32_n_rects(region);
+	if (n_rects > WLR_DAMAGE_RING_MAX_RECTS) {
+		pixman_box32_t *extents = pixman_region32_extents(region);
+		pixman_region32_union_rect(region, region,
+			extents->x1, extents->y1,
+			extents->x2 - extents->x1,
+			extents->y2 - extents->y1);
+	}
+}
+
 void wlr_damage_ring_get_buffer_damage(struct wlr_damage_ring *ring,
 		int buffer_age, pixman_region32_t *damage) {
-	if (buffer_age <= 0 || buffer_age - 1 > WLR_DAMAGE_RING_PREVIOUS_LEN) {
+	if (buffer_age <= 0 || (size_t)buffer_age - 1 > ring->previous_len) {
 		pixman_region32_clear(damage);
 		pixman_region32_union_rect(damage, damage,
 			0, 0, ring->width, ring->height);
@@ -96,18 +227,10 @@ void wlr_damage_ring_get_buffer_damage(struct wlr_damage_ring *ring,
 
 		// Accumulate damage from old buffers
 		for (int i = 0; i < buffer_age - 1; ++i) {
-			int j = (ring->previous_idx + i) % WLR_DAMAGE_RING_PREVIOUS_LEN;
+			int j = (ring->previous_idx + i) % ring->previous_len;
 			pixman_region32_union(damage, damage, &ring->previous[j]);
 		}
 
-		// Check the number of rectangles
-		int n_rects = pixman_region32_n_rects(damage);
-		if (n_rects > WLR_DAMAGE_RING_MAX_RECTS) {
-			pixman_box32_t *extents = pixman_region32_extents(damage);
-			pixman_region32_union_rect(damage, damage,
-				extents->x1, extents->y1,
-				extents->x2 - extents->x1,
-				extents->y2 - extents->y1);
-		}
+		wlr_damage_ring_simplify(ring, damage);
 	}
 }
@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
@@ -149,6 +150,149 @@ void wlr_keyboard_notify_key(struct wlr_keyboard *keyboard,
 	keyboard_led_update(keyboard);
 }
 
+// Keep a few XKB keymaps per serialized keymap for pointer comparisons
+#define KEYMAP_MAX_XKB_KEYMAPS 8
+
+/**
+ * A serialized keymap, shared by all keyboards using the same keymap.
+ */
+struct keyboard_keymap {
+	char *string;
+	size_t size; // including the NUL terminator
+	uint64_t hash;
+	int fd; // read-only
+	// XKB keymaps known to serialize to this keymap, each referenced
+	struct xkb_keymap *xkb_keymaps[KEYMAP_MAX_XKB_KEYMAPS];
+	size_t xkb_keymaps_len;
+	int n_refs;
+	struct wl_list link; // keymap_cache
+};
+
+static struct wl_list keymap_cache = { &keymap_cache, &keymap_cache };
+
+static uint64_t keymap_hash(const char *data, size_t size) {
+	// FNV-1a
+	uint64_t hash = 0xcbf29ce484222325;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= (unsigned char)data[i];
+		hash *= 0x100000001b3;
+	}
+	return hash;
+}
+
+static struct keyboard_keymap *keymap_find_xkb(struct xkb_keymap *xkb_keymap) {
+	struct keyboard_keymap *keymap;
+	wl_list_for_each(keymap, &keymap_cache, link) {
+		for (size_t i = 0; i < keymap->xkb_keymaps_len; i++) {
+			if (keymap->xkb_keymaps[i] == xkb_keymap) {
+				return keymap;
+			}
+		}
+	}
+	return NULL;
+}
+
+static struct keyboard_keymap *keymap_create(char *string, size_t size,
+		uint64_t hash) {
+	struct keyboard_keymap *keymap = calloc(1, sizeof(*keymap));
+	if (keymap == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+
+	int rw_fd = -1, ro_fd = -1;
+	if (!allocate_shm_file_pair(size, &rw_fd, &ro_fd)) {
+		wlr_log(WLR_ERROR, "Failed to allocate shm file for keymap");
+		free(keymap);
+		return NULL;
+	}
+
+	void *dst = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, rw_fd, 0);
+	if (dst == MAP_FAILED) {
+		wlr_log_errno(WLR_ERROR, "mmap failed");
+		close(rw_fd);
+		close(ro_fd);
+		free(keymap);
+		return NULL;
+	}
+
+	memcpy(dst, string, size);
+	munmap(dst, size);
+	close(rw_fd);
+
+	keymap->string = string;
+	keymap->size = size;
+	keymap->hash = hash;
+	keymap->fd = ro_fd;
+	wl_list_insert(&keymap_cache, &keymap->link);
+	return keymap;
+}
+
+/**
+ * Get the shared serialized form of an XKB keymap. Only keymaps which aren't
+ * known yet are serialized.
+ */
+static struct keyboard_keymap *keymap_intern(struct xkb_keymap *xkb_keymap) {
+	struct keyboard_keymap *keymap = keymap_find_xkb(xkb_keymap);
+	if (keymap != NULL) {
+		keymap->n_refs++;
+		return keymap;
+	}
+
+	char *string = xkb_keymap_get_as_string(xkb_keymap,
+		XKB_KEYMAP_FORMAT_TEXT_V1);
+	if (string == NULL) {
+		wlr_log(WLR_ERROR, "Failed to get string version of keymap");
+		return NULL;
+	}
+	size_t size = strlen(string) + 1;
+	uint64_t hash = keymap_hash(string, size);
+
+	bool found = false;
+	wl_list_for_each(keymap, &keymap_cache, link) {
+		if (keymap->hash == hash && keymap->size == size &&
+				memcmp(keymap->string, string, size) == 0) {
+			found = true;
+			break;
+		}
+	}
+	if (found) {
+		free(string);
+	} else {
+		keymap = keymap_create(string, size, hash);
+		if (keymap == NULL) {
+			free(string);
+			return NULL;
+		}
+	}
+
+	if (keymap->xkb_keymaps_len < KEYMAP_MAX_XKB_KEYMAPS) {
+		keymap->xkb_keymaps[keymap->xkb_keymaps_len++] =
+			xkb_keymap_ref(xkb_keymap);
+	}
+	keymap->n_refs++;
+	return keymap;
+}
+
+static void keymap_unref(struct keyboard_keymap *keymap) {
+	if (keymap == NULL) {
+		return;
+	}
+	assert(keymap->n_refs > 0);
+	keymap->n_refs--;
+	if (keymap->n_refs > 0) {
+		return;
+	}
+
+	for (size_t i = 0; i < keymap->xkb_keymaps_len; i++) {
+		xkb_keymap_unref(keymap->xkb_keymaps[i]);
+	}
+	wl_list_remove(&keymap->link);
+	close(keymap->fd);
+	free(keymap->string);
+	free(keymap);
+}
+
 void wlr_keyboard_init(struct wlr_keyboard *kb,
 		const struct wlr_keyboard_impl *impl, const char *name) {
 	memset(kb, 0, sizeof(*kb));
@@ -186,10 +330,7 @@ void wlr_keyboard_finish(struct wlr_keyboard *kb) {
 	/* Finish xkbcommon resources */
 	xkb_state_unref(kb->xkb_state);
 	xkb_keymap_unref(kb->keymap);
-	free(kb->keymap_string);
-	if (kb->keymap_fd >= 0) {
-		close(kb->keymap_fd);
-	}
+	keymap_unref(kb->interned_keymap);
 }
 
 void wlr_keyboard_led_update(struct wlr_keyboard *kb, uint32_t leds) {
@@ -234,39 +375,15 @@ bool wlr_keyboard_set_keymap(struct wlr_keyboard *kb,
 		kb->mod_indexes[i] = xkb_map_mod_get_index(kb->keymap, mod_names[i]);
 	}
 
-	char *tmp_keymap_string = xkb_keymap_get_as_string(kb->keymap,
-		XKB_KEYMAP_FORMAT_TEXT_V1);
-	if (tmp_keymap_string == NULL) {
-		wlr_log(WLR_ERROR, "Failed to get string version of keymap");
-		goto err;
-	}
-	free(kb->keymap_string);
-	kb->keymap_string = tmp_keymap_string;
-	kb->keymap_size = strlen(kb->keymap_string) + 1;
-
-	int rw_fd = -1, ro_fd = -1;
-	if (!allocate_shm_file_pair(kb->keymap_size, &rw_fd, &ro_fd)) {
-		wlr_log(WLR_ERROR, "Failed to allocate shm file for keymap");
-		goto err;
-	}
-
-	void *dst = mmap(NULL, kb->keymap_size, PROT_READ | PROT_WRITE,
-		MAP_SHARED, rw_fd, 0);
-	if (dst == MAP_FAILED) {
-		wlr_log_errno(WLR_ERROR, "mmap failed");
-		close(rw_fd);
-		close(ro_fd);
+	struct keyboard_keymap *interned_keymap = keymap_intern(kb->keymap);
+	if (interned_keymap == NULL) {
 		goto err;
 	}
-
-	memcpy(dst, kb->keymap_string, kb->keymap_size);
-	munmap(dst, kb->keymap_size);
-	close(rw_fd);
-
-	if (kb->keymap_fd >= 0) {
-		close(kb->keymap_fd);
-	}
-	kb->keymap_fd = ro_fd;
+	keymap_unref(kb->interned_keymap);
+	kb->interned_keymap = interned_keymap;
+	kb->keymap_string = interned_keymap->string;
+	kb->keymap_size = interned_keymap->size;
+	kb->keymap_fd = interned_keymap->fd;
 
 	for (size_t i = 0; i < kb->num_keycodes; ++i) {
 		xkb_keycode_t keycode = kb->keycodes[i] + 8;
@@ -283,8 +400,11 @@ err:
 	kb->xkb_state = NULL;
 	xkb_keymap_unref(keymap);
 	kb->keymap = NULL;
-	free(kb->keymap_string);
+	keymap_unref(kb->interned_keymap);
+	kb->interned_keymap = NULL;
 	kb->keymap_string = NULL;
+	kb->keymap_size = 0;
+	kb->keymap_fd = -1;
 	return false;
 }
 
@@ -318,6 +438,14 @@ bool wlr_keyboard_keymaps_match(struct xkb_keymap *km1,
 	if (!km1 || !km2) {
 		return false;
 	}
+	if (km1 == km2) {
+		return true;
+	}
+	struct keyboard_keymap *interned1 = keymap_find_xkb(km1);
+	struct keyboard_keymap *interned2 = keymap_find_xkb(km2);
+	if (interned1 != NULL && interned2 != NULL) {
+		return interned1 == interned2;
+	}
 	char *km1_str = xkb_keymap_get_as_string(km1, XKB_KEYMAP_FORMAT_TEXT_V1);
 	char *km2_str = xkb_keymap_get_as_string(km2, XKB_KEYMAP_FORMAT_TEXT_V1);
 	bool result = strcmp(km1_str, km2_str) == 0;
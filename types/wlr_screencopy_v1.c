@@ -12,18 +12,40 @@
 #include <wlr/util/log.h>
 #include "wlr-screencopy-unstable-v1-protocol.h"
 #include "render/pixel_format.h"
+#include "render/wlr_renderer.h"
 #include "util/signal.h"
 
 #define SCREENCOPY_MANAGER_VERSION 3
 
 struct screencopy_damage {
 	struct wl_list link;
+	struct wlr_screencopy_v1_client *client;
 	struct wlr_output *output;
 	struct pixman_region32 damage;
 	struct wl_listener output_precommit;
 	struct wl_listener output_destroy;
 };
 
+/**
+ * A client buffer filled by a previous copy_with_damage request. The next copy
+ * into the same buffer only needs to write the damaged areas.
+ */
+struct screencopy_buffer {
+	struct wl_list link; // wlr_screencopy_v1_client.buffers
+	// Only one of these is set
+	struct wl_shm_buffer *shm_buffer;
+	struct wlr_dmabuf_v1_buffer *dma_buffer;
+
+	// Source of the buffer contents, NULL if unknown
+	struct wlr_output *output;
+	struct wlr_box box;
+	// Damage accumulated since the buffer was filled, output-buffer-local
+	// coordinates
+	struct pixman_region32 damage;
+
+	struct wl_listener resource_destroy;
+};
+
 static const struct zwlr_screencopy_frame_v1_interface frame_impl;
 
 static struct screencopy_damage *screencopy_damage_find(
@@ -40,11 +62,8 @@ static struct screencopy_damage *screencopy_damage_find(
 	return NULL;
 }
 
-static void screencopy_damage_accumulate(struct screencopy_damage *damage,
-		const struct wlr_output_state *state) {
-	struct pixman_region32 *region = &damage->damage;
-	struct wlr_output *output = damage->output;
-
+static void screencopy_damage_accumulate(struct pixman_region32 *region,
+		struct wlr_output *output, const struct wlr_output_state *state) {
 	if (state->committed & WLR_OUTPUT_STATE_DAMAGE) {
 		// If the compositor submitted damage, copy it over
 		pixman_region32_union(region, region,
@@ -64,10 +83,36 @@ static void screencopy_damage_handle_output_precommit(
 	struct screencopy_damage *damage =
 		wl_container_of(listener, damage, output_precommit);
 	const struct wlr_output_event_precommit *event = data;
-	screencopy_damage_accumulate(damage, event->state);
+	const struct wlr_output_state *state = event->state;
+	screencopy_damage_accumulate(&damage->damage, damage->output, state);
+
+	// Changes to the buffer layout aren't reflected in the damage
+	uint32_t invalidate = WLR_OUTPUT_STATE_ENABLED | WLR_OUTPUT_STATE_MODE |
+		WLR_OUTPUT_STATE_SCALE | WLR_OUTPUT_STATE_TRANSFORM |
+		WLR_OUTPUT_STATE_RENDER_FORMAT;
+	struct screencopy_buffer *buffer;
+	wl_list_for_each(buffer, &damage->client->buffers, link) {
+		if (buffer->output != damage->output) {
+			continue;
+		}
+		if (state->committed & invalidate) {
+			buffer->output = NULL;
+		} else {
+			screencopy_damage_accumulate(&buffer->damage, damage->output,
+				state);
+		}
+	}
 }
 
 static void screencopy_damage_destroy(struct screencopy_damage *damage) {
+	// Damage is no longer tracked for buffers filled from this output
+	struct screencopy_buffer *buffer;
+	wl_list_for_each(buffer, &damage->client->buffers, link) {
+		if (buffer->output == damage->output) {
+			buffer->output = NULL;
+		}
+	}
+
 	wl_list_remove(&damage->output_destroy.link);
 	wl_list_remove(&damage->output_precommit.link);
 	wl_list_remove(&damage->link);
@@ -91,6 +136,7 @@ static struct screencopy_damage *screencopy_damage_create(
 		return NULL;
 	}
 
+	damage->client = client;
 	damage->output = output;
 	pixman_region32_init_rect(&damage->damage, 0, 0, output->width,
 		output->height);
@@ -113,6 +159,110 @@ static struct screencopy_damage *screencopy_damage_get_or_create(
 	return damage ? damage : screencopy_damage_create(client, output);
 }
 
+static struct screencopy_buffer *screencopy_buffer_find(
+		struct wlr_screencopy_frame_v1 *frame) {
+	struct screencopy_buffer *buffer;
+	wl_list_for_each(buffer, &frame->client->buffers, link) {
+		if (buffer->shm_buffer == frame->shm_buffer &&
+				buffer->dma_buffer == frame->dma_buffer) {
+			return buffer;
+		}
+	}
+	return NULL;
+}
+
+static void screencopy_buffer_destroy(struct screencopy_buffer *buffer) {
+	wl_list_remove(&buffer->resource_destroy.link);
+	wl_list_remove(&buffer->link);
+	pixman_region32_fini(&buffer->damage);
+	free(buffer);
+}
+
+static void screencopy_buffer_handle_resource_destroy(
+		struct wl_listener *listener, void *data) {
+	struct screencopy_buffer *buffer =
+		wl_container_of(listener, buffer, resource_destroy);
+	screencopy_buffer_destroy(buffer);
+}
+
+static struct screencopy_buffer *screencopy_buffer_get_or_create(
+		struct wlr_screencopy_frame_v1 *frame, struct wl_resource *resource) {
+	struct screencopy_buffer *buffer = screencopy_buffer_find(frame);
+	if (buffer != NULL) {
+		return buffer;
+	}
+
+	buffer = calloc(1, sizeof(struct screencopy_buffer));
+	if (!buffer) {
+		return NULL;
+	}
+
+	buffer->shm_buffer = frame->shm_buffer;
+	buffer->dma_buffer = frame->dma_buffer;
+	pixman_region32_init(&buffer->damage);
+	wl_list_insert(&frame->client->buffers, &buffer->link);
+
+	wl_resource_add_destroy_listener(resource, &buffer->resource_destroy);
+	buffer->resource_destroy.notify =
+		screencopy_buffer_handle_resource_destroy;
+
+	return buffer;
+}
+
+/**
+ * Get the tracked buffer the frame will be copied into, if any.
+ */
+static struct screencopy_buffer *frame_get_buffer(
+		struct wlr_screencopy_frame_v1 *frame) {
+	return screencopy_buffer_find(frame);
+}
+
+/**
+ * Check whether the frame is a copy_with_damage request for which damage is
+ * accumulated, i.e. whether the buffer contents can be reused by a later copy.
+ */
+static bool frame_tracks_damage(struct wlr_screencopy_frame_v1 *frame) {
+	// Damage is only accumulated if the client has requested it before
+	return frame->with_damage &&
+		screencopy_damage_find(frame->client, frame->output) != NULL;
+}
+
+/**
+ * Get the part of the captured box which needs to be copied, in
+ * output-buffer-local coordinates. Only the damage is needed if the buffer
+ * already holds a previous frame of the same box.
+ */
+static void frame_get_copy_region(struct wlr_screencopy_frame_v1 *frame,
+		struct screencopy_buffer *buffer, pixman_region32_t *region) {
+	const struct wlr_box *box = &frame->box;
+	if (buffer != NULL && frame_tracks_damage(frame) &&
+			buffer->output == frame->output &&
+			buffer->box.x == box->x && buffer->box.y == box->y &&
+			buffer->box.width == box->width &&
+			buffer->box.height == box->height) {
+		pixman_region32_init(region);
+		pixman_region32_intersect_rect(region, &buffer->damage,
+			box->x, box->y, box->width, box->height);
+	} else {
+		pixman_region32_init_rect(region,
+			box->x, box->y, box->width, box->height);
+	}
+}
+
+/**
+ * Record what a copy wrote into a tracked buffer. Any copy other than a
+ * successful damage-tracked one leaves the buffer contents unknown.
+ */
+static void screencopy_buffer_update(struct screencopy_buffer *buffer,
+		struct wlr_screencopy_frame_v1 *frame, bool valid) {
+	if (buffer == NULL) {
+		return;
+	}
+	buffer->output = valid && frame_tracks_damage(frame) ? frame->output : NULL;
+	buffer->box = frame->box;
+	pixman_region32_clear(&buffer->damage);
+}
+
 static void client_unref(struct wlr_screencopy_v1_client *client) {
 	assert(client->ref > 0);
 
@@ -125,6 +275,11 @@ static void client_unref(struct wlr_screencopy_v1_client *client) {
 		screencopy_damage_destroy(damage);
 	}
 
+	struct screencopy_buffer *buffer, *tmp_buffer;
+	wl_list_for_each_safe(buffer, tmp_buffer, &client->buffers, link) {
+		screencopy_buffer_destroy(buffer);
+	}
+
 	free(client);
 }
 
@@ -204,75 +359,115 @@ static bool frame_shm_copy(struct wlr_screencopy_frame_v1 *frame,
 
 	enum wl_shm_format wl_shm_format = wl_shm_buffer_get_format(shm_buffer);
 	uint32_t drm_format = convert_wl_shm_format_to_drm(wl_shm_format);
-	int32_t width = wl_shm_buffer_get_width(shm_buffer);
-	int32_t height = wl_shm_buffer_get_height(shm_buffer);
 	int32_t stride = wl_shm_buffer_get_stride(shm_buffer);
 
-	wl_shm_buffer_begin_access(shm_buffer);
-	void *data = wl_shm_buffer_get_data(shm_buffer);
+	struct screencopy_buffer *buffer = frame_get_buffer(frame);
+	pixman_region32_t region;
+	frame_get_copy_region(frame, buffer, &region);
+
+	int rects_len;
+	const pixman_box32_t *rects =
+		pixman_region32_rectangles(&region, &rects_len);
+
 	uint32_t renderer_flags = 0;
-	bool ok;
-	ok = wlr_renderer_begin_with_buffer(renderer, src_buffer);
-	ok = ok && wlr_renderer_read_pixels(renderer, drm_format,
-		&renderer_flags, stride, width, height, x, y, 0, 0, data);
-	wlr_renderer_end(renderer);
+	bool ok = true;
+	if (rects_len > 0) {
+		wl_shm_buffer_begin_access(shm_buffer);
+		void *data = wl_shm_buffer_get_data(shm_buffer);
+		ok = wlr_renderer_begin_with_buffer(renderer, src_buffer);
+		for (int i = 0; ok && i < rects_len; i++) {
+			const pixman_box32_t *rect = &rects[i];
+			ok = wlr_renderer_read_pixels(renderer, drm_format,
+				&renderer_flags, stride, rect->x2 - rect->x1,
+				rect->y2 - rect->y1, rect->x1, rect->y1,
+				rect->x1 - x, rect->y1 - y, data);
+		}
+		wlr_renderer_end(renderer);
+		wl_shm_buffer_end_access(shm_buffer);
+	}
 	*flags = renderer_flags & WLR_RENDERER_READ_PIXELS_Y_INVERT ?
 		ZWLR_SCREENCOPY_FRAME_V1_FLAGS_Y_INVERT : 0;
-	wl_shm_buffer_end_access(shm_buffer);
+
+	pixman_region32_fini(&region);
+
+	// Rectangles can't be patched into a flipped image
+	screencopy_buffer_update(buffer, frame,
+		ok && !(renderer_flags & WLR_RENDERER_READ_PIXELS_Y_INVERT));
 
 	return ok;
 }
 
-static bool blit_dmabuf(struct wlr_renderer *renderer,
-		struct wlr_dmabuf_v1_buffer *dst_dmabuf,
-		struct wlr_buffer *src_buffer) {
-	struct wlr_buffer *dst_buffer = wlr_buffer_lock(&dst_dmabuf->base);
-
+static bool blit_buffer(struct wlr_renderer *renderer,
+		struct wlr_buffer *dst_buffer, struct wlr_buffer *src_buffer,
+		const struct wlr_box *src_box, pixman_region32_t *damage) {
 	struct wlr_texture *src_tex =
 		wlr_texture_from_buffer(renderer, src_buffer);
 	if (src_tex == NULL) {
-		goto error_src_tex;
+		return false;
 	}
 
+	struct wlr_fbox src_fbox = {
+		.x = src_box->x,
+		.y = src_box->y,
+		.width = src_box->width,
+		.height = src_box->height,
+	};
+
 	float mat[9];
 	wlr_matrix_identity(mat);
 	wlr_matrix_scale(mat, dst_buffer->width, dst_buffer->height);
 
 	if (!wlr_renderer_begin_with_buffer(renderer, dst_buffer)) {
-		goto error_renderer_begin;
+		wlr_texture_destroy(src_tex);
+		return false;
+	}
+
+	int rects_len;
+	const pixman_box32_t *rects = pixman_region32_rectangles(damage, &rects_len);
+	for (int i = 0; i < rects_len; i++) {
+		const pixman_box32_t *rect = &rects[i];
+		wlr_renderer_scissor(renderer, &(struct wlr_box){
+			.x = rect->x1,
+			.y = rect->y1,
+			.width = rect->x2 - rect->x1,
+			.height = rect->y2 - rect->y1,
+		});
+		wlr_renderer_clear(renderer, (float[]){ 0.0, 0.0, 0.0, 0.0 });
 	}
+	wlr_renderer_scissor(renderer, NULL);
 
-	wlr_renderer_clear(renderer, (float[]){ 0.0, 0.0, 0.0, 0.0 });
-	wlr_render_texture_with_matrix(renderer, src_tex, mat, 1.0f);
+	wlr_render_subtexture_with_matrix_region(renderer, src_tex, &src_fbox,
+		mat, 1.0f, damage);
 
 	wlr_renderer_end(renderer);
 
 	wlr_texture_destroy(src_tex);
-	wlr_buffer_unlock(dst_buffer);
 	return true;
-
-error_renderer_begin:
-	wlr_texture_destroy(src_tex);
-error_src_tex:
-	wlr_buffer_unlock(dst_buffer);
-	return false;
 }
 
 static bool frame_dma_copy(struct wlr_screencopy_frame_v1 *frame,
 		struct wlr_buffer *src_buffer) {
-	struct wlr_dmabuf_v1_buffer *dst_buffer = frame->dma_buffer;
+	struct wlr_buffer *dst_buffer = wlr_buffer_lock(&frame->dma_buffer->base);
 	struct wlr_output *output = frame->output;
 	struct wlr_renderer *renderer = output->renderer;
 	assert(renderer);
 
-	// TODO: add support for copying regions with DMA-BUFs
-	if (frame->box.x != 0 || frame->box.y != 0 ||
-			src_buffer->width != frame->box.width ||
-			src_buffer->height != frame->box.height) {
-		return false;
+	struct screencopy_buffer *buffer = frame_get_buffer(frame);
+	pixman_region32_t damage;
+	frame_get_copy_region(frame, buffer, &damage);
+	// The destination buffer only covers the captured box
+	pixman_region32_translate(&damage, -frame->box.x, -frame->box.y);
+
+	bool ok = true;
+	if (pixman_region32_not_empty(&damage)) {
+		ok = blit_buffer(renderer, dst_buffer, src_buffer, &frame->box,
+			&damage);
 	}
+	screencopy_buffer_update(buffer, frame, ok);
 
-	return blit_dmabuf(renderer, dst_buffer, src_buffer);
+	pixman_region32_fini(&damage);
+	wlr_buffer_unlock(dst_buffer);
+	return ok;
 }
 
 static void frame_handle_output_commit(struct wl_listener *listener,
@@ -434,6 +629,11 @@ static void frame_handle_copy(struct wl_client *wl_client,
 	frame->shm_buffer = shm_buffer;
 	frame->dma_buffer = dma_buffer;
 
+	if (frame->with_damage) {
+		// Start tracking the buffer, a full copy is needed the first time
+		screencopy_buffer_get_or_create(frame, buffer_resource);
+	}
+
 	wl_signal_add(&output->events.commit, &frame->output_commit);
 	frame->output_commit.notify = frame_handle_output_commit;
 
@@ -553,8 +753,12 @@ static void capture_output(struct wl_client *wl_client,
 	}
 
 	frame->format = convert_drm_format_to_wl_shm(drm_format);
+	// DMA-BUFs are blitted into, which needs a renderer able to render to
+	// them: the pixman renderer only handles data pointer buffers
 	if (output->allocator &&
-			(output->allocator->buffer_caps & WLR_BUFFER_CAP_DMABUF)) {
+			(output->allocator->buffer_caps & WLR_BUFFER_CAP_DMABUF) &&
+			(renderer_get_render_buffer_caps(renderer) &
+			WLR_BUFFER_CAP_DMABUF)) {
 		frame->fourcc = output->render_format;
 	} else {
 		frame->fourcc = DRM_FORMAT_INVALID;
@@ -667,6 +871,7 @@ static void manager_bind(struct wl_client *wl_client, void *data,
 	client->ref = 1;
 	client->manager = manager;
 	wl_list_init(&client->damages);
+	wl_list_init(&client->buffers);
 
 	wl_resource_set_implementation(resource, &manager_impl, client,
 		manager_handle_resource_destroy);
@@ -18,6 +18,17 @@ struct wlr_xcursor_manager *wlr_xcursor_manager_create(const char *name,
 	return manager;
 }
 
+struct wlr_xcursor_manager *wlr_xcursor_manager_create_lazy(const char *name,
+		uint32_t size, size_t memory_budget) {
+	struct wlr_xcursor_manager *manager = wlr_xcursor_manager_create(name, size);
+	if (manager == NULL) {
+		return NULL;
+	}
+	manager->lazy = true;
+	manager->memory_budget = memory_budget;
+	return manager;
+}
+
 void wlr_xcursor_manager_destroy(struct wlr_xcursor_manager *manager) {
 	if (manager == NULL) {
 		return;
@@ -46,7 +57,13 @@ bool wlr_xcursor_manager_load(struct wlr_xcursor_manager *manager,
 		return false;
 	}
 	theme->scale = scale;
-	theme->theme = wlr_xcursor_theme_load(manager->name, manager->size * scale);
+	if (manager->lazy) {
+		theme->theme = wlr_xcursor_theme_load_lazy(manager->name,
+			manager->size * scale, manager->memory_budget);
+	} else {
+		theme->theme = wlr_xcursor_theme_load(manager->name,
+			manager->size * scale);
+	}
 	if (theme->theme == NULL) {
 		free(theme);
 		return false;
@@ -0,0 +1,88 @@
+#include <stdlib.h>
+#include "util/hash_table.h"
+
+#define HASH_TABLE_MIN_BUCKETS 16
+
+static struct wl_list *get_bucket(struct wl_list *buckets, size_t buckets_len,
+		uint64_t key) {
+	// Keys are often sequential IDs or aligned pointers, mix the bits
+	uint64_t hash = key * 0x9e3779b97f4a7c15;
+	hash ^= hash >> 32;
+	return &buckets[hash & (buckets_len - 1)];
+}
+
+static bool resize(struct hash_table *table, size_t len) {
+	struct wl_list *buckets = calloc(len, sizeof(buckets[0]));
+	if (buckets == NULL) {
+		return false;
+	}
+	for (size_t i = 0; i < len; i++) {
+		wl_list_init(&buckets[i]);
+	}
+
+	for (size_t i = 0; i < table->buckets_len; i++) {
+		struct wl_list *link = table->buckets[i].next, *next;
+		while (link != &table->buckets[i]) {
+			next = link->next;
+			wl_list_remove(link);
+			wl_list_insert(get_bucket(buckets, len, table->get_key(link)),
+				link);
+			link = next;
+		}
+	}
+
+	free(table->buckets);
+	table->buckets = buckets;
+	table->buckets_len = len;
+	return true;
+}
+
+void hash_table_init(struct hash_table *table,
+		uint64_t (*get_key)(struct wl_list *link)) {
+	*table = (struct hash_table){ .get_key = get_key };
+}
+
+void hash_table_finish(struct hash_table *table) {
+	free(table->buckets);
+	table->buckets = NULL;
+	table->buckets_len = 0;
+	table->len = 0;
+}
+
+bool hash_table_insert(struct hash_table *table, struct wl_list *link) {
+	if (table->len >= table->buckets_len) {
+		size_t len = table->buckets_len * 2;
+		if (len < HASH_TABLE_MIN_BUCKETS) {
+			len = HASH_TABLE_MIN_BUCKETS;
+		}
+		// Keep using the current buckets if they can't be grown
+		if (!resize(table, len) && table->buckets_len == 0) {
+			return false;
+		}
+	}
+
+	wl_list_insert(get_bucket(table->buckets, table->buckets_len,
+		table->get_key(link)), link);
+	table->len++;
+	return true;
+}
+
+void hash_table_remove(struct hash_table *table, struct wl_list *link) {
+	wl_list_remove(link);
+	table->len--;
+}
+
+struct wl_list *hash_table_find(struct hash_table *table, uint64_t key) {
+	if (table->buckets_len == 0) {
+		return NULL;
+	}
+	struct wl_list *bucket =
+		get_bucket(table->buckets, table->buckets_len, key);
+	for (struct wl_list *link = bucket->next; link != bucket;
+			link = link->next) {
+		if (table->get_key(link) == key) {
+			return link;
+		}
+	}
+	return NULL;
+}
@@ -0,0 +1,269 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/util/input_latency.h>
+#include <wlr/util/log.h>
+#include "util/input_latency.h"
+#include "util/time.h"
+
+#define DEFAULT_ENV_LOG_INTERVAL 1000
+// Events sent to clients before an output commit
+#define MAX_FRAME_EVENTS 64
+// Output commits waiting to be presented
+#define MAX_PENDING_FRAMES 8
+// Events not presented after this delay didn't cause a new frame
+#define MAX_SCANOUT_NSEC 1000000000
+
+struct latency_frame {
+	struct wlr_output *output; // NULL if unused
+	uint32_t commit_seq;
+	size_t len;
+	int64_t send_nsec[MAX_FRAME_EVENTS];
+};
+
+static struct {
+	bool initialized;
+	bool enabled;
+	struct wlr_input_latency_histogram histograms[WLR_INPUT_LATENCY_STAGE_COUNT];
+
+	// Last event read by the backend
+	int64_t dispatch_nsec;
+	bool event_pending; // not sent to a client yet
+
+	// Events sent since the last output commit
+	struct latency_frame sent;
+	struct latency_frame frames[MAX_PENDING_FRAMES];
+
+	// Log histograms every log_interval events, set by WLR_INPUT_LATENCY
+	size_t log_interval;
+	size_t events_since_log;
+} latency;
+
+static const char *const stage_names[WLR_INPUT_LATENCY_STAGE_COUNT] = {
+	[WLR_INPUT_LATENCY_DISPATCH] = "dispatch",
+	[WLR_INPUT_LATENCY_HANDLING] = "handling",
+	[WLR_INPUT_LATENCY_SCANOUT] = "scanout",
+};
+
+static int64_t get_now_nsec(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return timespec_to_nsec(&now);
+}
+
+static void init_from_env(void) {
+	if (latency.initialized) {
+		return;
+	}
+	latency.initialized = true;
+
+	const char *str = getenv("WLR_INPUT_LATENCY");
+	if (str == NULL || strcmp(str, "0") == 0) {
+		return;
+	}
+
+	char *end;
+	errno = 0;
+	unsigned long interval = strtoul(str, &end, 10);
+	if (errno != 0 || *end != '\0' || end == str) {
+		wlr_log(WLR_ERROR, "Invalid WLR_INPUT_LATENCY value: '%s'", str);
+		return;
+	}
+	if (interval < 2) {
+		interval = DEFAULT_ENV_LOG_INTERVAL;
+	}
+
+	latency.enabled = true;
+	latency.log_interval = interval;
+}
+
+// Upper bound of the bucket containing the given quantile
+static uint64_t histogram_quantile(
+		const struct wlr_input_latency_histogram *histogram, int percent) {
+	uint64_t target = (histogram->count * percent + 99) / 100, n = 0;
+	for (size_t i = 0; i < WLR_INPUT_LATENCY_BUCKETS - 1; i++) {
+		n += histogram->buckets[i];
+		if (n >= target) {
+			return 2ull << i;
+		}
+	}
+	return histogram->max_usec;
+}
+
+static void log_histograms(void) {
+	for (size_t i = 0; i < WLR_INPUT_LATENCY_STAGE_COUNT; i++) {
+		const struct wlr_input_latency_histogram *histogram =
+			&latency.histograms[i];
+		if (histogram->count == 0) {
+			continue;
+		}
+		wlr_log(WLR_INFO, "Input latency: %-8s %8" PRIu64 " events, "
+			"mean %6.2f ms, p50 < %6.2f ms, p99 < %6.2f ms, max %6.2f ms",
+			stage_names[i], histogram->count,
+			histogram->total_usec / (double)histogram->count / 1e3,
+			histogram_quantile(histogram, 50) / 1e3,
+			histogram_quantile(histogram, 99) / 1e3,
+			histogram->max_usec / 1e3);
+	}
+}
+
+static void record(enum wlr_input_latency_stage stage, int64_t nsec) {
+	uint64_t usec = nsec > 0 ? (uint64_t)nsec / 1000 : 0;
+
+	size_t bucket = 0;
+	while (bucket < WLR_INPUT_LATENCY_BUCKETS - 1 && usec >= 2ull << bucket) {
+		bucket++;
+	}
+
+	struct wlr_input_latency_histogram *histogram = &latency.histograms[stage];
+	histogram->buckets[bucket]++;
+	histogram->count++;
+	histogram->total_usec += usec;
+	if (usec > histogram->max_usec) {
+		histogram->max_usec = usec;
+	}
+}
+
+void wlr_input_latency_set_enabled(bool enabled) {
+	init_from_env();
+	latency.enabled = enabled;
+	latency.event_pending = false;
+}
+
+void wlr_input_latency_get_histogram(enum wlr_input_latency_stage stage,
+		struct wlr_input_latency_histogram *histogram) {
+	*histogram = latency.histograms[stage];
+}
+
+void wlr_input_latency_reset(void) {
+	memset(latency.histograms, 0, sizeof(latency.histograms));
+	latency.events_since_log = 0;
+}
+
+bool input_latency_is_enabled(void) {
+	init_from_env();
+	return latency.enabled;
+}
+
+void input_latency_handle_dispatch(uint64_t time_usec) {
+	if (!input_latency_is_enabled()) {
+		return;
+	}
+
+	int64_t now = get_now_nsec();
+	record(WLR_INPUT_LATENCY_DISPATCH, now - (int64_t)time_usec * 1000);
+	latency.dispatch_nsec = now;
+	latency.event_pending = true;
+}
+
+void input_latency_handle_dispatch_done(void) {
+	latency.event_pending = false;
+}
+
+bool input_latency_take_event(int64_t *dispatch_nsec) {
+	if (!latency.enabled || !latency.event_pending) {
+		return false;
+	}
+	latency.event_pending = false;
+	*dispatch_nsec = latency.dispatch_nsec;
+	return true;
+}
+
+void input_latency_handle_send(void) {
+	int64_t dispatch_nsec;
+	if (input_latency_take_event(&dispatch_nsec)) {
+		input_latency_handle_delayed_send(dispatch_nsec);
+	}
+}
+
+void input_latency_handle_delayed_send(int64_t dispatch_nsec) {
+	if (!latency.enabled) {
+		return;
+	}
+
+	int64_t now = get_now_nsec();
+	record(WLR_INPUT_LATENCY_HANDLING, now - dispatch_nsec);
+	if (latency.sent.len < MAX_FRAME_EVENTS) {
+		latency.sent.send_nsec[latency.sent.len++] = now;
+	}
+
+	latency.events_since_log++;
+	if (latency.log_interval > 0 &&
+			latency.events_since_log >= latency.log_interval) {
+		log_histograms();
+		latency.events_since_log = 0;
+	}
+}
+
+void input_latency_handle_output_commit(struct wlr_output *output) {
+	if (!latency.enabled || latency.sent.len == 0) {
+		return;
+	}
+
+	// Events sent to a client don't tell which output will show the result,
+	// attribute them to the first output committing a new frame
+	for (size_t i = 0; i < MAX_PENDING_FRAMES; i++) {
+		struct latency_frame *frame = &latency.frames[i];
+		if (frame->output == NULL) {
+			*frame = latency.sent;
+			frame->output = output;
+			frame->commit_seq = output->commit_seq;
+			latency.sent.len = 0;
+			return;
+		}
+	}
+
+	// Too many frames in flight, the events will be attributed to a later
+	// commit
+}
+
+static void frame_handle_present(struct latency_frame *frame,
+		const struct wlr_output_event_present *event) {
+	if (event->presented && event->when != NULL) {
+		int64_t present_nsec = timespec_to_nsec(event->when);
+		for (size_t i = 0; i < frame->len; i++) {
+			int64_t delay = present_nsec - frame->send_nsec[i];
+			if (delay <= MAX_SCANOUT_NSEC) {
+				record(WLR_INPUT_LATENCY_SCANOUT, delay);
+			}
+		}
+	}
+	frame->len = 0;
+	frame->output = NULL;
+}
+
+void input_latency_handle_output_present(struct wlr_output *output,
+		const struct wlr_output_event_present *event) {
+	if (!latency.enabled) {
+		return;
+	}
+
+	if (event->commit_seq == output->commit_seq + 1) {
+		// Some backends send the event from within the commit
+		frame_handle_present(&latency.sent, event);
+		return;
+	}
+
+	for (size_t i = 0; i < MAX_PENDING_FRAMES; i++) {
+		struct latency_frame *frame = &latency.frames[i];
+		if (frame->output == output &&
+				frame->commit_seq == event->commit_seq) {
+			frame_handle_present(frame, event);
+			return;
+		}
+	}
+}
+
+void input_latency_handle_output_destroy(struct wlr_output *output) {
+	for (size_t i = 0; i < MAX_PENDING_FRAMES; i++) {
+		struct latency_frame *frame = &latency.frames[i];
+		if (frame->output == output) {
+			frame->len = 0;
+			frame->output = NULL;
+		}
+	}
+}
@@ -0,0 +1,603 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <wlr/util/log.h>
+#include <wlr/xcursor.h>
+#include "xcursor/cache.h"
+#include "xcursor/xcursor.h"
+
+/*
+ * Cache files are only ever read back by the machine which wrote them, so
+ * all fields use the native byte order. Offsets are relative to the start of
+ * the file and are aligned to CACHE_ALIGN. Bump CACHE_VERSION on any layout
+ * change.
+ */
+
+#define CACHE_MAGIC 0x43435857 // "WXCC"
+#define CACHE_VERSION 1
+#define CACHE_ALIGN 8
+#define CACHE_IMAGE_MAX_SIZE 0x7fff // same as Xcursor files
+
+struct cache_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t file_size;
+	uint32_t size; // nominal cursor size
+	uint32_t theme_offset; // string
+	uint32_t library_path_offset; // string
+	uint32_t sources_offset, sources_len; // struct cache_source[]
+	uint32_t cursors_offset, cursors_len; // struct cache_cursor[], by name
+};
+
+struct cache_source {
+	int64_t mtime_sec, mtime_nsec;
+	uint32_t path_offset; // string
+	uint32_t exists;
+};
+
+struct cache_cursor {
+	uint32_t name_offset; // string
+	uint32_t images_offset, images_len; // struct cache_image[]
+	uint32_t pad;
+};
+
+struct cache_image {
+	uint32_t width, height;
+	uint32_t hotspot_x, hotspot_y;
+	uint32_t delay;
+	uint32_t pixels_offset; // ARGB8888, width * height * 4 bytes
+};
+
+struct xcursor_cache {
+	const uint8_t *data;
+	size_t size;
+	const struct cache_header *header;
+};
+
+static bool cache_enabled(void) {
+	const char *env = getenv("WLR_XCURSOR_CACHE");
+	return env == NULL || strcmp(env, "0") != 0;
+}
+
+static bool is_valid_theme_name(const char *theme) {
+	return theme[0] != '\0' && theme[0] != '.' && strchr(theme, '/') == NULL;
+}
+
+/**
+ * Get the path of the cache directory, and create it if requested.
+ */
+static char *get_cache_dir(bool create) {
+	const char *cache_home = getenv("XDG_CACHE_HOME");
+	char *base = NULL;
+	if (cache_home != NULL && cache_home[0] == '/') {
+		base = strdup(cache_home);
+	} else {
+		const char *home = getenv("HOME");
+		if (home == NULL || home[0] != '/') {
+			return NULL;
+		}
+		size_t len = strlen(home) + strlen("/.cache") + 1;
+		base = malloc(len);
+		if (base != NULL) {
+			snprintf(base, len, "%s/.cache", home);
+		}
+	}
+	if (base == NULL) {
+		return NULL;
+	}
+
+	size_t len = strlen(base) + strlen("/wlroots/xcursor") + 1;
+	char *dir = malloc(len);
+	if (dir == NULL) {
+		free(base);
+		return NULL;
+	}
+
+	if (create) {
+		snprintf(dir, len, "%s/wlroots", base);
+		const char *dirs[] = { base, dir };
+		for (size_t i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++) {
+			if (mkdir(dirs[i], 0755) != 0 && errno != EEXIST) {
+				wlr_log_errno(WLR_DEBUG, "Failed to create %s", dirs[i]);
+				free(dir);
+				free(base);
+				return NULL;
+			}
+		}
+	}
+
+	snprintf(dir, len, "%s/wlroots/xcursor", base);
+	free(base);
+
+	if (create && mkdir(dir, 0755) != 0 && errno != EEXIST) {
+		wlr_log_errno(WLR_DEBUG, "Failed to create %s", dir);
+		free(dir);
+		return NULL;
+	}
+
+	return dir;
+}
+
+static char *get_cache_path(const char *theme, int size, bool create) {
+	if (!is_valid_theme_name(theme)) {
+		return NULL;
+	}
+
+	char *dir = get_cache_dir(create);
+	if (dir == NULL) {
+		return NULL;
+	}
+
+	int len = snprintf(NULL, 0, "%s/%s-%d", dir, theme, size);
+	char *path = malloc(len + 1);
+	if (path != NULL) {
+		snprintf(path, len + 1, "%s/%s-%d", dir, theme, size);
+	}
+	free(dir);
+	return path;
+}
+
+static bool get_mtime(const char *path, struct timespec *mtime) {
+	struct stat st;
+	if (stat(path, &st) != 0) {
+		*mtime = (struct timespec){0};
+		return false;
+	}
+	*mtime = st.st_mtim;
+	return true;
+}
+
+static const void *cache_get(struct xcursor_cache *cache, uint32_t offset,
+		size_t elem_size, uint32_t len) {
+	if (offset % CACHE_ALIGN != 0 || offset > cache->size ||
+			len > (cache->size - offset) / elem_size) {
+		return NULL;
+	}
+	return cache->data + offset;
+}
+
+static const char *cache_get_string(struct xcursor_cache *cache,
+		uint32_t offset) {
+	if (offset >= cache->size ||
+			memchr(cache->data + offset, '\0', cache->size - offset) == NULL) {
+		return NULL;
+	}
+	return (const char *)cache->data + offset;
+}
+
+static bool cache_check(struct xcursor_cache *cache, const char *theme,
+		int size) {
+	const struct cache_header *header = cache->header;
+	if (header->magic != CACHE_MAGIC || header->version != CACHE_VERSION ||
+			header->file_size != cache->size || header->size != (uint32_t)size) {
+		return false;
+	}
+
+	const char *cache_theme = cache_get_string(cache, header->theme_offset);
+	if (cache_theme == NULL || strcmp(cache_theme, theme) != 0) {
+		return false;
+	}
+
+	// Themes are looked up in a different set of directories
+	const char *library_path =
+		cache_get_string(cache, header->library_path_offset);
+	char *current_library_path = xcursor_library_path();
+	bool same_library_path = library_path != NULL &&
+		current_library_path != NULL &&
+		strcmp(library_path, current_library_path) == 0;
+	free(current_library_path);
+	if (!same_library_path) {
+		return false;
+	}
+
+	// Cursors or inherited themes have been added, removed or changed
+	const struct cache_source *sources = cache_get(cache,
+		header->sources_offset, sizeof(*sources), header->sources_len);
+	if (sources == NULL) {
+		return false;
+	}
+	for (uint32_t i = 0; i < header->sources_len; i++) {
+		const struct cache_source *source = &sources[i];
+		const char *path = cache_get_string(cache, source->path_offset);
+		if (path == NULL) {
+			return false;
+		}
+		struct timespec mtime;
+		bool exists = get_mtime(path, &mtime);
+		if (exists != (source->exists != 0) ||
+				mtime.tv_sec != source->mtime_sec ||
+				mtime.tv_nsec != source->mtime_nsec) {
+			return false;
+		}
+	}
+
+	return cache_get(cache, header->cursors_offset,
+		sizeof(struct cache_cursor), header->cursors_len) != NULL;
+}
+
+struct xcursor_cache *xcursor_cache_open(const char *theme, int size) {
+	if (!cache_enabled()) {
+		return NULL;
+	}
+
+	char *path = get_cache_path(theme, size, false);
+	if (path == NULL) {
+		return NULL;
+	}
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		free(path);
+		return NULL;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct cache_header) ||
+			(uint64_t)st.st_size > UINT32_MAX) {
+		close(fd);
+		free(path);
+		return NULL;
+	}
+
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		wlr_log_errno(WLR_ERROR, "Failed to map %s", path);
+		free(path);
+		return NULL;
+	}
+
+	struct xcursor_cache *cache = calloc(1, sizeof(*cache));
+	if (cache == NULL) {
+		munmap(data, st.st_size);
+		free(path);
+		return NULL;
+	}
+	cache->data = data;
+	cache->size = st.st_size;
+	cache->header = data;
+
+	if (!cache_check(cache, theme, size)) {
+		wlr_log(WLR_DEBUG, "Ignoring outdated cursor cache %s", path);
+		xcursor_cache_destroy(cache);
+		free(path);
+		return NULL;
+	}
+
+	wlr_log(WLR_DEBUG, "Using cursor cache %s (%"PRIu32" cursors)", path,
+		cache->header->cursors_len);
+	free(path);
+	return cache;
+}
+
+void xcursor_cache_destroy(struct xcursor_cache *cache) {
+	if (cache == NULL) {
+		return;
+	}
+	munmap((void *)cache->data, cache->size);
+	free(cache);
+}
+
+static const struct cache_cursor *cache_find_cursor(
+		struct xcursor_cache *cache, const char *name) {
+	const struct cache_header *header = cache->header;
+	const struct cache_cursor *cursors = cache_get(cache,
+		header->cursors_offset, sizeof(*cursors), header->cursors_len);
+	if (cursors == NULL) {
+		return NULL;
+	}
+
+	uint32_t lo = 0, hi = header->cursors_len;
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		const char *mid_name = cache_get_string(cache, cursors[mid].name_offset);
+		if (mid_name == NULL) {
+			return NULL;
+		}
+		int cmp = strcmp(name, mid_name);
+		if (cmp == 0) {
+			return &cursors[mid];
+		} else if (cmp < 0) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+	return NULL;
+}
+
+static void xcursor_destroy_partial(struct wlr_xcursor *cursor,
+		unsigned int images_len) {
+	for (unsigned int i = 0; i < images_len; i++) {
+		free(cursor->images[i]->buffer);
+		free(cursor->images[i]);
+	}
+	free(cursor->images);
+	free(cursor->name);
+	free(cursor);
+}
+
+struct wlr_xcursor *xcursor_cache_load_cursor(struct xcursor_cache *cache,
+		const char *name) {
+	const struct cache_cursor *cache_cursor = cache_find_cursor(cache, name);
+	if (cache_cursor == NULL) {
+		return NULL;
+	}
+
+	const struct cache_image *cache_images = cache_get(cache,
+		cache_cursor->images_offset, sizeof(*cache_images),
+		cache_cursor->images_len);
+	if (cache_images == NULL || cache_cursor->images_len == 0) {
+		return NULL;
+	}
+
+	struct wlr_xcursor *cursor = calloc(1, sizeof(*cursor));
+	if (cursor == NULL) {
+		return NULL;
+	}
+	cursor->name = strdup(name);
+	cursor->images = calloc(cache_cursor->images_len, sizeof(cursor->images[0]));
+	if (cursor->name == NULL || cursor->images == NULL) {
+		xcursor_destroy_partial(cursor, 0);
+		return NULL;
+	}
+
+	for (uint32_t i = 0; i < cache_cursor->images_len; i++) {
+		const struct cache_image *cache_image = &cache_images[i];
+		if (cache_image->width > CACHE_IMAGE_MAX_SIZE ||
+				cache_image->height > CACHE_IMAGE_MAX_SIZE) {
+			xcursor_destroy_partial(cursor, i);
+			return NULL;
+		}
+
+		size_t size = (size_t)cache_image->width * cache_image->height * 4;
+		const void *pixels = cache_get(cache, cache_image->pixels_offset,
+			4, cache_image->width * cache_image->height);
+		struct wlr_xcursor_image *image = calloc(1, sizeof(*image));
+		if (pixels == NULL || image == NULL) {
+			free(image);
+			xcursor_destroy_partial(cursor, i);
+			return NULL;
+		}
+		image->buffer = malloc(size);
+		if (image->buffer == NULL) {
+			free(image);
+			xcursor_destroy_partial(cursor, i);
+			return NULL;
+		}
+		memcpy(image->buffer, pixels, size);
+
+		image->width = cache_image->width;
+		image->height = cache_image->height;
+		image->hotspot_x = cache_image->hotspot_x;
+		image->hotspot_y = cache_image->hotspot_y;
+		image->delay = cache_image->delay;
+
+		cursor->images[i] = image;
+		cursor->total_delay += image->delay;
+	}
+	cursor->image_count = cache_cursor->images_len;
+
+	return cursor;
+}
+
+void xcursor_cache_add_source(struct wl_array *sources, const char *path) {
+	struct xcursor_cache_source *source = wl_array_add(sources, sizeof(*source));
+	if (source == NULL) {
+		return;
+	}
+	source->path = strdup(path);
+	source->exists = get_mtime(path, &source->mtime);
+	if (source->path == NULL) {
+		sources->size -= sizeof(*source);
+	}
+}
+
+void xcursor_cache_sources_finish(struct wl_array *sources) {
+	struct xcursor_cache_source *source;
+	wl_array_for_each(source, sources) {
+		free(source->path);
+	}
+	wl_array_release(sources);
+}
+
+/**
+ * Append data to the cache file contents, and return its offset.
+ */
+static uint32_t buf_append(struct wl_array *buf, const void *data, size_t size,
+		bool *ok) {
+	size_t padding = (CACHE_ALIGN - buf->size % CACHE_ALIGN) % CACHE_ALIGN;
+	if (buf->size + padding + size > UINT32_MAX) {
+		*ok = false;
+		return 0;
+	}
+
+	uint8_t *dst = wl_array_add(buf, padding + size);
+	if (dst == NULL) {
+		*ok = false;
+		return 0;
+	}
+	memset(dst, 0, padding);
+	if (size > 0) {
+		memcpy(dst + padding, data, size);
+	}
+	return buf->size - size;
+}
+
+static uint32_t buf_append_string(struct wl_array *buf, const char *str,
+		bool *ok) {
+	return buf_append(buf, str, strlen(str) + 1, ok);
+}
+
+static int compare_cursors(const void *a, const void *b) {
+	const struct wlr_xcursor *cursor_a = *(struct wlr_xcursor *const *)a;
+	const struct wlr_xcursor *cursor_b = *(struct wlr_xcursor *const *)b;
+	return strcmp(cursor_a->name, cursor_b->name);
+}
+
+static bool write_file(const char *path, const void *data, size_t size) {
+	size_t tmp_len = strlen(path) + strlen(".XXXXXX") + 1;
+	char *tmp_path = malloc(tmp_len);
+	if (tmp_path == NULL) {
+		return false;
+	}
+	snprintf(tmp_path, tmp_len, "%s.XXXXXX", path);
+
+	// Write to a temporary file first, so that readers never see a partial
+	// file
+	int fd = mkstemp(tmp_path);
+	if (fd < 0) {
+		wlr_log_errno(WLR_DEBUG, "Failed to create %s", tmp_path);
+		free(tmp_path);
+		return false;
+	}
+
+	const uint8_t *p = data;
+	size_t left = size;
+	while (left > 0) {
+		ssize_t n = write(fd, p, left);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		} else if (n <= 0) {
+			wlr_log_errno(WLR_DEBUG, "Failed to write %s", tmp_path);
+			close(fd);
+			unlink(tmp_path);
+			free(tmp_path);
+			return false;
+		}
+		p += n;
+		left -= n;
+	}
+
+	bool ok = fchmod(fd, 0644) == 0;
+	ok = close(fd) == 0 && ok;
+	ok = ok && rename(tmp_path, path) == 0;
+	if (!ok) {
+		wlr_log_errno(WLR_DEBUG, "Failed to write %s", path);
+		unlink(tmp_path);
+	}
+	free(tmp_path);
+	return ok;
+}
+
+bool xcursor_cache_write(const char *theme, int size,
+		struct wlr_xcursor **cursors, unsigned int cursors_len,
+		const struct wl_array *sources) {
+	if (!cache_enabled()) {
+		return false;
+	}
+
+	char *path = get_cache_path(theme, size, true);
+	if (path == NULL) {
+		return false;
+	}
+
+	char *library_path = xcursor_library_path();
+	struct wlr_xcursor **sorted = calloc(cursors_len, sizeof(sorted[0]));
+	struct cache_cursor *cache_cursors =
+		calloc(cursors_len, sizeof(cache_cursors[0]));
+	size_t sources_len = sources->size / sizeof(struct xcursor_cache_source);
+	struct cache_source *cache_sources =
+		calloc(sources_len, sizeof(cache_sources[0]));
+	struct cache_image *cache_images = NULL;
+
+	struct wl_array buf;
+	wl_array_init(&buf);
+	bool ok = library_path != NULL && (cursors_len == 0 ||
+		(sorted != NULL && cache_cursors != NULL)) &&
+		(sources_len == 0 || cache_sources != NULL);
+	if (!ok) {
+		goto out;
+	}
+
+	struct cache_header header = {
+		.magic = CACHE_MAGIC,
+		.version = CACHE_VERSION,
+		.size = size,
+		.sources_len = sources_len,
+		.cursors_len = cursors_len,
+	};
+	// Filled in last
+	buf_append(&buf, &header, sizeof(header), &ok);
+
+	header.theme_offset = buf_append_string(&buf, theme, &ok);
+	header.library_path_offset = buf_append_string(&buf, library_path, &ok);
+
+	size_t i = 0;
+	const struct xcursor_cache_source *source;
+	wl_array_for_each(source, sources) {
+		cache_sources[i++] = (struct cache_source){
+			.path_offset = buf_append_string(&buf, source->path, &ok),
+			.exists = source->exists,
+			.mtime_sec = source->mtime.tv_sec,
+			.mtime_nsec = source->mtime.tv_nsec,
+		};
+	}
+	header.sources_offset = buf_append(&buf, cache_sources,
+		sources_len * sizeof(cache_sources[0]), &ok);
+
+	// Cursors are sorted by name for lookups
+	memcpy(sorted, cursors, cursors_len * sizeof(sorted[0]));
+	qsort(sorted, cursors_len, sizeof(sorted[0]), compare_cursors);
+
+	for (i = 0; ok && i < cursors_len; i++) {
+		struct wlr_xcursor *cursor = sorted[i];
+		cache_images = calloc(cursor->image_count, sizeof(cache_images[0]));
+		if (cache_images == NULL) {
+			ok = false;
+			break;
+		}
+		for (unsigned int j = 0; j < cursor->image_count; j++) {
+			struct wlr_xcursor_image *image = cursor->images[j];
+			cache_images[j] = (struct cache_image){
+				.width = image->width,
+				.height = image->height,
+				.hotspot_x = image->hotspot_x,
+				.hotspot_y = image->hotspot_y,
+				.delay = image->delay,
+				.pixels_offset = buf_append(&buf, image->buffer,
+					(size_t)image->width * image->height * 4, &ok),
+			};
+		}
+		cache_cursors[i] = (struct cache_cursor){
+			.name_offset = buf_append_string(&buf, cursor->name, &ok),
+			.images_offset = buf_append(&buf, cache_images,
+				cursor->image_count * sizeof(cache_images[0]), &ok),
+			.images_len = cursor->image_count,
+		};
+		free(cache_images);
+		cache_images = NULL;
+	}
+	header.cursors_offset = buf_append(&buf, cache_cursors,
+		cursors_len * sizeof(cache_cursors[0]), &ok);
+
+	if (!ok) {
+		goto out;
+	}
+
+	header.file_size = buf.size;
+	memcpy(buf.data, &header, sizeof(header));
+
+	ok = write_file(path, buf.data, buf.size);
+	if (ok) {
+		wlr_log(WLR_DEBUG, "Wrote cursor cache %s (%u cursors)", path,
+			cursors_len);
+	}
+
+out:
+	wl_array_release(&buf);
+	free(cache_images);
+	free(cache_sources);
+	free(cache_cursors);
+	free(sorted);
+	free(library_path);
+	free(path);
+	return ok;
+}
@@ -30,6 +30,7 @@
 #include <string.h>
 #include <wlr/util/log.h>
 #include <wlr/xcursor.h>
+#include "xcursor/cache.h"
 #include "xcursor/xcursor.h"
 
 static void xcursor_destroy(struct wlr_xcursor *cursor) {
@@ -184,8 +185,40 @@ static struct wlr_xcursor *xcursor_create_from_xcursor_images(
 	return cursor;
 }
 
+/**
+ * A cursor file of a lazily loaded theme. A name may have several entries,
+ * one per theme providing it, in lookup order.
+ */
+struct xcursor_index_entry {
+	char *name;
+	char *path; // NULL if the file failed to load
+};
+
+struct load_context {
+	struct wlr_xcursor_theme *theme;
+	struct wl_array sources; // struct xcursor_cache_source
+};
+
+static bool theme_add_cursor(struct wlr_xcursor_theme *theme,
+		struct wlr_xcursor *cursor) {
+	struct wlr_xcursor **cursors = realloc(theme->cursors,
+		(theme->cursor_count + 1) * sizeof(theme->cursors[0]));
+	if (cursors == NULL) {
+		return false;
+	}
+	theme->cursors = cursors;
+	theme->cursors[theme->cursor_count++] = cursor;
+	return true;
+}
+
+static void path_callback(const char *path, void *data) {
+	struct load_context *ctx = data;
+	xcursor_cache_add_source(&ctx->sources, path);
+}
+
 static void load_callback(XcursorImages *images, void *data) {
-	struct wlr_xcursor_theme *theme = data;
+	struct load_context *ctx = data;
+	struct wlr_xcursor_theme *theme = ctx->theme;
 	struct wlr_xcursor *cursor;
 
 	if (wlr_xcursor_theme_get_cursor(theme, images->name)) {
@@ -195,46 +228,56 @@ static void load_callback(XcursorImages *images, void *data) {
 
 	cursor = xcursor_create_from_xcursor_images(images, theme);
 
-	if (cursor) {
-		struct wlr_xcursor **cursors;
-		theme->cursor_count++;
-		cursors =
-			realloc(theme->cursors,
-				theme->cursor_count * sizeof(theme->cursors[0]));
-
-		if (cursors == NULL) {
-			theme->cursor_count--;
-			free(cursor);
-		} else {
-			theme->cursors = cursors;
-			theme->cursors[theme->cursor_count - 1] = cursor;
-		}
+	if (cursor && !theme_add_cursor(theme, cursor)) {
+		xcursor_destroy(cursor);
 	}
 
 	XcursorImagesDestroy(images);
 }
 
-struct wlr_xcursor_theme *wlr_xcursor_theme_load(const char *name, int size) {
-	struct wlr_xcursor_theme *theme;
-
-	theme = malloc(sizeof(*theme));
+static struct wlr_xcursor_theme *theme_create(const char *name, int size) {
+	struct wlr_xcursor_theme *theme = calloc(1, sizeof(*theme));
 	if (!theme) {
 		return NULL;
 	}
 
+	theme->name = strdup(name);
+	if (!theme->name) {
+		free(theme);
+		return NULL;
+	}
+	theme->size = size;
+
+	return theme;
+}
+
+struct wlr_xcursor_theme *wlr_xcursor_theme_load(const char *name, int size) {
+	struct wlr_xcursor_theme *theme;
+
 	if (!name) {
 		name = "default";
 	}
 
-	theme->name = strdup(name);
-	if (!theme->name) {
-		goto out_error_name;
+	theme = theme_create(name, size);
+	if (!theme) {
+		return NULL;
+	}
+
+	theme->cache = xcursor_cache_open(name, size);
+	if (theme->cache != NULL) {
+		wlr_log(WLR_DEBUG, "Loaded cursor theme '%s' at size %d from cache",
+				theme->name, size);
+		return theme;
 	}
-	theme->size = size;
-	theme->cursor_count = 0;
-	theme->cursors = NULL;
 
-	xcursor_load_theme(name, size, load_callback, theme);
+	struct load_context ctx = { .theme = theme };
+	wl_array_init(&ctx.sources);
+	xcursor_load_theme(name, size, load_callback, path_callback, &ctx);
+	if (theme->cursor_count > 0) {
+		xcursor_cache_write(name, size, theme->cursors, theme->cursor_count,
+			&ctx.sources);
+	}
+	xcursor_cache_sources_finish(&ctx.sources);
 
 	if (theme->cursor_count == 0) {
 		load_default_theme(theme);
@@ -244,12 +287,118 @@ struct wlr_xcursor_theme *wlr_xcursor_theme_load(const char *name, int size) {
 			theme->name, size, theme->cursor_count);
 
 	return theme;
+}
 
-out_error_name:
-	free(theme);
+static void index_callback(const char *name, const char *path, void *data) {
+	struct wlr_xcursor_theme *theme = data;
+
+	// Keep every file providing a cursor: like the eager loader, fall back to
+	// the next theme if the first file can't be loaded
+	struct xcursor_index_entry *index = realloc(theme->index,
+		(theme->index_len + 1) * sizeof(theme->index[0]));
+	if (index == NULL) {
+		return;
+	}
+	theme->index = index;
+
+	struct xcursor_index_entry *entry = &theme->index[theme->index_len];
+	entry->name = strdup(name);
+	entry->path = strdup(path);
+	if (entry->name == NULL || entry->path == NULL) {
+		free(entry->name);
+		free(entry->path);
+		return;
+	}
+	theme->index_len++;
+}
+
+static struct wlr_xcursor *theme_load_indexed_cursor(
+		struct wlr_xcursor_theme *theme, const char *name) {
+	for (size_t i = 0; i < theme->index_len; i++) {
+		struct xcursor_index_entry *entry = &theme->index[i];
+		if (entry->path == NULL || strcmp(entry->name, name) != 0) {
+			continue;
+		}
+
+		struct wlr_xcursor *cursor = NULL;
+		XcursorImages *images =
+			xcursor_load_file(entry->path, entry->name, theme->size);
+		if (images != NULL) {
+			cursor = xcursor_create_from_xcursor_images(images, theme);
+			XcursorImagesDestroy(images);
+		}
+		if (cursor != NULL) {
+			return cursor;
+		}
+
+		// Don't try this file again, e.g. it's a dangling symlink
+		free(entry->path);
+		entry->path = NULL;
+	}
 	return NULL;
 }
 
+struct wlr_xcursor_theme *wlr_xcursor_theme_load_lazy(const char *name,
+		int size, size_t memory_budget) {
+	if (!name) {
+		name = "default";
+	}
+
+	struct wlr_xcursor_theme *theme = theme_create(name, size);
+	if (!theme) {
+		return NULL;
+	}
+	theme->memory_budget = memory_budget;
+
+	theme->cache = xcursor_cache_open(name, size);
+	if (theme->cache != NULL) {
+		wlr_log(WLR_DEBUG, "Loaded cursor theme '%s' at size %d from cache",
+				theme->name, size);
+		return theme;
+	}
+
+	xcursor_index_theme(name, index_callback, NULL, theme);
+	if (theme->index_len == 0) {
+		load_default_theme(theme);
+	}
+
+	wlr_log(WLR_DEBUG, "Indexed cursor theme '%s' at size %d (%zu cursor files)",
+			theme->name, size, theme->index_len);
+
+	return theme;
+}
+
+static size_t xcursor_get_memory_size(struct wlr_xcursor *cursor) {
+	size_t size = 0;
+	for (unsigned int i = 0; i < cursor->image_count; i++) {
+		struct wlr_xcursor_image *image = cursor->images[i];
+		size += (size_t)image->width * image->height * 4;
+	}
+	return size;
+}
+
+/**
+ * Unload the least recently used cursors until the memory budget is met. The
+ * most recently used cursor is always kept.
+ */
+static void theme_evict_cursors(struct wlr_xcursor_theme *theme) {
+	if (theme->memory_budget == 0) {
+		return;
+	}
+
+	unsigned int evicted = 0;
+	while (theme->memory_used > theme->memory_budget &&
+			theme->cursor_count - evicted > 1) {
+		struct wlr_xcursor *cursor = theme->cursors[evicted++];
+		theme->memory_used -= xcursor_get_memory_size(cursor);
+		xcursor_destroy(cursor);
+	}
+
+	theme->cursor_count -= evicted;
+	memmove(theme->cursors, theme->cursors + evicted,
+		theme->cursor_count * sizeof(theme->cursors[0]));
+}
+
 void wlr_xcursor_theme_destroy(struct wlr_xcursor_theme *theme) {
 	unsigned int i;
 
@@ -257,6 +406,13 @@ void wlr_xcursor_theme_destroy(struct wlr_xcursor_theme *theme) {
 		xcursor_destroy(theme->cursors[i]);
 	}
 
+	for (size_t i = 0; i < theme->index_len; i++) {
+		free(theme->index[i].name);
+		free(theme->index[i].path);
+	}
+	free(theme->index);
+
+	xcursor_cache_destroy(theme->cache);
 	free(theme->name);
 	free(theme->cursors);
 	free(theme);
@@ -267,12 +423,36 @@ struct wlr_xcursor *wlr_xcursor_theme_get_cursor(struct wlr_xcursor_theme *theme
 	unsigned int i;
 
 	for (i = 0; i < theme->cursor_count; i++) {
-		if (strcmp(name, theme->cursors[i]->name) == 0) {
-			return theme->cursors[i];
+		struct wlr_xcursor *cursor = theme->cursors[i];
+		if (strcmp(name, cursor->name) != 0) {
+			continue;
 		}
+		if (theme->memory_budget != 0) {
+			// Keep cursors sorted from least to most recently used
+			memmove(&theme->cursors[i], &theme->cursors[i + 1],
+				(theme->cursor_count - i - 1) * sizeof(theme->cursors[0]));
+			theme->cursors[theme->cursor_count - 1] = cursor;
+		}
+		return cursor;
 	}
 
-	return NULL;
+	struct wlr_xcursor *cursor = NULL;
+	if (theme->cache != NULL) {
+		cursor = xcursor_cache_load_cursor(theme->cache, name);
+	} else {
+		cursor = theme_load_indexed_cursor(theme, name);
+	}
+	if (cursor == NULL) {
+		return NULL;
+	}
+
+	if (!theme_add_cursor(theme, cursor)) {
+		xcursor_destroy(cursor);
+		return NULL;
+	}
+	theme->memory_used += xcursor_get_memory_size(cursor);
+	theme_evict_cursors(theme);
+	return cursor;
 }
 
 static int xcursor_frame_and_duration(struct wlr_xcursor *cursor,
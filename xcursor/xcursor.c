@@ -661,6 +661,12 @@ XcursorLibraryPath (void)
 	return path;
 }
 
+char *
+xcursor_library_path(void)
+{
+	return XcursorLibraryPath();
+}
+
 static  void
 _XcursorAddPathElt (char *path, const char *elt, int len)
 {
@@ -820,9 +826,33 @@ _XcursorThemeInherits (const char *full)
     return result;
 }
 
+XcursorImages *
+xcursor_load_file(const char *path, const char *name, int size)
+{
+	FILE *f;
+	XcursorImages *images;
+
+	f = fopen(path, "r");
+	if (!f)
+		return NULL;
+
+	images = XcursorFileLoadImages(f, size);
+	if (images)
+		XcursorImagesSetName(images, name);
+
+	fclose(f);
+	return images;
+}
+
+/*
+ * Either decode each cursor file and pass it to load_callback, or only pass
+ * its name and path to index_callback
+ */
 static void
 load_all_cursors_from_dir(const char *path, int size,
 			  void (*load_callback)(XcursorImages *, void *),
+			  void (*index_callback)(const char *, const char *,
+						 void *),
 			  void *user_data)
 {
 	FILE *f;
@@ -845,6 +875,12 @@ load_all_cursors_from_dir(const char *path, int size,
 		if (!full)
 			continue;
 
+		if (index_callback) {
+			index_callback(ent->d_name, full, user_data);
+			free(full);
+			continue;
+		}
+
 		f = fopen(full, "r");
 		if (!f) {
 			free(full);
@@ -865,29 +901,12 @@ load_all_cursors_from_dir(const char *path, int size,
 	closedir(dir);
 }
 
-/** Load all the cursor of a theme
- *
- * This function loads all the cursor images of a given theme and its
- * inherited themes. Each cursor is loaded into an XcursorImages object
- * which is passed to the caller's load callback. If a cursor appears
- * more than once across all the inherited themes, the load callback
- * will be called multiple times, with possibly different XcursorImages
- * object which have the same name. The user is expected to destroy the
- * XcursorImages objects passed to the callback with
- * XcursorImagesDestroy().
- *
- * \param theme The name of theme that should be loaded
- * \param size The desired size of the cursor images
- * \param load_callback A callback function that will be called
- * for each cursor loaded. The first parameter is the XcursorImages
- * object representing the loaded cursor and the second is a pointer
- * to data provided by the user.
- * \param user_data The data that should be passed to the load callback
- */
-void
-xcursor_load_theme(const char *theme, int size,
-		    void (*load_callback)(XcursorImages *, void *),
-		    void *user_data)
+static void
+walk_theme(const char *theme, int size,
+	   void (*load_callback)(XcursorImages *, void *),
+	   void (*index_callback)(const char *, const char *, void *),
+	   void (*path_callback)(const char *, void *),
+	   void *user_data)
 {
 	char *full, *dir;
 	char *inherits = NULL;
@@ -905,14 +924,18 @@ xcursor_load_theme(const char *theme, int size,
 		full = _XcursorBuildFullname(dir, "cursors", "");
 
 		if (full) {
+			if (path_callback)
+				path_callback(full, user_data);
 			load_all_cursors_from_dir(full, size, load_callback,
-						  user_data);
+						  index_callback, user_data);
 			free(full);
 		}
 
 		if (!inherits) {
 			full = _XcursorBuildFullname(dir, "", "index.theme");
 			if (full) {
+				if (path_callback)
+					path_callback(full, user_data);
 				inherits = _XcursorThemeInherits(full);
 				free(full);
 			}
@@ -922,9 +945,57 @@ xcursor_load_theme(const char *theme, int size,
 	}
 
 	for (i = inherits; i; i = _XcursorNextPath(i))
-		xcursor_load_theme(i, size, load_callback, user_data);
+		walk_theme(i, size, load_callback, index_callback,
+			   path_callback, user_data);
 
 	if (inherits)
 		free(inherits);
 	free(xcursor_path);
 }
+
+/** Load all the cursor of a theme
+ *
+ * This function loads all the cursor images of a given theme and its
+ * inherited themes. Each cursor is loaded into an XcursorImages object
+ * which is passed to the caller's load callback. If a cursor appears
+ * more than once across all the inherited themes, the load callback
+ * will be called multiple times, with possibly different XcursorImages
+ * object which have the same name. The user is expected to destroy the
+ * XcursorImages objects passed to the callback with
+ * XcursorImagesDestroy().
+ *
+ * \param theme The name of theme that should be loaded
+ * \param size The desired size of the cursor images
+ * \param load_callback A callback function that will be called
+ * for each cursor loaded. The first parameter is the XcursorImages
+ * object representing the loaded cursor and the second is a pointer
+ * to data provided by the user.
+ * \param path_callback An optional callback function that will be
+ * called with each directory and index.theme file consulted, whether
+ * it exists or not, before it is read.
+ * \param user_data The data that should be passed to the callbacks
+ */
+void
+xcursor_load_theme(const char *theme, int size,
+		    void (*load_callback)(XcursorImages *, void *),
+		    void (*path_callback)(const char *, void *),
+		    void *user_data)
+{
+	walk_theme(theme, size, load_callback, NULL, path_callback,
+		   user_data);
+}
+
+/** List the cursor files of a theme
+ *
+ * Like xcursor_load_theme(), but the cursor files aren't read: the
+ * index callback is called with the name and path of each cursor file
+ * instead. The files can be loaded later on with xcursor_load_file().
+ */
+void
+xcursor_index_theme(const char *theme,
+		    void (*index_callback)(const char *, const char *, void *),
+		    void (*path_callback)(const char *, void *),
+		    void *user_data)
+{
+	walk_theme(theme, 0, NULL, index_callback, path_callback, user_data);
+}
@@ -15,6 +15,7 @@
 #include <xcb/composite.h>
 #include <xcb/render.h>
 #include <xcb/res.h>
+#include <xcb/xcbext.h>
 #include <xcb/xfixes.h>
 #include "util/signal.h"
 #include "xwayland/xwm.h"
@@ -98,6 +99,16 @@ struct pending_startup_id {
 	struct wl_list link;
 };
 
+/**
+ * A GetProperty request whose reply hasn't been handled yet.
+ */
+struct pending_property {
+	xcb_get_property_cookie_t cookie;
+	struct wlr_xwayland_surface *surface; // NULL if destroyed
+	xcb_atom_t property;
+	struct wl_list link; // wlr_xwm::pending_properties
+};
+
 static const struct wlr_surface_role xwayland_surface_role;
 
 bool wlr_surface_is_xwayland_surface(struct wlr_surface *surface) {
@@ -110,16 +121,21 @@ struct wlr_xwayland_surface *wlr_xwayland_surface_from_wlr_surface(
 	return (struct wlr_xwayland_surface *)surface->role_data;
 }
 
-// TODO: replace this with hash table?
+static uint64_t surface_get_hash_key(struct wl_list *link) {
+	struct wlr_xwayland_surface *surface =
+		wl_container_of(link, surface, hash_link);
+	return surface->window_id;
+}
+
 static struct wlr_xwayland_surface *lookup_surface(struct wlr_xwm *xwm,
 		xcb_window_t window_id) {
-	struct wlr_xwayland_surface *surface;
-	wl_list_for_each(surface, &xwm->surfaces, link) {
-		if (surface->window_id == window_id) {
-			return surface;
-		}
+	struct wl_list *link = hash_table_find(&xwm->surfaces_by_id, window_id);
+	if (link == NULL) {
+		return NULL;
 	}
-	return NULL;
+	struct wlr_xwayland_surface *surface =
+		wl_container_of(link, surface, hash_link);
+	return surface;
 }
 
 static int xwayland_surface_handle_ping_timeout(void *data) {
@@ -200,6 +216,12 @@ static struct wlr_xwayland_surface *xwayland_surface_create(
 		return NULL;
 	}
 
+	if (!hash_table_insert(&xwm->surfaces_by_id, &surface->hash_link)) {
+		wl_event_source_remove(surface->ping_timer);
+		free(surface);
+		wlr_log(WLR_ERROR, "Could not allocate surface hash table");
+		return NULL;
+	}
 	wl_list_insert(&xwm->surfaces, &surface->link);
 
 	wlr_signal_emit_safe(&xwm->xwayland->events.new_surface, surface);
@@ -397,6 +419,16 @@ static void xwayland_surface_destroy(
 	}
 
 	wl_list_remove(&xsurface->link);
+	hash_table_remove(&xsurface->xwm->surfaces_by_id, &xsurface->hash_link);
+
+	if (xsurface->pending_properties > 0) {
+		struct pending_property *pending;
+		wl_list_for_each(pending, &xsurface->xwm->pending_properties, link) {
+			if (pending->surface == xsurface) {
+				pending->surface = NULL;
+			}
+		}
+	}
 	wl_list_remove(&xsurface->stack_link);
 	wl_list_remove(&xsurface->parent_link);
 
@@ -783,16 +815,9 @@ char *xwm_get_atom_name(struct wlr_xwm *xwm, xcb_atom_t atom) {
 	return name;
 }
 
-static void read_surface_property(struct wlr_xwm *xwm,
-		struct wlr_xwayland_surface *xsurface, xcb_atom_t property) {
-	xcb_get_property_cookie_t cookie = xcb_get_property(xwm->xcb_conn, 0,
-		xsurface->window_id, property, XCB_ATOM_ANY, 0, 2048);
-	xcb_get_property_reply_t *reply = xcb_get_property_reply(xwm->xcb_conn,
-		cookie, NULL);
-	if (reply == NULL) {
-		return;
-	}
-
+static void handle_surface_property(struct wlr_xwm *xwm,
+		struct wlr_xwayland_surface *xsurface, xcb_atom_t property,
+		xcb_get_property_reply_t *reply) {
 	if (property == XCB_ATOM_WM_CLASS) {
 		read_surface_class(xwm, xsurface, reply);
 	} else if (property == XCB_ATOM_WM_NAME ||
@@ -824,8 +849,101 @@ static void read_surface_property(struct wlr_xwm *xwm,
 			property, prop_name ? prop_name : "(null)", xsurface->window_id);
 		free(prop_name);
 	}
+}
 
-	free(reply);
+/**
+ * Request a property of a surface. The reply is handled asynchronously by
+ * xwm_read_property_replies(), so that many requests can be in flight without
+ * blocking the compositor.
+ */
+static void read_surface_property(struct wlr_xwm *xwm,
+		struct wlr_xwayland_surface *xsurface, xcb_atom_t property) {
+	struct pending_property *pending = calloc(1, sizeof(*pending));
+	if (pending == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return;
+	}
+	pending->cookie = xcb_get_property(xwm->xcb_conn, 0,
+		xsurface->window_id, property, XCB_ATOM_ANY, 0, 2048);
+	pending->surface = xsurface;
+	pending->property = property;
+	wl_list_insert(xwm->pending_properties.prev, &pending->link);
+	xsurface->pending_properties++;
+}
+
+static void pending_property_destroy(struct wlr_xwm *xwm,
+		struct pending_property *pending, bool discard) {
+	if (discard) {
+		xcb_discard_reply(xwm->xcb_conn, pending->cookie.sequence);
+	}
+	wl_list_remove(&pending->link);
+	free(pending);
+}
+
+static void xsurface_handle_map_request(struct wlr_xwayland_surface *xsurface);
+static void xsurface_try_map(struct wlr_xwayland_surface *xsurface);
+
+/**
+ * Handle the property replies which have been received, without blocking.
+ * Replies arrive in request order, so stop at the first one still in flight.
+ *
+ * Once all properties of a surface have been read, finish mapping it: this
+ * ensures compositors see the same state as when properties were read
+ * synchronously. Returns true if any reply has been handled.
+ */
+static bool xwm_read_property_replies(struct wlr_xwm *xwm) {
+	bool handled = false;
+	struct pending_property *pending, *tmp;
+	wl_list_for_each_safe(pending, tmp, &xwm->pending_properties, link) {
+		void *reply = NULL;
+		xcb_generic_error_t *error = NULL;
+		if (!xcb_poll_for_reply(xwm->xcb_conn, pending->cookie.sequence,
+				&reply, &error)) {
+			break;
+		}
+		handled = true;
+
+		struct wlr_xwayland_surface *xsurface = pending->surface;
+		xcb_atom_t property = pending->property;
+		pending_property_destroy(xwm, pending, false);
+		free(error);
+
+		// The window may have been destroyed in the meantime
+		if (xsurface == NULL) {
+			free(reply);
+			continue;
+		}
+
+		if (reply != NULL) {
+			handle_surface_property(xwm, xsurface, property, reply);
+			free(reply);
+		}
+
+		assert(xsurface->pending_properties > 0);
+		xsurface->pending_properties--;
+		if (xsurface->pending_properties == 0) {
+			if (xsurface->map_request_pending) {
+				xsurface->map_request_pending = false;
+				xsurface_handle_map_request(xsurface);
+			}
+			xsurface_try_map(xsurface);
+		}
+	}
+	return handled;
+}
+
+static void xsurface_try_map(struct wlr_xwayland_surface *xsurface) {
+	// Wait until the properties read when the surface was associated with
+	// the window are known
+	if (xsurface->mapped || xsurface->surface == NULL ||
+			xsurface->pending_properties > 0 ||
+			!wlr_surface_has_buffer(xsurface->surface)) {
+		return;
+	}
+
+	xsurface->mapped = true;
+	wlr_signal_emit_safe(&xsurface->events.map, xsurface);
+	xwm_set_net_client_list(xsurface->xwm);
 }
 
 static void xwayland_surface_role_commit(struct wlr_surface *wlr_surface) {
@@ -835,11 +953,7 @@ static void xwayland_surface_role_commit(struct wlr_surface *wlr_surface) {
 		return;
 	}
 
-	if (!surface->mapped && wlr_surface_has_buffer(surface->surface)) {
-		surface->mapped = true;
-		wlr_signal_emit_safe(&surface->events.map, surface);
-		xwm_set_net_client_list(surface->xwm);
-	}
+	xsurface_try_map(surface);
 }
 
 static void xwayland_surface_role_precommit(struct wlr_surface *wlr_surface,
@@ -1063,6 +1177,14 @@ void wlr_xwayland_surface_restack(struct wlr_xwayland_surface *xsurface,
 	xcb_flush(xwm->xcb_conn);
 }
 
+static void xsurface_handle_map_request(struct wlr_xwayland_surface *xsurface) {
+	xsurface_set_wm_state(xsurface, XCB_ICCCM_WM_STATE_NORMAL);
+	xsurface_set_net_wm_state(xsurface);
+
+	wlr_xwayland_surface_restack(xsurface, NULL, XCB_STACK_MODE_BELOW);
+	xcb_map_window(xsurface->xwm->xcb_conn, xsurface->window_id);
+}
+
 static void xwm_handle_map_request(struct wlr_xwm *xwm,
 		xcb_map_request_event_t *ev) {
 	struct wlr_xwayland_surface *xsurface = lookup_surface(xwm, ev->window);
@@ -1070,11 +1192,14 @@ static void xwm_handle_map_request(struct wlr_xwm *xwm,
 		return;
 	}
 
-	xsurface_set_wm_state(xsurface, XCB_ICCCM_WM_STATE_NORMAL);
-	xsurface_set_net_wm_state(xsurface);
+	if (xsurface->pending_properties > 0) {
+		// _NET_WM_STATE is written back to the window, wait until the value
+		// set by the client before mapping is known
+		xsurface->map_request_pending = true;
+		return;
+	}
 
-	wlr_xwayland_surface_restack(xsurface, NULL, XCB_STACK_MODE_BELOW);
-	xcb_map_window(xwm->xcb_conn, ev->window);
+	xsurface_handle_map_request(xsurface);
 }
 
 static void xwm_handle_map_notify(struct wlr_xwm *xwm,
@@ -1097,6 +1222,7 @@ static void xwm_handle_unmap_notify(struct wlr_xwm *xwm,
 		return;
 	}
 
+	xsurface->map_request_pending = false;
 	xsurface_unmap(xsurface);
 	xsurface_set_wm_state(xsurface, XCB_ICCCM_WM_STATE_WITHDRAWN);
 }
@@ -1643,7 +1769,8 @@ static int x11_event_handler(int fd, uint32_t mask, void *data) {
 		free(event);
 	}
 
-	if (count) {
+	// Handling replies may finish a map request
+	if (xwm_read_property_replies(xwm) || count) {
 		xcb_flush(xwm->xcb_conn);
 	}
 
@@ -1793,6 +1920,14 @@ void xwm_destroy(struct wlr_xwm *xwm) {
 		pending_startup_id_destroy(pending);
 	}
 
+	hash_table_finish(&xwm->surfaces_by_id);
+
+	struct pending_property *pending_prop, *next_prop;
+	wl_list_for_each_safe(pending_prop, next_prop, &xwm->pending_properties,
+			link) {
+		pending_property_destroy(xwm, pending_prop, false);
+	}
+
 	xwm->xwayland->xwm = NULL;
 	free(xwm);
 }
@@ -2034,7 +2169,9 @@ struct wlr_xwm *xwm_create(struct wlr_xwayland *xwayland, int wm_fd) {
 	wl_list_init(&xwm->surfaces);
 	wl_list_init(&xwm->surfaces_in_stack_order);
 	wl_list_init(&xwm->unpaired_surfaces);
+	hash_table_init(&xwm->surfaces_by_id, surface_get_hash_key);
 	wl_list_init(&xwm->pending_startup_ids);
+	wl_list_init(&xwm->pending_properties);
 	xwm->ping_timeout = 10000;
 
 	xwm->xcb_conn = xcb_connect_to_fd(wm_fd, NULL);